@@ -0,0 +1,99 @@
+#pragma once
+
+#include "BasicTypes.h"
+
+#include <string.h>
+
+namespace SHA256
+{
+	// A SHA-256 digest, as defined by FIPS 180-4.
+	struct Digest
+	{
+		U8 bytes[32];
+
+		friend bool operator==(const Digest& left,const Digest& right) { return !memcmp(left.bytes,right.bytes,sizeof(left.bytes)); }
+		friend bool operator!=(const Digest& left,const Digest& right) { return !(left == right); }
+	};
+
+	inline U32 rotateRight(U32 value,U32 numBits) { return (value >> numBits) | (value << (32 - numBits)); }
+
+	// Updates the hash state with a 64-byte block of the message.
+	inline void processBlock(U32 state[8],const U8* block)
+	{
+		static const U32 roundConstants[64] =
+		{
+			0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+			0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+			0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+			0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+			0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+			0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+			0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+			0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+		};
+
+		// Expand the block into the message schedule.
+		U32 schedule[64];
+		for(Uptr index = 0;index < 16;++index)
+		{
+			schedule[index] = (U32(block[index * 4 + 0]) << 24)
+				| (U32(block[index * 4 + 1]) << 16)
+				| (U32(block[index * 4 + 2]) << 8)
+				| U32(block[index * 4 + 3]);
+		}
+		for(Uptr index = 16;index < 64;++index)
+		{
+			const U32 s0 = rotateRight(schedule[index - 15],7) ^ rotateRight(schedule[index - 15],18) ^ (schedule[index - 15] >> 3);
+			const U32 s1 = rotateRight(schedule[index - 2],17) ^ rotateRight(schedule[index - 2],19) ^ (schedule[index - 2] >> 10);
+			schedule[index] = schedule[index - 16] + s0 + schedule[index - 7] + s1;
+		}
+
+		U32 a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+		for(Uptr index = 0;index < 64;++index)
+		{
+			const U32 s1 = rotateRight(e,6) ^ rotateRight(e,11) ^ rotateRight(e,25);
+			const U32 choice = (e & f) ^ (~e & g);
+			const U32 temp1 = h + s1 + choice + roundConstants[index] + schedule[index];
+			const U32 s0 = rotateRight(a,2) ^ rotateRight(a,13) ^ rotateRight(a,22);
+			const U32 majority = (a & b) ^ (a & c) ^ (b & c);
+			const U32 temp2 = s0 + majority;
+			h = g; g = f; f = e; e = d + temp1;
+			d = c; c = b; b = a; a = temp1 + temp2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+	}
+
+	// Computes the SHA-256 digest of a message.
+	inline Digest computeDigest(const U8* message,Uptr numBytes)
+	{
+		U32 state[8] = {0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19};
+
+		// Process the whole blocks of the message.
+		Uptr offset = 0;
+		for(;numBytes - offset >= 64;offset += 64) { processBlock(state,message + offset); }
+
+		// Pad the rest of the message with a 1 bit, zeroes, and the message's length in bits as a big-endian U64.
+		U8 finalBlocks[128] = {0};
+		const Uptr numRemainingBytes = numBytes - offset;
+		memcpy(finalBlocks,message + offset,numRemainingBytes);
+		finalBlocks[numRemainingBytes] = 0x80;
+		const Uptr numFinalBytes = numRemainingBytes < 56 ? 64 : 128;
+		const U64 numMessageBits = U64(numBytes) * 8;
+		for(Uptr byteIndex = 0;byteIndex < 8;++byteIndex)
+		{
+			finalBlocks[numFinalBytes - 1 - byteIndex] = U8(numMessageBits >> (byteIndex * 8));
+		}
+		for(Uptr finalOffset = 0;finalOffset < numFinalBytes;finalOffset += 64) { processBlock(state,finalBlocks + finalOffset); }
+
+		Digest digest;
+		for(Uptr index = 0;index < 8;++index)
+		{
+			digest.bytes[index * 4 + 0] = U8(state[index] >> 24);
+			digest.bytes[index * 4 + 1] = U8(state[index] >> 16);
+			digest.bytes[index * 4 + 2] = U8(state[index] >> 8);
+			digest.bytes[index * 4 + 3] = U8(state[index]);
+		}
+		return digest;
+	}
+}
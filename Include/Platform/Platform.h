@@ -94,6 +94,42 @@ namespace Platform
 	// baseVirtualAddress must be a multiple of the preferred page size.
 	PLATFORM_API void freeVirtualPages(U8* baseVirtualAddress,Uptr numPages);
 
+	// Advises the OS to back the specified committed virtual pages with huge pages (e.g. 2MB pages on x86-64).
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	// Returns false if the OS doesn't support huge pages for the pages.
+	PLATFORM_API bool adviseHugePages(U8* baseVirtualAddress,Uptr numPages);
+
+	// An anonymous file in memory whose pages can be mapped copy-on-write into any number of virtual address ranges.
+	struct SharedPageFile;
+
+	// Creates a shared page file with the given contents, padded with zeroes to a whole number of pages.
+	// Returns null if the platform doesn't support shared page files.
+	PLATFORM_API SharedPageFile* createSharedPageFile(const U8* bytes,Uptr numBytes);
+	PLATFORM_API void destroySharedPageFile(SharedPageFile* file);
+
+	// Maps the first numPages pages of a shared page file copy-on-write over reserved virtual pages, with read-write
+	// access. Pages are only copied when they are written. The file may be destroyed while it's still mapped.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	// Returns false if the pages couldn't be mapped.
+	PLATFORM_API bool mapSharedPageFile(SharedPageFile* file,U8* baseVirtualAddress,Uptr numPages);
+
+	// Discards the copies of pages mapped by mapSharedPageFile that were made when they were written, so they read the
+	// file's contents again. The cost is proportional to the number of pages that have been accessed since they were
+	// mapped or last reset, rather than the number of pages.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	PLATFORM_API void resetSharedPageFileMapping(U8* baseVirtualAddress,Uptr numPages);
+
+	// Replaces pages mapped by mapSharedPageFile with reserved but uncommitted pages.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	PLATFORM_API void unmapSharedPageFile(U8* baseVirtualAddress,Uptr numPages);
+
+	// Allocates committed pages that are mapped at two virtual address ranges, both with read-write access. Writes
+	// through either mapping are visible through the other, so the access of one mapping can be changed to execute
+	// while code is still written through the other, without any page being both writable and executable.
+	// Returns false if the platform doesn't support mapping the same pages twice.
+	PLATFORM_API bool allocateDualMappedPages(Uptr numPages,U8*& outFirstBaseAddress,U8*& outSecondBaseAddress);
+	PLATFORM_API void freeDualMappedPages(U8* firstBaseAddress,U8* secondBaseAddress,Uptr numPages);
+
 	//
 	// Call stack and exceptions
 	//
@@ -143,6 +179,9 @@ namespace Platform
 	// The resolution is microseconds, and the origin is arbitrary.
 	PLATFORM_API U64 getMonotonicClock();
 
+	// Returns an ID for the current process that is unique among running processes.
+	PLATFORM_API U64 getProcessID();
+
 	// Platform-independent mutexes.
 	struct Mutex;
 	PLATFORM_API Mutex* createMutex();
@@ -175,7 +214,8 @@ namespace Platform
 		Mutex* mutex;
 	};
 
-	// Platform-independent events.
+	// Platform-independent auto-reset events. Signaling an event wakes one thread that is waiting for it. If no thread
+	// is waiting, the event stays signaled until the next wait, which returns immediately and resets it.
 	struct Event;
 	PLATFORM_API Event* createEvent();
 	PLATFORM_API void destroyEvent(Event* event);
@@ -4,6 +4,8 @@
 #include "IR/IR.h"
 #include "Runtime.h"
 
+namespace Runtime { struct InstanceContext; }
+
 namespace Intrinsics
 {
 	// An intrinsic function.
@@ -114,35 +116,37 @@ namespace NativeTypes
 };
 
 // Macros for defining intrinsic functions of various arities.
+// The native function receives a hidden instanceContext parameter: when the function is called directly by compiled
+// WebAssembly code it is the context of the calling module instance, and otherwise it is null.
 #define DEFINE_INTRINSIC_FUNCTION0(module,cName,name,returnType) \
-	NativeTypes::returnType cName##returnType(); \
+	NativeTypes::returnType cName##returnType(Runtime::InstanceContext*); \
 	static Intrinsics::Function cName##returnType##Function(#module "." #name,IR::FunctionType::get(IR::ResultType::returnType),(void*)&cName##returnType); \
-	NativeTypes::returnType cName##returnType()
+	NativeTypes::returnType cName##returnType(Runtime::InstanceContext* instanceContext)
 
 #define DEFINE_INTRINSIC_FUNCTION1(module,cName,name,returnType,arg0Type,arg0Name) \
-	NativeTypes::returnType cName##returnType##arg0Type(NativeTypes::arg0Type); \
+	NativeTypes::returnType cName##returnType##arg0Type(Runtime::InstanceContext*,NativeTypes::arg0Type); \
 	static Intrinsics::Function cName##returnType##arg0Type##Function(#module "." #name,IR::FunctionType::get(IR::ResultType::returnType,{IR::ValueType::arg0Type}),(void*)&cName##returnType##arg0Type); \
-	NativeTypes::returnType cName##returnType##arg0Type(NativeTypes::arg0Type arg0Name)
+	NativeTypes::returnType cName##returnType##arg0Type(Runtime::InstanceContext* instanceContext,NativeTypes::arg0Type arg0Name)
 
 #define DEFINE_INTRINSIC_FUNCTION2(module,cName,name,returnType,arg0Type,arg0Name,arg1Type,arg1Name) \
-	NativeTypes::returnType cName##returnType##arg0Type##arg1Type(NativeTypes::arg0Type,NativeTypes::arg1Type); \
+	NativeTypes::returnType cName##returnType##arg0Type##arg1Type(Runtime::InstanceContext*,NativeTypes::arg0Type,NativeTypes::arg1Type); \
 	static Intrinsics::Function cName##returnType##arg0Type##arg1Type##Function(#module "." #name,IR::FunctionType::get(IR::ResultType::returnType,{IR::ValueType::arg0Type,IR::ValueType::arg1Type}),(void*)&cName##returnType##arg0Type##arg1Type); \
-	NativeTypes::returnType cName##returnType##arg0Type##arg1Type(NativeTypes::arg0Type arg0Name,NativeTypes::arg1Type arg1Name)
+	NativeTypes::returnType cName##returnType##arg0Type##arg1Type(Runtime::InstanceContext* instanceContext,NativeTypes::arg0Type arg0Name,NativeTypes::arg1Type arg1Name)
 
 #define DEFINE_INTRINSIC_FUNCTION3(module,cName,name,returnType,arg0Type,arg0Name,arg1Type,arg1Name,arg2Type,arg2Name) \
-	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type(NativeTypes::arg0Type,NativeTypes::arg1Type,NativeTypes::arg2Type); \
+	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type(Runtime::InstanceContext*,NativeTypes::arg0Type,NativeTypes::arg1Type,NativeTypes::arg2Type); \
 	static Intrinsics::Function cName##returnType##arg0Type##arg1Type##arg2Type##Function(#module "." #name,IR::FunctionType::get(IR::ResultType::returnType,{IR::ValueType::arg0Type,IR::ValueType::arg1Type,IR::ValueType::arg2Type}),(void*)&cName##returnType##arg0Type##arg1Type##arg2Type); \
-	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type(NativeTypes::arg0Type arg0Name,NativeTypes::arg1Type arg1Name,NativeTypes::arg2Type arg2Name)
+	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type(Runtime::InstanceContext* instanceContext,NativeTypes::arg0Type arg0Name,NativeTypes::arg1Type arg1Name,NativeTypes::arg2Type arg2Name)
 
 #define DEFINE_INTRINSIC_FUNCTION4(module,cName,name,returnType,arg0Type,arg0Name,arg1Type,arg1Name,arg2Type,arg2Name,arg3Type,arg3Name) \
-	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type(NativeTypes::arg0Type,NativeTypes::arg1Type,NativeTypes::arg2Type,NativeTypes::arg3Type); \
+	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type(Runtime::InstanceContext*,NativeTypes::arg0Type,NativeTypes::arg1Type,NativeTypes::arg2Type,NativeTypes::arg3Type); \
 	static Intrinsics::Function cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type##Function(#module "." #name,IR::FunctionType::get(IR::ResultType::returnType,{IR::ValueType::arg0Type,IR::ValueType::arg1Type,IR::ValueType::arg2Type,IR::ValueType::arg3Type}),(void*)&cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type); \
-	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type(NativeTypes::arg0Type arg0Name,NativeTypes::arg1Type arg1Name,NativeTypes::arg2Type arg2Name,NativeTypes::arg3Type arg3Name)
+	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type(Runtime::InstanceContext* instanceContext,NativeTypes::arg0Type arg0Name,NativeTypes::arg1Type arg1Name,NativeTypes::arg2Type arg2Name,NativeTypes::arg3Type arg3Name)
 
 #define DEFINE_INTRINSIC_FUNCTION5(module,cName,name,returnType,arg0Type,arg0Name,arg1Type,arg1Name,arg2Type,arg2Name,arg3Type,arg3Name,arg4Type,arg4Name) \
-	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type##arg4Type(NativeTypes::arg0Type,NativeTypes::arg1Type,NativeTypes::arg2Type,NativeTypes::arg3Type,NativeTypes::arg4Type); \
+	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type##arg4Type(Runtime::InstanceContext*,NativeTypes::arg0Type,NativeTypes::arg1Type,NativeTypes::arg2Type,NativeTypes::arg3Type,NativeTypes::arg4Type); \
 	static Intrinsics::Function cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type##arg4Type##Function(#module "." #name,IR::FunctionType::get(IR::ResultType::returnType,{IR::ValueType::arg0Type,IR::ValueType::arg1Type,IR::ValueType::arg2Type,IR::ValueType::arg3Type,IR::ValueType::arg4Type}),(void*)&cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type##arg4Type); \
-	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type##arg4Type(NativeTypes::arg0Type arg0Name,NativeTypes::arg1Type arg1Name,NativeTypes::arg2Type arg2Name,NativeTypes::arg3Type arg3Name,NativeTypes::arg4Type arg4Name)
+	NativeTypes::returnType cName##returnType##arg0Type##arg1Type##arg2Type##arg3Type##arg4Type(Runtime::InstanceContext* instanceContext,NativeTypes::arg0Type arg0Name,NativeTypes::arg1Type arg1Name,NativeTypes::arg2Type arg2Name,NativeTypes::arg3Type arg3Name,NativeTypes::arg4Type arg4Name)
 
 // Macros for defining intrinsic globals, memories, and tables.
 #define DEFINE_INTRINSIC_GLOBAL(module,cName,name,valueType,isMutable,initializer) \
@@ -16,6 +16,44 @@ namespace Runtime
 	// Initializes the runtime. Should only be called once per process.
 	RUNTIME_API void init();
 
+	// Sets a directory used to cache the object code generated for modules, so instantiating the same module
+	// in a later process doesn't need to compile it again. Passing nullptr disables the cache, which is the default.
+	RUNTIME_API void setObjectCacheDirectory(const char* directory);
+
+	// Enables tiered compilation: modules are compiled without optimization, and functions that are called often or
+	// run many loop iterations are recompiled with optimization on a background thread. It is disabled by default.
+	RUNTIME_API void setTieredCompilationEnabled(bool enable);
+
+	// Enables lazy compilation: modules are compiled to a small stub for each function, and each function's body
+	// is compiled on its first call. It is disabled by default.
+	RUNTIME_API void setLazyCompilationEnabled(bool enable);
+
+	// Sets the number of calls and loop iterations in a function's unoptimized code that cause it to be recompiled with
+	// optimization when tiered compilation is enabled. It applies to modules compiled after it's set, and is 10000 by
+	// default.
+	RUNTIME_API void setTierUpThreshold(U32 numCallsAndLoopIterations);
+
+	// Waits until the optimized code requested by tiered compilation has been compiled and has replaced the
+	// unoptimized code.
+	RUNTIME_API void waitForTieredCompilation();
+
+	// Enables placing the code of large JIT compiled modules in memory that the OS is advised to back with huge pages,
+	// to reduce instruction TLB misses. Each module's code is given whole huge pages of its own rather than being
+	// packed with other modules' code, since like other code pages they are only writable until the code is loaded.
+	// That wastes the rest of a module's last huge page, so it's only used for modules with at least 1MB of code. It is disabled
+	// by default.
+	RUNTIME_API void setHugePageCodeEnabled(bool enable);
+
+	// Enables describing JIT compiled code to the Linux perf profiler, in /tmp/perf-<pid>.map or in a jitdump file
+	// that perf inject merges into a recorded profile. They may also be enabled by setting the WAVM_PERF_MAP or
+	// WAVM_JITDUMP environment variables, and are ignored on other platforms.
+	RUNTIME_API void setPerfMapEnabled(bool enable);
+	RUNTIME_API void setJITDumpEnabled(bool enable);
+
+	// Enables registering JIT compiled code with debuggers through the GDB JIT interface, so debuggers and core dumps
+	// can symbolize it. Only code loaded while it's enabled is registered. It is disabled by default.
+	RUNTIME_API void setGDBRegistrationEnabled(bool enable);
+
 	// Information about a runtime exception.
 	struct Exception
 	{
@@ -74,6 +112,12 @@ namespace Runtime
 	struct GlobalInstance;
 	struct ModuleInstance;
 
+	// A module compiled to native code. This isn't an Object, and is only defined within Runtime.
+	struct CompiledModule;
+
+	// The context that compiled code for a module instance is called with. This is only defined within Runtime.
+	struct InstanceContext;
+
 	// A runtime object of any type.
 	struct ObjectInstance
 	{
@@ -127,6 +171,94 @@ namespace Runtime
 	// Returns the type of a FunctionInstance.
 	RUNTIME_API const IR::FunctionType* getFunctionType(FunctionInstance* function);
 
+	// Returns the native code and context that a FunctionInstance is called with. The native code takes the context
+	// followed by the function's parameters, and uses the C calling convention.
+	// Throws a Runtime::Exception if the function doesn't have the expected type.
+	RUNTIME_API void getFunctionNativeCode(
+		FunctionInstance* function,
+		const IR::FunctionType* expectedType,
+		void*& outNativeCode,
+		InstanceContext*& outContext);
+
+	// Calls thunk(thunkArgument), turning any hardware trap that occurs during the call into a Runtime::Exception.
+	RUNTIME_API void callAndTurnHardwareTrapsIntoRuntimeExceptions(void (*thunk)(void*),void* thunkArgument);
+
+	// Maps the native types used by TypedFunction to WebAssembly types.
+	template<typename Native> IR::ValueType getNativeValueType();
+	template<> inline IR::ValueType getNativeValueType<I32>() { return IR::ValueType::i32; }
+	template<> inline IR::ValueType getNativeValueType<I64>() { return IR::ValueType::i64; }
+	template<> inline IR::ValueType getNativeValueType<F32>() { return IR::ValueType::f32; }
+	template<> inline IR::ValueType getNativeValueType<F64>() { return IR::ValueType::f64; }
+	template<typename Native> IR::ResultType getNativeResultType() { return IR::asResultType(getNativeValueType<Native>()); }
+	template<> inline IR::ResultType getNativeResultType<void>() { return IR::ResultType::none; }
+
+	// Calls a lambda through callAndTurnHardwareTrapsIntoRuntimeExceptions, and returns its result.
+	template<typename Result>
+	struct TypedFunctionCall
+	{
+		template<typename Lambda>
+		static Result call(const Lambda& lambda)
+		{
+			Result result;
+			auto thunk = [&result,&lambda]{ result = lambda(); };
+			callAndTurnHardwareTrapsIntoRuntimeExceptions(&callThunk<decltype(thunk)>,&thunk);
+			return result;
+		}
+
+		template<typename Thunk>
+		static void callThunk(void* thunk) { (*(Thunk*)thunk)(); }
+	};
+	template<>
+	struct TypedFunctionCall<void>
+	{
+		template<typename Lambda>
+		static void call(const Lambda& lambda)
+		{
+			callAndTurnHardwareTrapsIntoRuntimeExceptions(&callThunk<Lambda>,(void*)&lambda);
+		}
+
+		template<typename Thunk>
+		static void callThunk(void* thunk) { (*(const Thunk*)thunk)(); }
+	};
+
+	// A FunctionInstance bound to a static C++ signature, e.g. TypedFunction<I32(I32,F64)>. The function's type is
+	// checked once when it's bound, and calls go directly to the function's native code, without allocating memory,
+	// boxing the arguments in Values, or looking up an invoke thunk.
+	// The FunctionInstance must be kept alive while the TypedFunction is used.
+	template<typename Signature> struct TypedFunction;
+	template<typename Result,typename... Args>
+	struct TypedFunction<Result(Args...)>
+	{
+		TypedFunction(): nativeCode(nullptr), context(nullptr) {}
+
+		// Throws a Runtime::Exception if the function doesn't have the signature.
+		TypedFunction(FunctionInstance* function)
+		{
+			void* nativeCodeVoid;
+			getFunctionNativeCode(
+				function,
+				IR::FunctionType::get(getNativeResultType<Result>(),{getNativeValueType<Args>()...}),
+				nativeCodeVoid,
+				context);
+			nativeCode = (NativeCode)nativeCodeVoid;
+		}
+
+		// Calls the function. Throws a Runtime::Exception if a trap occurs.
+		Result operator()(Args... args) const
+		{
+			NativeCode callNativeCode = nativeCode;
+			InstanceContext* callContext = context;
+			return TypedFunctionCall<Result>::call([&]{ return (*callNativeCode)(callContext,args...); });
+		}
+
+		operator bool() const { return nativeCode != nullptr; }
+
+	private:
+		typedef Result (*NativeCode)(InstanceContext*,Args...);
+		NativeCode nativeCode;
+		InstanceContext* context;
+	};
+
 	//
 	// Tables
 	//
@@ -134,6 +266,11 @@ namespace Runtime
 	// Creates a Table. May return null if the memory allocation fails.
 	RUNTIME_API TableInstance* createTable(IR::TableType type);
 
+	// Sets the number of tables' worth of address space that is kept reserved to be reused by new tables, so creating
+	// and destroying tables only commits and decommits the pages they use. The address space is reserved immediately.
+	// It is 0 by default.
+	RUNTIME_API void setTablePoolSize(Uptr numPooledTables);
+
 	// Reads an element from the table. Assumes that index is in bounds.
 	RUNTIME_API ObjectInstance* getTableElement(TableInstance* table,Uptr index);
 
@@ -155,6 +292,11 @@ namespace Runtime
 	// Creates a Memory. May return null if the memory allocation fails.
 	RUNTIME_API MemoryInstance* createMemory(IR::MemoryType type);
 
+	// Sets the number of memories' worth of address space that is kept reserved to be reused by new memories, so
+	// creating and destroying memories only commits and decommits the pages they use. The address space is reserved
+	// immediately. It is 0 by default.
+	RUNTIME_API void setMemoryPoolSize(Uptr numPooledMemories);
+
 	// Gets the base address of the memory's data.
 	RUNTIME_API U8* getMemoryBaseAddress(MemoryInstance* memory);
 
@@ -202,8 +344,60 @@ namespace Runtime
 		std::vector<GlobalInstance*> globals;
 	};
 
-	// Instantiates a module, bindings its imports to the specified objects. May throw InstantiationException.
-	RUNTIME_API ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports);
+	// Options that control how a module is compiled to native code.
+	struct CompileOptions
+	{
+		// The optimization level, from 0 to 3 like a C compiler's -O flag. 0 does no optimization, 1 only runs a
+		// few cheap passes, and 2 and 3 run the standard optimization pipelines with inlining and vectorization.
+		Uptr optimizationLevel;
+
+		// How much debug information to generate, like a C compiler's -g flag. It's used to describe the op each frame
+		// of a trap's call stack was executing, and by native debuggers.
+		enum class DebugInfoLevel
+		{
+			// No debug information: call stacks only include function names.
+			none,
+			// Line tables that map each instruction to the index of the op it was compiled from.
+			opIndices,
+			// Line tables, and the types of each function's parameters.
+			full
+		};
+		DebugInfoLevel debugInfoLevel;
+
+		// Whether native code added to the module by precompileModule is loaded instead of generating code for it.
+		// The native code isn't validated, so it can do anything the process can: only enable this for modules from
+		// trusted sources. Otherwise, the native code is ignored.
+		bool allowPrecompiledCode;
+
+		CompileOptions(): optimizationLevel(2), debugInfoLevel(DebugInfoLevel::opIndices), allowPrecompiledCode(false) {}
+	};
+
+	// Compiles a module to native code that can be shared by any number of instances of the module.
+	// The compiled module keeps a copy of the IR::Module, so the caller doesn't need to keep it alive.
+	RUNTIME_API CompiledModule* compileModule(const IR::Module& module,const CompileOptions& options = CompileOptions());
+
+	// Generates native code for a module, and adds it to the module in a user section. When the module is saved and
+	// later compiled with CompileOptions::allowPrecompiledCode by a runtime with the same target and version, the
+	// native code is loaded instead of generated. Only trusted modules may be loaded this way.
+	RUNTIME_API void precompileModule(IR::Module& module,const CompileOptions& options = CompileOptions());
+
+	// Releases the reference to a compiled module returned by compileModule. The compiled module is freed once
+	// all instances of it have also been freed.
+	RUNTIME_API void releaseCompiledModule(CompiledModule* compiledModule);
+
+	// Instantiates a compiled module, binding its imports to the specified objects. This doesn't generate any code:
+	// it only creates the instance's memories, tables, and globals, and copies the module's segments into them.
+	// May throw InstantiationException.
+	RUNTIME_API ModuleInstance* instantiateModule(CompiledModule* compiledModule,ImportBindings&& imports);
+
+	// Compiles and instantiates a module, bindings its imports to the specified objects. May throw InstantiationException.
+	RUNTIME_API ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports,const CompileOptions& options = CompileOptions());
+
+	// Creates a new instance of the same compiled module as another instance, with copies of the other instance's
+	// current memories, tables, and globals, without running the module's start function. This snapshots the other
+	// instance, so each call captures its memories again: to create many instances in the same state, snapshot it
+	// once and clone the snapshot instead.
+	RUNTIME_API ModuleInstance* cloneInstance(ModuleInstance* moduleInstance,ImportBindings&& imports);
 
 	// Gets the default table/memory for a ModuleInstance.
 	RUNTIME_API MemoryInstance* getDefaultMemory(ModuleInstance* moduleInstance);
@@ -211,4 +405,46 @@ namespace Runtime
 
 	// Gets an object exported by a ModuleInstance by name.
 	RUNTIME_API ObjectInstance* getInstanceExport(ModuleInstance* moduleInstance,const std::string& name);
+
+	//
+	// Instance snapshots
+	//
+
+	// The state of a module instance's memories, tables, and globals at some point, which the instance can be reset to.
+	struct InstanceSnapshot;
+
+	// Snapshots the state of a module instance, e.g. after instantiating it and running its start function. The
+	// instance must not be running on another thread. Where the platform supports it, the instance's memories are
+	// remapped copy-on-write from the snapshot, so resetting them only restores the pages that were written since.
+	// The snapshot is a root for the garbage collector until it's deleted, so the instance and the objects that were
+	// in its tables aren't freed while the snapshot may still be used to reset or clone the instance.
+	RUNTIME_API InstanceSnapshot* snapshotInstance(ModuleInstance* moduleInstance);
+
+	// Resets the memories, tables, and globals of a module instance to their state in the snapshot. The instance may
+	// be the snapshotted instance, or another instance of the same compiled module such as a clone of the snapshot,
+	// in which case its imported memories, tables, and globals aren't reset. The instance must not be running on
+	// another thread.
+	RUNTIME_API void resetInstance(ModuleInstance* moduleInstance,const InstanceSnapshot* snapshot);
+
+	// Creates a new instance of the snapshotted instance's compiled module, in the state of the snapshot, without
+	// running the module's start function. Where the platform supports it, the snapshot's memory images are mapped
+	// copy-on-write into the new instance's memories, so creating a clone doesn't copy the memories, and a clone
+	// only gets its own copy of a page when it writes to it. The new instance's imports are bound to the specified
+	// objects, and elements of its tables that referred to the snapshotted instance's functions refer to the
+	// corresponding functions of the new instance. Imported memories and tables aren't copied.
+	RUNTIME_API ModuleInstance* cloneInstance(const InstanceSnapshot* snapshot,ImportBindings&& imports);
+
+	RUNTIME_API void deleteInstanceSnapshot(InstanceSnapshot* snapshot);
+
+	// Writes the state of a module instance's memories, tables, and globals to a file, omitting memory pages that are
+	// all zeroes. Returns false if the file couldn't be written, or if a table contains a function that isn't one of
+	// the instance's functions.
+	RUNTIME_API bool saveInstanceState(ModuleInstance* moduleInstance,const char* path);
+
+	// Restores state written by saveInstanceState to an instance of the same module with the same imports, e.g. to skip
+	// running expensive initialization code. The whole file is validated before the instance is changed, and state
+	// saved from an instance of a different module is rejected. Returns false if the file isn't valid for the instance,
+	// in which case the instance is unchanged, or if the file couldn't be read or a memory couldn't be grown while
+	// restoring it, in which case the instance may be partially restored.
+	RUNTIME_API bool restoreInstanceState(ModuleInstance* moduleInstance,const char* path);
 }
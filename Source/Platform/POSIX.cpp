@@ -26,6 +26,7 @@
 #ifdef __linux__
 	#include <execinfo.h>
 	#include <dlfcn.h>
+	#include <sys/syscall.h>
 #endif
 
 namespace Platform
@@ -99,6 +100,114 @@ namespace Platform
 		if(munmap(baseVirtualAddress,numPages << getPageSizeLog2())) { Errors::fatal("munmap failed"); }
 	}
 
+	bool adviseHugePages(U8* baseVirtualAddress,Uptr numPages)
+	{
+		errorUnless(isPageAligned(baseVirtualAddress));
+		#ifdef MADV_HUGEPAGE
+			return madvise(baseVirtualAddress,numPages << getPageSizeLog2(),MADV_HUGEPAGE) == 0;
+		#else
+			return false;
+		#endif
+	}
+
+	struct SharedPageFile
+	{
+		int fd;
+	};
+
+	SharedPageFile* createSharedPageFile(const U8* bytes,Uptr numBytes)
+	{
+		#if defined(__linux__) && defined(SYS_memfd_create)
+			const int fd = int(syscall(SYS_memfd_create,"wavm-shared-pages",0));
+			if(fd < 0) { return nullptr; }
+
+			// Size the file to a whole number of pages, and write the contents to it.
+			const Uptr pageMask = (Uptr(1) << getPageSizeLog2()) - 1;
+			bool succeeded = ftruncate(fd,off_t((numBytes + pageMask) & ~pageMask)) == 0;
+			for(Uptr offset = 0;succeeded && offset < numBytes;)
+			{
+				const ssize_t numWrittenBytes = pwrite(fd,bytes + offset,numBytes - offset,off_t(offset));
+				if(numWrittenBytes <= 0) { succeeded = false; }
+				else { offset += Uptr(numWrittenBytes); }
+			}
+			if(!succeeded) { close(fd); return nullptr; }
+
+			return new SharedPageFile {fd};
+		#else
+			return nullptr;
+		#endif
+	}
+
+	void destroySharedPageFile(SharedPageFile* file)
+	{
+		// Closing the file doesn't affect existing mappings of it.
+		close(file->fd);
+		delete file;
+	}
+
+	bool mapSharedPageFile(SharedPageFile* file,U8* baseVirtualAddress,Uptr numPages)
+	{
+		errorUnless(isPageAligned(baseVirtualAddress));
+		return mmap(baseVirtualAddress,numPages << getPageSizeLog2(),PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_FIXED,file->fd,0) != MAP_FAILED;
+	}
+
+	void resetSharedPageFileMapping(U8* baseVirtualAddress,Uptr numPages)
+	{
+		// Dropping private pages of a file mapping makes them read the file's contents the next time they're accessed.
+		errorUnless(isPageAligned(baseVirtualAddress));
+		if(madvise(baseVirtualAddress,numPages << getPageSizeLog2(),MADV_DONTNEED)) { Errors::fatal("madvise failed"); }
+	}
+
+	void unmapSharedPageFile(U8* baseVirtualAddress,Uptr numPages)
+	{
+		// Decommitting private file pages would just reload them from the file, so replace them with a new anonymous mapping.
+		errorUnless(isPageAligned(baseVirtualAddress));
+		if(mmap(baseVirtualAddress,numPages << getPageSizeLog2(),PROT_NONE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,-1,0) == MAP_FAILED)
+		{
+			Errors::fatal("mmap failed");
+		}
+	}
+
+	bool allocateDualMappedPages(Uptr numPages,U8*& outFirstBaseAddress,U8*& outSecondBaseAddress)
+	{
+		#if defined(__linux__) && defined(SYS_memfd_create)
+			const int fd = int(syscall(SYS_memfd_create,"wavm-dual-mapped-pages",0));
+			if(fd < 0) { return false; }
+
+			// Map the file twice. The mappings keep the file's pages alive after it's closed.
+			const Uptr numBytes = numPages << getPageSizeLog2();
+			void* firstBaseAddress = MAP_FAILED;
+			void* secondBaseAddress = MAP_FAILED;
+			if(ftruncate(fd,off_t(numBytes)) == 0)
+			{
+				firstBaseAddress = mmap(nullptr,numBytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+				secondBaseAddress = mmap(nullptr,numBytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+			}
+			close(fd);
+
+			if(firstBaseAddress == MAP_FAILED || secondBaseAddress == MAP_FAILED)
+			{
+				if(firstBaseAddress != MAP_FAILED) { munmap(firstBaseAddress,numBytes); }
+				if(secondBaseAddress != MAP_FAILED) { munmap(secondBaseAddress,numBytes); }
+				return false;
+			}
+
+			outFirstBaseAddress = (U8*)firstBaseAddress;
+			outSecondBaseAddress = (U8*)secondBaseAddress;
+			return true;
+		#else
+			return false;
+		#endif
+	}
+
+	void freeDualMappedPages(U8* firstBaseAddress,U8* secondBaseAddress,Uptr numPages)
+	{
+		errorUnless(isPageAligned(firstBaseAddress));
+		errorUnless(isPageAligned(secondBaseAddress));
+		if(munmap(firstBaseAddress,numPages << getPageSizeLog2())) { Errors::fatal("munmap failed"); }
+		if(munmap(secondBaseAddress,numPages << getPageSizeLog2())) { Errors::fatal("munmap failed"); }
+	}
+
 	bool describeInstructionPointer(Uptr ip,std::string& outDescription)
 	{
 		#ifdef __linux__
@@ -298,6 +407,11 @@ namespace Platform
 			return U64(monotonicClock.tv_sec) * 1000000 + U64(monotonicClock.tv_nsec) / 1000;
 		#endif
 	}
+
+	U64 getProcessID()
+	{
+		return U64(getpid());
+	}
 	
 	struct Mutex
 	{
@@ -327,10 +441,13 @@ namespace Platform
 		errorUnless(!pthread_mutex_unlock(&mutex->pthreadMutex));
 	}
 
+	// Like a Windows auto-reset event, the event stays signaled until a wait consumes the signal, so a signal that
+	// arrives before the wait starts isn't lost.
 	struct Event
 	{
 		pthread_cond_t conditionVariable;
 		pthread_mutex_t mutex;
+		bool isSignaled;
 	};
 
 	Event* createEvent()
@@ -345,8 +462,9 @@ namespace Platform
 			errorUnless(!pthread_condattr_setclock(&conditionVariableAttr,CLOCK_MONOTONIC));
 		#endif
 
-		errorUnless(!pthread_cond_init(&event->conditionVariable,nullptr));
+		errorUnless(!pthread_cond_init(&event->conditionVariable,&conditionVariableAttr));
 		errorUnless(!pthread_mutex_init(&event->mutex,nullptr));
+		event->isSignaled = false;
 
 		errorUnless(!pthread_condattr_destroy(&conditionVariableAttr));
 
@@ -364,36 +482,41 @@ namespace Platform
 	{
 		errorUnless(!pthread_mutex_lock(&event->mutex));
 
-		int result;
-		if(untilTime == UINT64_MAX)
+		// Wait until the event is signaled, ignoring spurious wakeups, or until the timeout.
+		while(!event->isSignaled)
 		{
-			result = pthread_cond_wait(&event->conditionVariable,&event->mutex);
-		}
-		else
-		{
-			timespec untilTimeSpec;
-			untilTimeSpec.tv_sec = untilTime / 1000000;
-			untilTimeSpec.tv_nsec = (untilTime % 1000000) * 1000;
-
-			result = pthread_cond_timedwait(&event->conditionVariable,&event->mutex,&untilTimeSpec);
-		}
+			int result;
+			if(untilTime == UINT64_MAX)
+			{
+				result = pthread_cond_wait(&event->conditionVariable,&event->mutex);
+			}
+			else
+			{
+				timespec untilTimeSpec;
+				untilTimeSpec.tv_sec = untilTime / 1000000;
+				untilTimeSpec.tv_nsec = (untilTime % 1000000) * 1000;
 
-		errorUnless(!pthread_mutex_unlock(&event->mutex));
+				result = pthread_cond_timedwait(&event->conditionVariable,&event->mutex,&untilTimeSpec);
+			}
 
-		if(result == ETIMEDOUT)
-		{
-			return false;
-		}
-		else
-		{
+			if(result == ETIMEDOUT) { break; }
 			errorUnless(!result);
-			return true;
 		}
+
+		// Consume the signal, if there was one.
+		const bool wasSignaled = event->isSignaled;
+		event->isSignaled = false;
+
+		errorUnless(!pthread_mutex_unlock(&event->mutex));
+		return wasSignaled;
 	}
 
 	void signalEvent(Event* event)
 	{
+		errorUnless(!pthread_mutex_lock(&event->mutex));
+		event->isSignaled = true;
 		errorUnless(!pthread_cond_signal(&event->conditionVariable));
+		errorUnless(!pthread_mutex_unlock(&event->mutex));
 	}
 }
 
@@ -85,6 +85,61 @@ namespace Platform
 		if(baseVirtualAddress && !result) { Errors::fatal("VirtualFree(MEM_RELEASE) failed"); }
 	}
 
+	struct SharedPageFile {};
+
+	// Mapping a file view over part of a reserved range requires splitting the reservation, so shared page files
+	// aren't supported, and callers fall back to copying the contents.
+	SharedPageFile* createSharedPageFile(const U8* bytes,Uptr numBytes) { return nullptr; }
+	void destroySharedPageFile(SharedPageFile* file) { Errors::unreachable(); }
+	bool mapSharedPageFile(SharedPageFile* file,U8* baseVirtualAddress,Uptr numPages) { Errors::unreachable(); }
+	void resetSharedPageFileMapping(U8* baseVirtualAddress,Uptr numPages) { Errors::unreachable(); }
+	void unmapSharedPageFile(U8* baseVirtualAddress,Uptr numPages) { Errors::unreachable(); }
+
+	bool allocateDualMappedPages(Uptr numPages,U8*& outFirstBaseAddress,U8*& outSecondBaseAddress)
+	{
+		// Create a pagefile-backed section that allows execute access, so a view of it can be made executable.
+		const U64 numBytes = U64(numPages) << getPageSizeLog2();
+		HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE,nullptr,PAGE_EXECUTE_READWRITE,DWORD(numBytes >> 32),DWORD(numBytes),nullptr);
+		if(!section) { return false; }
+
+		// Map two views of the section, which keep it alive after its handle is closed. Both views are read-write, but
+		// may have their access changed to execute by VirtualProtect.
+		void* firstBaseAddress = MapViewOfFile(section,FILE_MAP_WRITE | FILE_MAP_EXECUTE,0,0,SIZE_T(numBytes));
+		void* secondBaseAddress = MapViewOfFile(section,FILE_MAP_WRITE | FILE_MAP_EXECUTE,0,0,SIZE_T(numBytes));
+		CloseHandle(section);
+
+		if(!firstBaseAddress || !secondBaseAddress)
+		{
+			if(firstBaseAddress) { UnmapViewOfFile(firstBaseAddress); }
+			if(secondBaseAddress) { UnmapViewOfFile(secondBaseAddress); }
+			return false;
+		}
+
+		// The views are initially read-write-execute, so restrict them to read-write.
+		DWORD oldProtection = 0;
+		errorUnless(VirtualProtect(firstBaseAddress,SIZE_T(numBytes),PAGE_READWRITE,&oldProtection));
+		errorUnless(VirtualProtect(secondBaseAddress,SIZE_T(numBytes),PAGE_READWRITE,&oldProtection));
+
+		outFirstBaseAddress = (U8*)firstBaseAddress;
+		outSecondBaseAddress = (U8*)secondBaseAddress;
+		return true;
+	}
+
+	void freeDualMappedPages(U8* firstBaseAddress,U8* secondBaseAddress,Uptr numPages)
+	{
+		errorUnless(isPageAligned(firstBaseAddress));
+		errorUnless(isPageAligned(secondBaseAddress));
+		if(!UnmapViewOfFile(firstBaseAddress) || !UnmapViewOfFile(secondBaseAddress)) { Errors::fatal("UnmapViewOfFile failed"); }
+	}
+
+	bool adviseHugePages(U8* baseVirtualAddress,Uptr numPages)
+	{
+		// Windows only provides large pages for memory that is allocated with MEM_LARGE_PAGES by a process with
+		// SeLockMemoryPrivilege, so existing pages can't be promoted to huge pages.
+		errorUnless(isPageAligned(baseVirtualAddress));
+		return false;
+	}
+
 	// The interface to the DbgHelp DLL
 	struct DbgHelp
 	{
@@ -287,6 +342,11 @@ namespace Platform
 			: performanceCounter.QuadPart * (wavmFrequency / performanceCounterFrequency.QuadPart);
 	}
 
+	U64 getProcessID()
+	{
+		return U64(GetCurrentProcessId());
+	}
+
 	struct Mutex
 	{
 		CRITICAL_SECTION criticalSection;
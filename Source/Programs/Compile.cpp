@@ -0,0 +1,49 @@
+#include "Inline/BasicTypes.h"
+#include "CLI.h"
+#include "WAST/WAST.h"
+#include "WASM/WASM.h"
+#include "Runtime/Runtime.h"
+
+int commandMain(int argc,char** argv)
+{
+	if(argc < 3)
+	{
+		std::cerr << "Usage: Compile in.wast|in.wasm out.wasm [switches]" << std::endl;
+		std::cerr << "  -O0|-O1|-O2|-O3\t\tSet the optimization level (default: -O2)" << std::endl;
+		std::cerr << "  -g0|-g1|-g2\t\t\tSet the debug info level: none, op indices, or full (default: -g1)" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const char* inputFilename = argv[1];
+	const char* outputFilename = argv[2];
+	Runtime::CompileOptions compileOptions;
+	for(Iptr argumentIndex = 3;argumentIndex < argc;++argumentIndex)
+	{
+		const char* argument = argv[argumentIndex];
+		if(!strcmp(argument,"-O0") || !strcmp(argument,"-O1") || !strcmp(argument,"-O2") || !strcmp(argument,"-O3"))
+		{
+			compileOptions.optimizationLevel = Uptr(argument[2] - '0');
+		}
+		else if(!strcmp(argument,"-g0") || !strcmp(argument,"-g1") || !strcmp(argument,"-g2"))
+		{
+			compileOptions.debugInfoLevel = Runtime::CompileOptions::DebugInfoLevel(argument[2] - '0');
+		}
+		else
+		{
+			std::cerr << "Unrecognized argument: " << argument << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Load the module.
+	IR::Module module;
+	if(!loadModule(inputFilename,module)) { return EXIT_FAILURE; }
+
+	// Generate native code for the module, and add it to the module.
+	Runtime::init();
+	Runtime::precompileModule(module,compileOptions);
+
+	// Write the binary module with the precompiled code.
+	if(!saveBinaryModule(outputFilename,module)) { return EXIT_FAILURE; }
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,528 @@
+#include "Inline/BasicTypes.h"
+#include "Runtime/Runtime.h"
+
+#include "CLI.h"
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+	#include <unistd.h>
+#endif
+
+using namespace IR;
+using namespace Runtime;
+
+// Tests of the runtime's embedding API that can't be expressed as a WAST test script.
+
+static Uptr numFailedChecks = 0;
+
+#define CHECK(condition) \
+	if(!(condition)) \
+	{ \
+		std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #condition << std::endl; \
+		++numFailedChecks; \
+	}
+
+static void parseTestModule(const char* wastString,IR::Module& outModule)
+{
+	errorUnless(loadTextModule("test module",wastString,outModule));
+}
+
+static I32 invokeI32Export(ModuleInstance* moduleInstance,const char* exportName,const std::vector<Value>& parameters = {})
+{
+	return invokeFunction(asFunction(getInstanceExport(moduleInstance,exportName)),parameters).i32;
+}
+
+// Returns the cause of the Runtime::Exception thrown by a function, or unknown if it doesn't throw one.
+static Exception::Cause getExceptionCause(const std::function<void()>& function)
+{
+	try { function(); }
+	catch(const Exception& exception) { return exception.cause; }
+	return Exception::Cause::unknown;
+}
+
+static U8 getMemoryByte(ModuleInstance* moduleInstance,Uptr address)
+{
+	return getMemoryBaseAddress(getDefaultMemory(moduleInstance))[address];
+}
+
+// A module with a memory, a mutable global, and a table, and functions to change and read them.
+static const char* counterModuleWAST =
+	"(module\n"
+	"  (type $getter (func (result i32)))\n"
+	"  (memory 1 4)\n"
+	"  (data (i32.const 0) \"\\2a\")\n"
+	"  (global $counter (mut i32) (i32.const 0))\n"
+	"  (table 2 4 anyfunc)\n"
+	"  (elem (i32.const 0) $getCounter)\n"
+	"  (export \"getByteElement\" (func $getByte))\n"
+	"  (func $getCounter (type $getter) (get_global $counter))\n"
+	"  (func $getByte (type $getter) (i32.load8_u (i32.const 0)))\n"
+	"  (func (export \"increment\") (result i32)\n"
+	"    (set_global $counter (i32.add (get_global $counter) (i32.const 1)))\n"
+	"    (i32.store8 (i32.const 0) (i32.add (i32.load8_u (i32.const 0)) (i32.const 1)))\n"
+	"    (get_global $counter))\n"
+	"  (func (export \"getByte\") (result i32) (call $getByte))\n"
+	"  (func (export \"grow\") (result i32) (grow_memory (i32.const 1)))\n"
+	"  (func (export \"memorySize\") (result i32) (current_memory))\n"
+	"  (func (export \"callElement\") (param i32) (result i32) (call_indirect $getter (get_local 0))))\n";
+
+// Instantiates one compiled module twice, and checks that the instances share its code but not its state.
+static void testInstantiateCompiledModuleTwice()
+{
+	IR::Module module;
+	parseTestModule(counterModuleWAST,module);
+	CompiledModule* compiledModule = compileModule(module);
+
+	ModuleInstance* instanceA = instantiateModule(compiledModule,ImportBindings());
+	ModuleInstance* instanceB = instantiateModule(compiledModule,ImportBindings());
+
+	// The instances must remain usable after the handle to the compiled module is released.
+	releaseCompiledModule(compiledModule);
+
+	CHECK(invokeI32Export(instanceA,"increment") == 1);
+	CHECK(invokeI32Export(instanceA,"increment") == 2);
+	CHECK(invokeI32Export(instanceB,"increment") == 1);
+	CHECK(getMemoryByte(instanceA,0) == 0x2c);
+	CHECK(getMemoryByte(instanceB,0) == 0x2b);
+	CHECK(invokeI32Export(instanceA,"callElement",{I32(0)}) == 2);
+	CHECK(invokeI32Export(instanceB,"callElement",{I32(0)}) == 1);
+
+	freeUnreferencedObjects({});
+}
+
+// Calls functions through TypedFunction, and checks that binding a function to the wrong signature throws.
+static void testTypedFunction()
+{
+	IR::Module module;
+	parseTestModule(counterModuleWAST,module);
+	ModuleInstance* moduleInstance = instantiateModule(module,ImportBindings());
+
+	FunctionInstance* increment = asFunction(getInstanceExport(moduleInstance,"increment"));
+	TypedFunction<I32()> typedIncrement(increment);
+	CHECK(typedIncrement);
+	CHECK(typedIncrement() == 1);
+	CHECK(typedIncrement() == 2);
+	CHECK(invokeI32Export(moduleInstance,"increment") == 3);
+
+	TypedFunction<I32(I32)> callElement(asFunction(getInstanceExport(moduleInstance,"callElement")));
+	CHECK(callElement(0) == 3);
+
+	// A trap in the called function is thrown as a Runtime::Exception.
+	CHECK(getExceptionCause([&]{ callElement(1); }) == Exception::Cause::undefinedTableElement);
+
+	// Binding a function to a signature that doesn't match its type throws before anything is called.
+	CHECK(getExceptionCause([&]{ TypedFunction<I64()> wrongResult(increment); }) == Exception::Cause::invokeSignatureMismatch);
+	CHECK(getExceptionCause([&]{ TypedFunction<I32(I32)> wrongParameters(increment); }) == Exception::Cause::invokeSignatureMismatch);
+	CHECK(getExceptionCause([&]{ TypedFunction<void()> wrongVoidResult(increment); }) == Exception::Cause::invokeSignatureMismatch);
+	CHECK(invokeI32Export(moduleInstance,"increment") == 4);
+
+	freeUnreferencedObjects({});
+}
+
+// Resets an instance to a snapshot after growing its memory and writing to its memory, globals, and table.
+static void testResetInstance()
+{
+	IR::Module module;
+	parseTestModule(counterModuleWAST,module);
+	ModuleInstance* moduleInstance = instantiateModule(module,ImportBindings());
+	MemoryInstance* memory = getDefaultMemory(moduleInstance);
+	TableInstance* table = getDefaultTable(moduleInstance);
+	ObjectInstance* getByteElement = getInstanceExport(moduleInstance,"getByteElement");
+
+	CHECK(invokeI32Export(moduleInstance,"increment") == 1);
+	InstanceSnapshot* snapshot = snapshotInstance(moduleInstance);
+
+	// Reset the instance several times, to check that resetting doesn't change the snapshot.
+	for(Uptr resetIndex = 0;resetIndex < 3;++resetIndex)
+	{
+		CHECK(invokeI32Export(moduleInstance,"increment") == 2);
+		CHECK(invokeI32Export(moduleInstance,"increment") == 3);
+		CHECK(invokeI32Export(moduleInstance,"grow") == 1);
+		CHECK(invokeI32Export(moduleInstance,"memorySize") == 2);
+		getMemoryBaseAddress(memory)[IR::numBytesPerPage] = 0xff;
+		setTableElement(table,0,getByteElement);
+		setTableElement(table,1,getByteElement);
+		CHECK(invokeI32Export(moduleInstance,"callElement",{I32(1)}) == 0x2d);
+
+		resetInstance(moduleInstance,snapshot);
+
+		CHECK(invokeI32Export(moduleInstance,"memorySize") == 1);
+		CHECK(getMemoryByte(moduleInstance,0) == 0x2b);
+		CHECK(getExceptionCause([&]{ invokeI32Export(moduleInstance,"callElement",{I32(1)}); }) == Exception::Cause::undefinedTableElement);
+		CHECK(invokeI32Export(moduleInstance,"callElement",{I32(0)}) == 1);
+
+		// Pages that were added since the snapshot are zero when the memory is grown again.
+		CHECK(invokeI32Export(moduleInstance,"grow") == 1);
+		CHECK(getMemoryByte(moduleInstance,IR::numBytesPerPage) == 0);
+		resetInstance(moduleInstance,snapshot);
+	}
+
+	deleteInstanceSnapshot(snapshot);
+	freeUnreferencedObjects({});
+}
+
+// Saves an instance's state to a file and restores it to another instance, and checks that truncated files and files
+// saved from a different module are rejected without changing the instance.
+static void testSaveAndRestoreInstanceState()
+{
+	const char* statePath = "RuntimeTest.state";
+	const char* truncatedStatePath = "RuntimeTest.truncated.state";
+
+	IR::Module module;
+	parseTestModule(counterModuleWAST,module);
+	CompiledModule* compiledModule = compileModule(module);
+
+	ModuleInstance* savedInstance = instantiateModule(compiledModule,ImportBindings());
+	CHECK(invokeI32Export(savedInstance,"increment") == 1);
+	CHECK(invokeI32Export(savedInstance,"increment") == 2);
+	CHECK(invokeI32Export(savedInstance,"grow") == 1);
+	getMemoryBaseAddress(getDefaultMemory(savedInstance))[IR::numBytesPerPage + 10] = 0x7f;
+	setTableElement(getDefaultTable(savedInstance),1,getInstanceExport(savedInstance,"getByteElement"));
+	CHECK(saveInstanceState(savedInstance,statePath));
+
+	// Restore the state to another instance of the module. Its table element refers to its own getByte function.
+	ModuleInstance* restoredInstance = instantiateModule(compiledModule,ImportBindings());
+	CHECK(restoreInstanceState(restoredInstance,statePath));
+	CHECK(invokeI32Export(restoredInstance,"memorySize") == 2);
+	CHECK(getMemoryByte(restoredInstance,0) == 0x2c);
+	CHECK(getMemoryByte(restoredInstance,IR::numBytesPerPage + 10) == 0x7f);
+	CHECK(invokeI32Export(restoredInstance,"callElement",{I32(0)}) == 2);
+	getMemoryBaseAddress(getDefaultMemory(restoredInstance))[0] = 0x30;
+	CHECK(invokeI32Export(restoredInstance,"callElement",{I32(1)}) == 0x30);
+	CHECK(getMemoryByte(savedInstance,0) == 0x2c);
+
+	// Write a copy of the state that is missing its last byte.
+	const std::string stateBytes = loadFile(statePath);
+	CHECK(stateBytes.size() > 1);
+	{
+		std::ofstream truncatedStream(truncatedStatePath,std::ios::binary | std::ios::out | std::ios::trunc);
+		truncatedStream.write(stateBytes.data(),stateBytes.size() - 1);
+	}
+
+	// Restoring the truncated state fails, and leaves the instance unchanged.
+	ModuleInstance* unrestoredInstance = instantiateModule(compiledModule,ImportBindings());
+	CHECK(invokeI32Export(unrestoredInstance,"increment") == 1);
+	CHECK(!restoreInstanceState(unrestoredInstance,truncatedStatePath));
+	CHECK(invokeI32Export(unrestoredInstance,"memorySize") == 1);
+	CHECK(getMemoryByte(unrestoredInstance,0) == 0x2b);
+	CHECK(invokeI32Export(unrestoredInstance,"callElement",{I32(0)}) == 1);
+	CHECK(getExceptionCause([&]{ invokeI32Export(unrestoredInstance,"callElement",{I32(1)}); }) == Exception::Cause::undefinedTableElement);
+
+	// Restoring the state to an instance of a module with the same shape but different contents fails.
+	std::string otherModuleWAST = counterModuleWAST;
+	otherModuleWAST.replace(otherModuleWAST.find("\\2a"),3,"\\2b");
+	IR::Module otherModule;
+	parseTestModule(otherModuleWAST.c_str(),otherModule);
+	ModuleInstance* otherInstance = instantiateModule(otherModule,ImportBindings());
+	CHECK(!restoreInstanceState(otherInstance,statePath));
+	CHECK(getMemoryByte(otherInstance,0) == 0x2b);
+
+	std::remove(statePath);
+	std::remove(truncatedStatePath);
+	releaseCompiledModule(compiledModule);
+	freeUnreferencedObjects({});
+}
+
+// Clones a snapshot twice, and checks that writes to the source instance and each clone aren't visible to the others.
+static void testCloneInstance()
+{
+	IR::Module module;
+	parseTestModule(counterModuleWAST,module);
+	ModuleInstance* sourceInstance = instantiateModule(module,ImportBindings());
+	CHECK(invokeI32Export(sourceInstance,"increment") == 1);
+	setTableElement(getDefaultTable(sourceInstance),1,getInstanceExport(sourceInstance,"getByteElement"));
+	InstanceSnapshot* snapshot = snapshotInstance(sourceInstance);
+
+	// The snapshot keeps the source instance and its table elements alive without any other roots.
+	freeUnreferencedObjects({});
+
+	ModuleInstance* cloneA = cloneInstance(snapshot,ImportBindings());
+	ModuleInstance* cloneB = cloneInstance(snapshot,ImportBindings());
+
+	CHECK(invokeI32Export(cloneA,"increment") == 2);
+	CHECK(invokeI32Export(cloneA,"increment") == 3);
+	CHECK(invokeI32Export(cloneB,"increment") == 2);
+	CHECK(invokeI32Export(sourceInstance,"increment") == 2);
+	getMemoryBaseAddress(getDefaultMemory(sourceInstance))[0] = 0x40;
+	CHECK(invokeI32Export(cloneA,"grow") == 1);
+
+	CHECK(getMemoryByte(sourceInstance,0) == 0x40);
+	CHECK(getMemoryByte(cloneA,0) == 0x2d);
+	CHECK(getMemoryByte(cloneB,0) == 0x2c);
+	CHECK(invokeI32Export(sourceInstance,"memorySize") == 1);
+	CHECK(invokeI32Export(cloneB,"memorySize") == 1);
+
+	// The cloned table elements refer to each clone's own functions.
+	CHECK(invokeI32Export(cloneA,"callElement",{I32(0)}) == 3);
+	CHECK(invokeI32Export(cloneA,"callElement",{I32(1)}) == 0x2d);
+	CHECK(invokeI32Export(cloneB,"callElement",{I32(0)}) == 2);
+	CHECK(invokeI32Export(cloneB,"callElement",{I32(1)}) == 0x2c);
+
+	// A clone can be reset to the snapshot it was cloned from without affecting the other instances.
+	resetInstance(cloneA,snapshot);
+	CHECK(invokeI32Export(cloneA,"memorySize") == 1);
+	CHECK(getMemoryByte(cloneA,0) == 0x2b);
+	CHECK(invokeI32Export(cloneA,"callElement",{I32(0)}) == 1);
+	CHECK(getMemoryByte(cloneB,0) == 0x2c);
+	CHECK(getMemoryByte(sourceInstance,0) == 0x40);
+
+	// Cloning the source instance directly copies its current state.
+	ModuleInstance* cloneC = cloneInstance(sourceInstance,ImportBindings());
+	CHECK(getMemoryByte(cloneC,0) == 0x40);
+	CHECK(invokeI32Export(cloneC,"increment") == 3);
+	CHECK(invokeI32Export(sourceInstance,"callElement",{I32(0)}) == 2);
+	CHECK(getMemoryByte(sourceInstance,0) == 0x40);
+
+	deleteInstanceSnapshot(snapshot);
+	freeUnreferencedObjects({});
+}
+
+// Compiles a module with tiered compilation and a low tier-up threshold, and checks that its functions still return
+// the same results after they are replaced with optimized code.
+static void testTierUp()
+{
+	setTieredCompilationEnabled(true);
+	setTierUpThreshold(100);
+
+	IR::Module module;
+	parseTestModule(
+		"(module\n"
+		"  (func $addOne (param i32) (result i32) (i32.add (get_local 0) (i32.const 1)))\n"
+		"  (func (export \"count\") (param i32) (result i32) (local i32)\n"
+		"    (block $done (loop $loop\n"
+		"      (br_if $done (i32.eqz (get_local 0)))\n"
+		"      (set_local 1 (call $addOne (get_local 1)))\n"
+		"      (set_local 0 (i32.sub (get_local 0) (i32.const 1)))\n"
+		"      (br $loop)))\n"
+		"    (get_local 1)))\n",
+		module);
+	ModuleInstance* moduleInstance = instantiateModule(module,ImportBindings());
+
+	// The first call crosses the threshold for both functions, so later calls use the optimized code.
+	CHECK(invokeI32Export(moduleInstance,"count",{I32(10)}) == 10);
+	CHECK(invokeI32Export(moduleInstance,"count",{I32(1000)}) == 1000);
+	waitForTieredCompilation();
+	CHECK(invokeI32Export(moduleInstance,"count",{I32(1000)}) == 1000);
+	CHECK(invokeI32Export(moduleInstance,"count",{I32(0)}) == 0);
+
+	setTierUpThreshold(10000);
+	setTieredCompilationEnabled(false);
+	freeUnreferencedObjects({});
+}
+
+// Instantiates a module with enough data to initialize its memory from a shared memory image, and checks that the
+// instances see the data but not each other's writes to it.
+static void testMemoryImage()
+{
+	// Make a 64KB data segment that starts partway into the first page and crosses into the second page.
+	const Uptr numDataBytes = 64 * 1024;
+	const Uptr dataBaseOffset = 100;
+	std::string wastString = "(module\n  (memory 2)\n  (data (i32.const 100) \"";
+	for(Uptr byteIndex = 0;byteIndex < numDataBytes;++byteIndex)
+	{
+		char escapedByte[4];
+		snprintf(escapedByte,sizeof(escapedByte),"\\%02x",U8(byteIndex * 7 + 3));
+		wastString += escapedByte;
+	}
+	wastString += "\")\n"
+		"  (func (export \"storeByte\") (param i32 i32) (i32.store8 (get_local 0) (get_local 1))))\n";
+
+	IR::Module module;
+	parseTestModule(wastString.c_str(),module);
+	CompiledModule* compiledModule = compileModule(module);
+	ModuleInstance* instanceA = instantiateModule(compiledModule,ImportBindings());
+	ModuleInstance* instanceB = instantiateModule(compiledModule,ImportBindings());
+	releaseCompiledModule(compiledModule);
+
+	bool isDataCorrect = true;
+	for(Uptr byteIndex = 0;byteIndex < numDataBytes;++byteIndex)
+	{
+		if(getMemoryByte(instanceA,dataBaseOffset + byteIndex) != U8(byteIndex * 7 + 3)
+		|| getMemoryByte(instanceB,dataBaseOffset + byteIndex) != U8(byteIndex * 7 + 3))
+		{ isDataCorrect = false; }
+	}
+	CHECK(isDataCorrect);
+	CHECK(getMemoryByte(instanceA,dataBaseOffset - 1) == 0);
+	CHECK(getMemoryByte(instanceA,dataBaseOffset + numDataBytes) == 0);
+
+	// Write to the data in one instance, and check that the other instance still sees the original data.
+	invokeFunction(asFunction(getInstanceExport(instanceA,"storeByte")),{I32(dataBaseOffset),I32(0xff)});
+	invokeFunction(asFunction(getInstanceExport(instanceA,"storeByte")),{I32(dataBaseOffset + numDataBytes - 1),I32(0xff)});
+	CHECK(getMemoryByte(instanceA,dataBaseOffset) == 0xff);
+	CHECK(getMemoryByte(instanceA,dataBaseOffset + numDataBytes - 1) == 0xff);
+	CHECK(getMemoryByte(instanceB,dataBaseOffset) == U8(3));
+	CHECK(getMemoryByte(instanceB,dataBaseOffset + numDataBytes - 1) == U8((numDataBytes - 1) * 7 + 3));
+
+	freeUnreferencedObjects({});
+}
+
+// Checks that the address space of a freed memory and table is reused by new ones, and that they start zeroed.
+static void testMemoryAndTablePools()
+{
+	setMemoryPoolSize(1);
+	setTablePoolSize(1);
+
+	MemoryInstance* memory = createMemory(MemoryType(false,{1,4}));
+	U8* memoryBaseAddress = getMemoryBaseAddress(memory);
+	memoryBaseAddress[0] = 0x2a;
+	memoryBaseAddress[IR::numBytesPerPage - 1] = 0x2a;
+	freeUnreferencedObjects({});
+
+	MemoryInstance* reusedMemory = createMemory(MemoryType(false,{1,4}));
+	CHECK(getMemoryBaseAddress(reusedMemory) == memoryBaseAddress);
+	CHECK(getMemoryBaseAddress(reusedMemory)[0] == 0);
+	CHECK(getMemoryBaseAddress(reusedMemory)[IR::numBytesPerPage - 1] == 0);
+	freeUnreferencedObjects({});
+
+	// Set an element that isn't initialized by the module, and check that it's undefined in the next instance.
+	IR::Module module;
+	parseTestModule(counterModuleWAST,module);
+	ModuleInstance* moduleInstance = instantiateModule(module,ImportBindings());
+	setTableElement(getDefaultTable(moduleInstance),1,getInstanceExport(moduleInstance,"getByteElement"));
+	CHECK(invokeI32Export(moduleInstance,"callElement",{I32(1)}) == 0x2a);
+	freeUnreferencedObjects({});
+
+	ModuleInstance* reusedInstance = instantiateModule(module,ImportBindings());
+	CHECK(getExceptionCause([&]{ invokeI32Export(reusedInstance,"callElement",{I32(1)}); }) == Exception::Cause::undefinedTableElement);
+	CHECK(invokeI32Export(reusedInstance,"callElement",{I32(0)}) == 0);
+
+	setMemoryPoolSize(0);
+	setTablePoolSize(0);
+	freeUnreferencedObjects({});
+}
+
+#ifdef __linux__
+	// Reads a whole file, or returns false if it can't be opened.
+	static bool readFile(const std::string& path,std::vector<U8>& outBytes)
+	{
+		FILE* file = fopen(path.c_str(),"rb");
+		if(!file) { return false; }
+		U8 buffer[4096];
+		Uptr numReadBytes;
+		while((numReadBytes = fread(buffer,1,sizeof(buffer),file)) > 0) { outBytes.insert(outBytes.end(),buffer,buffer + numReadBytes); }
+		fclose(file);
+		return true;
+	}
+
+	static void instantiateModuleWithFunctionName(const char* functionName)
+	{
+		IR::Module module;
+		parseTestModule(("(module (func $" + std::string(functionName) + " (export \"f\") (result i32) (i32.const 1)))").c_str(),module);
+		ModuleInstance* moduleInstance = instantiateModule(module,ImportBindings());
+		CHECK(invokeI32Export(moduleInstance,"f") == 1);
+	}
+
+	// Enables the perf map, then the jitdump file after the perf map has been written, and checks that each describes
+	// the code compiled while it was enabled.
+	static void testPerfMapAndJITDump()
+	{
+		const std::string processId = std::to_string(getpid());
+		const std::string perfMapPath = "/tmp/perf-" + processId + ".map";
+		const char* jitDumpDirectory = getenv("JITDUMPDIR");
+		const std::string jitDumpPath = std::string(jitDumpDirectory ? jitDumpDirectory : "/tmp") + "/jit-" + processId + ".dump";
+
+		setPerfMapEnabled(true);
+		instantiateModuleWithFunctionName("perfMapTestA");
+		setJITDumpEnabled(true);
+		instantiateModuleWithFunctionName("perfMapTestB");
+		setPerfMapEnabled(false);
+		setJITDumpEnabled(false);
+		instantiateModuleWithFunctionName("perfMapTestC");
+
+		// Each line of the perf map is "<address> <size> <name>".
+		std::vector<U8> perfMapBytes;
+		CHECK(readFile(perfMapPath,perfMapBytes));
+		const std::string perfMap(perfMapBytes.begin(),perfMapBytes.end());
+		CHECK(perfMap.find("_perfMapTestA\n") != std::string::npos);
+		CHECK(perfMap.find("_perfMapTestB\n") != std::string::npos);
+		CHECK(perfMap.find("_perfMapTestC\n") == std::string::npos);
+
+		// The jitdump file is a 40 byte header followed by records that start with their ID and size. Each code load
+		// record is followed by the symbol name and the code.
+		std::vector<U8> jitDumpBytes;
+		CHECK(readFile(jitDumpPath,jitDumpBytes));
+		const Uptr numHeaderBytes = 40;
+		const Uptr numCodeLoadRecordBytes = 56;
+		U32 magic = 0;
+		if(jitDumpBytes.size() >= numHeaderBytes) { memcpy(&magic,jitDumpBytes.data(),sizeof(magic)); }
+		CHECK(magic == 0x4A695444);
+
+		std::vector<std::string> codeLoadNames;
+		bool areRecordsValid = jitDumpBytes.size() >= numHeaderBytes;
+		for(Uptr offset = numHeaderBytes;areRecordsValid && offset < jitDumpBytes.size();)
+		{
+			U32 recordId = 0;
+			U32 recordNumBytes = 0;
+			if(jitDumpBytes.size() - offset < 16) { areRecordsValid = false; break; }
+			memcpy(&recordId,jitDumpBytes.data() + offset,sizeof(recordId));
+			memcpy(&recordNumBytes,jitDumpBytes.data() + offset + 4,sizeof(recordNumBytes));
+			if(recordNumBytes < 16 || recordNumBytes > jitDumpBytes.size() - offset) { areRecordsValid = false; break; }
+
+			if(recordId == 0)
+			{
+				U64 codeSize = 0;
+				memcpy(&codeSize,jitDumpBytes.data() + offset + 40,sizeof(codeSize));
+				const std::string name((const char*)jitDumpBytes.data() + offset + numCodeLoadRecordBytes);
+				if(recordNumBytes != numCodeLoadRecordBytes + name.size() + 1 + codeSize) { areRecordsValid = false; }
+				codeLoadNames.push_back(name);
+			}
+			offset += recordNumBytes;
+		}
+		CHECK(areRecordsValid);
+
+		Uptr numTestANames = 0;
+		Uptr numTestBNames = 0;
+		Uptr numTestCNames = 0;
+		for(const std::string& name : codeLoadNames)
+		{
+			if(name.find("_perfMapTestA") != std::string::npos) { ++numTestANames; }
+			if(name.find("_perfMapTestB") != std::string::npos) { ++numTestBNames; }
+			if(name.find("_perfMapTestC") != std::string::npos) { ++numTestCNames; }
+		}
+		CHECK(numTestANames == 0);
+		CHECK(numTestBNames == 1);
+		CHECK(numTestCNames == 0);
+
+		unlink(perfMapPath.c_str());
+		unlink(jitDumpPath.c_str());
+		freeUnreferencedObjects({});
+	}
+#endif
+
+int commandMain(int argc,char** argv)
+{
+	if(argc != 1)
+	{
+		std::cerr << "Usage: RuntimeTest" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	Runtime::init();
+
+	testInstantiateCompiledModuleTwice();
+	testTypedFunction();
+	testResetInstance();
+	testSaveAndRestoreInstanceState();
+	testCloneInstance();
+	testTierUp();
+	testMemoryImage();
+	testMemoryAndTablePools();
+	#ifdef __linux__
+		testPerfMapAndJITDump();
+	#endif
+
+	if(numFailedChecks)
+	{
+		std::cerr << "RuntimeTest: " << numFailedChecks << " checks failed!" << std::endl;
+		return EXIT_FAILURE;
+	}
+	else
+	{
+		std::cout << "RuntimeTest: all tests passed." << std::endl;
+		return EXIT_SUCCESS;
+	}
+}
@@ -28,6 +28,9 @@ struct TestScriptState
 	std::map<std::string,ModuleInstance*> moduleNameToInstanceMap;
 	
 	std::vector<WAST::Error> errors;
+
+	// The options used to compile the script's modules.
+	Runtime::CompileOptions compileOptions;
 	
 	TestScriptState() : hasInstantiatedModule(false), lastModuleInstance(nullptr) {}
 };
@@ -114,7 +117,7 @@ bool processAction(TestScriptState& state,Action* action,Result& outResult)
 		if(linkResult.success)
 		{
 			state.hasInstantiatedModule = true;
-			state.lastModuleInstance = instantiateModule(*moduleAction->module,std::move(linkResult.resolvedImports));
+			state.lastModuleInstance = instantiateModule(*moduleAction->module,std::move(linkResult.resolvedImports),state.compileOptions);
 		}
 		else
 		{
@@ -290,7 +293,7 @@ void processCommand(TestScriptState& state,const Command* command)
 				LinkResult linkResult = linkModule(*assertCommand->moduleAction->module,resolver);
 				if(linkResult.success)
 				{
-					instantiateModule(*assertCommand->moduleAction->module,std::move(linkResult.resolvedImports));
+					instantiateModule(*assertCommand->moduleAction->module,std::move(linkResult.resolvedImports),state.compileOptions);
 					testErrorf(state,assertCommand->locus,"module was linkable");
 				}
 			}
@@ -327,17 +330,46 @@ DEFINE_INTRINSIC_MEMORY(spectest,spectest_memory,memory,MemoryType(false,SizeCon
 
 int commandMain(int argc,char** argv)
 {
-	if(argc != 2)
+	if(argc < 2)
 	{
-		std::cerr <<  "Usage: Test in.wast" << std::endl;
+		std::cerr << "Usage: Test in.wast [switches]" << std::endl;
+		std::cerr << "  --tiered\t\tCompile without optimization, and optimize hot functions in the background" << std::endl;
+		std::cerr << "  --lazy\t\tCompile each function on its first call" << std::endl;
+		std::cerr << "  -O0|-O1|-O2|-O3\tSet the optimization level (default: -O2)" << std::endl;
 		return EXIT_FAILURE;
 	}
 	const char* filename = argv[1];
+	bool isTieredCompilationEnabled = false;
+	bool isLazyCompilationEnabled = false;
+	Runtime::CompileOptions compileOptions;
+	for(Iptr argumentIndex = 2;argumentIndex < argc;++argumentIndex)
+	{
+		const char* argument = argv[argumentIndex];
+		if(!strcmp(argument,"--tiered"))
+		{
+			isTieredCompilationEnabled = true;
+		}
+		else if(!strcmp(argument,"--lazy"))
+		{
+			isLazyCompilationEnabled = true;
+		}
+		else if(!strcmp(argument,"-O0") || !strcmp(argument,"-O1") || !strcmp(argument,"-O2") || !strcmp(argument,"-O3"))
+		{
+			compileOptions.optimizationLevel = Uptr(argument[2] - '0');
+		}
+		else
+		{
+			std::cerr << "Unrecognized argument: " << argument << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
 	
 	// Always enable debug logging for tests.
 	Log::setCategoryEnabled(Log::Category::debug,true);
 
 	Runtime::init();
+	Runtime::setTieredCompilationEnabled(isTieredCompilationEnabled);
+	Runtime::setLazyCompilationEnabled(isLazyCompilationEnabled);
 	
 	// Read the file into a string.
 	const std::string testScriptString = loadFile(filename);
@@ -345,6 +377,7 @@ int commandMain(int argc,char** argv)
 
 	// Process the test script.
 	TestScriptState testScriptState;
+	testScriptState.compileOptions = compileOptions;
 	std::vector<std::unique_ptr<Command>> testCommands;
 	
 	// Parse the test script.
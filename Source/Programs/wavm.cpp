@@ -24,6 +24,16 @@ void showHelp()
 	std::cerr << "  -f|--function name\t\tSpecify function name to run in module rather than main" << std::endl;
 	std::cerr << "  -c|--check\t\t\tExit after checking that the program is valid" << std::endl;
 	std::cerr << "  -d|--debug\t\t\tWrite additional debug information to stdout" << std::endl;
+	std::cerr << "  --object-cache dir\t\tCache compiled object code in the specified directory" << std::endl;
+	std::cerr << "  -O0|-O1|-O2|-O3\t\tSet the optimization level (default: -O2)" << std::endl;
+	std::cerr << "  -g0|-g1|-g2\t\t\tSet the debug info level: none, op indices, or full (default: -g1)" << std::endl;
+	std::cerr << "  --precompiled\t\t\tLoad native code added by Compile (only for trusted modules)" << std::endl;
+	std::cerr << "  --tiered\t\t\tCompile quickly, then recompile hot functions with more optimization" << std::endl;
+	std::cerr << "  --lazy\t\t\tCompile each function when it is first called" << std::endl;
+	std::cerr << "  --huge-pages\t\t\tGive the code of large modules whole huge pages" << std::endl;
+	std::cerr << "  --perf-map\t\t\tWrite /tmp/perf-<pid>.map for profiling with perf" << std::endl;
+	std::cerr << "  --jitdump\t\t\tWrite a jitdump file for profiling with perf" << std::endl;
+	std::cerr << "  --gdb-jit\t\t\tRegister compiled code with debuggers" << std::endl;
 	std::cerr << "  --\t\t\t\tStop parsing arguments" << std::endl;
 }
 
@@ -91,7 +101,7 @@ struct RootResolver : Resolver
 	}
 };
 
-int mainBody(const char* filename,const char* functionName,bool onlyCheck,char** args)
+int mainBody(const char* filename,const char* functionName,bool onlyCheck,const CompileOptions& compileOptions,char** args)
 {
 	Module module;
 	if(filename)
@@ -120,7 +130,7 @@ int mainBody(const char* filename,const char* functionName,bool onlyCheck,char**
 		}
 		return EXIT_FAILURE;
 	}
-	ModuleInstance* moduleInstance = instantiateModule(module,std::move(linkResult.resolvedImports));
+	ModuleInstance* moduleInstance = instantiateModule(module,std::move(linkResult.resolvedImports),compileOptions);
 	if(!moduleInstance) { return EXIT_FAILURE; }
 	Emscripten::initInstance(module,moduleInstance);
 
@@ -207,6 +217,14 @@ int commandMain(int argc,char** argv)
 {
 	const char* filename = nullptr;
 	const char* functionName = nullptr;
+	const char* objectCacheDirectory = nullptr;
+	bool isTieredCompilationEnabled = false;
+	bool isLazyCompilationEnabled = false;
+	bool isHugePageCodeEnabled = false;
+	bool isPerfMapEnabled = false;
+	bool isJITDumpEnabled = false;
+	bool isGDBRegistrationEnabled = false;
+	CompileOptions compileOptions;
 
 	bool onlyCheck = false;
 	auto args = argv;
@@ -225,6 +243,47 @@ int commandMain(int argc,char** argv)
 		{
 			Log::setCategoryEnabled(Log::Category::debug,true);
 		}
+		else if(!strcmp(*args, "--object-cache"))
+		{
+			if(!*++args) { showHelp(); return EXIT_FAILURE; }
+			objectCacheDirectory = *args;
+		}
+		else if(!strcmp(*args, "--precompiled"))
+		{
+			compileOptions.allowPrecompiledCode = true;
+		}
+		else if(!strcmp(*args, "--tiered"))
+		{
+			isTieredCompilationEnabled = true;
+		}
+		else if(!strcmp(*args, "--lazy"))
+		{
+			isLazyCompilationEnabled = true;
+		}
+		else if(!strcmp(*args, "--huge-pages"))
+		{
+			isHugePageCodeEnabled = true;
+		}
+		else if(!strcmp(*args, "--perf-map"))
+		{
+			isPerfMapEnabled = true;
+		}
+		else if(!strcmp(*args, "--jitdump"))
+		{
+			isJITDumpEnabled = true;
+		}
+		else if(!strcmp(*args, "--gdb-jit"))
+		{
+			isGDBRegistrationEnabled = true;
+		}
+		else if(!strcmp(*args, "-O0") || !strcmp(*args, "-O1") || !strcmp(*args, "-O2") || !strcmp(*args, "-O3"))
+		{
+			compileOptions.optimizationLevel = Uptr((*args)[2] - '0');
+		}
+		else if(!strcmp(*args, "-g0") || !strcmp(*args, "-g1") || !strcmp(*args, "-g2"))
+		{
+			compileOptions.debugInfoLevel = CompileOptions::DebugInfoLevel((*args)[2] - '0');
+		}
 		else if(!strcmp(*args, "--"))
 		{
 			++args;
@@ -243,13 +302,20 @@ int commandMain(int argc,char** argv)
 	}
 
 	Runtime::init();
+	Runtime::setObjectCacheDirectory(objectCacheDirectory);
+	Runtime::setTieredCompilationEnabled(isTieredCompilationEnabled);
+	Runtime::setLazyCompilationEnabled(isLazyCompilationEnabled);
+	Runtime::setHugePageCodeEnabled(isHugePageCodeEnabled);
+	if(isPerfMapEnabled) { Runtime::setPerfMapEnabled(true); }
+	if(isJITDumpEnabled) { Runtime::setJITDumpEnabled(true); }
+	Runtime::setGDBRegistrationEnabled(isGDBRegistrationEnabled);
 
 	int returnCode = EXIT_FAILURE;
 	#ifdef __AFL_LOOP
 	while(__AFL_LOOP(2000))
 	#endif
 	{
-		returnCode = mainBody(filename,functionName,onlyCheck,args);
+		returnCode = mainBody(filename,functionName,onlyCheck,compileOptions,args);
 		Runtime::freeUnreferencedObjects({});
 	}
 	return returnCode;
@@ -7,6 +7,7 @@
 
 #define ENABLE_LOGGING 0
 #define ENABLE_FUNCTION_ENTER_EXIT_HOOKS 0
+#define ENABLE_INDIRECT_CALL_PREDICTION 1
 
 using namespace IR;
 
@@ -16,16 +17,19 @@ namespace LLVMJIT
 	struct EmitModuleContext
 	{
 		const Module& module;
-		ModuleInstance* moduleInstance;
+		const std::vector<std::string>& functionDefDebugNames;
+		const CodeTier tier;
+		const Runtime::CompileOptions::DebugInfoLevel debugInfoLevel;
+		const Uptr singleFunctionDefIndex;
 
 		llvm::Module* llvmModule;
 		std::vector<llvm::Function*> functionDefs;
-		std::vector<llvm::Constant*> importedFunctionPointers;
-		std::vector<llvm::Constant*> globalPointers;
-		llvm::Constant* defaultTablePointer;
-		llvm::Constant* defaultTableEndOffset;
-		llvm::Constant* defaultMemoryBase;
-		llvm::Constant* defaultMemoryEndOffset;
+		std::vector<llvm::Constant*> typeIDs;
+		std::vector<Uptr> predictedIndirectCallees;
+		llvm::Type* tableElementType;
+		llvm::Constant* functionDefSlots;
+		llvm::Constant* functionDefTierUpCounters;
+		llvm::Constant* instanceContexts;
 		
 		llvm::DIBuilder diBuilder;
 		llvm::DICompileUnit* diCompileUnit;
@@ -36,23 +40,41 @@ namespace LLVMJIT
 		llvm::MDNode* likelyFalseBranchWeights;
 		llvm::MDNode* likelyTrueBranchWeights;
 
-		EmitModuleContext(const Module& inModule,ModuleInstance* inModuleInstance)
+		EmitModuleContext(const Module& inModule,const std::vector<std::string>& inFunctionDefDebugNames,CodeTier inTier,Runtime::CompileOptions::DebugInfoLevel inDebugInfoLevel,Uptr inSingleFunctionDefIndex)
 		: module(inModule)
-		, moduleInstance(inModuleInstance)
+		, functionDefDebugNames(inFunctionDefDebugNames)
+		, tier(inTier)
+		, debugInfoLevel(inDebugInfoLevel)
+		, singleFunctionDefIndex(inSingleFunctionDefIndex)
+		, functionDefSlots(nullptr)
+		, functionDefTierUpCounters(nullptr)
+		, instanceContexts(nullptr)
 		, llvmModule(new llvm::Module("",context))
 		, diBuilder(*llvmModule)
+		, diCompileUnit(nullptr)
+		, diModuleScope(nullptr)
 		{
-			diModuleScope = diBuilder.createFile("unknown","unknown");
-			diCompileUnit = diBuilder.createCompileUnit(0xffff,diModuleScope,"WAVM",true,"",0);
-
-			diValueTypes[(Uptr)ValueType::any] = nullptr;
-			diValueTypes[(Uptr)ValueType::i32] = diBuilder.createBasicType("i32",32,llvm::dwarf::DW_ATE_signed);
-			diValueTypes[(Uptr)ValueType::i64] = diBuilder.createBasicType("i64",64,llvm::dwarf::DW_ATE_signed);
-			diValueTypes[(Uptr)ValueType::f32] = diBuilder.createBasicType("f32",32,llvm::dwarf::DW_ATE_float);
-			diValueTypes[(Uptr)ValueType::f64] = diBuilder.createBasicType("f64",64,llvm::dwarf::DW_ATE_float);
-			#if ENABLE_SIMD_PROTOTYPE
-			diValueTypes[(Uptr)ValueType::v128] = diBuilder.createBasicType("v128",128,llvm::dwarf::DW_ATE_signed);
-			#endif
+			// Only create a debug info compile unit if the module will have debug info. Without full debug info, only
+			// line tables are emitted, and the functions' types aren't described.
+			for(Uptr typeIndex = 0;typeIndex < (Uptr)ValueType::num;++typeIndex) { diValueTypes[typeIndex] = nullptr; }
+			if(debugInfoLevel != Runtime::CompileOptions::DebugInfoLevel::none)
+			{
+				diModuleScope = diBuilder.createFile("unknown","unknown");
+				diCompileUnit = diBuilder.createCompileUnit(0xffff,diModuleScope,"WAVM",true,"",0,"",
+					debugInfoLevel == Runtime::CompileOptions::DebugInfoLevel::full
+						? llvm::DICompileUnit::DebugEmissionKind::FullDebug
+						: llvm::DICompileUnit::DebugEmissionKind::LineTablesOnly);
+			}
+			if(debugInfoLevel == Runtime::CompileOptions::DebugInfoLevel::full)
+			{
+				diValueTypes[(Uptr)ValueType::i32] = diBuilder.createBasicType("i32",32,llvm::dwarf::DW_ATE_signed);
+				diValueTypes[(Uptr)ValueType::i64] = diBuilder.createBasicType("i64",64,llvm::dwarf::DW_ATE_signed);
+				diValueTypes[(Uptr)ValueType::f32] = diBuilder.createBasicType("f32",32,llvm::dwarf::DW_ATE_float);
+				diValueTypes[(Uptr)ValueType::f64] = diBuilder.createBasicType("f64",64,llvm::dwarf::DW_ATE_float);
+				#if ENABLE_SIMD_PROTOTYPE
+				diValueTypes[(Uptr)ValueType::v128] = diBuilder.createBasicType("v128",128,llvm::dwarf::DW_ATE_signed);
+				#endif
+			}
 			
 			auto zeroAsMetadata = llvm::ConstantAsMetadata::get(emitLiteral(I32(0)));
 			auto i32MaxAsMetadata = llvm::ConstantAsMetadata::get(emitLiteral(I32(INT32_MAX)));
@@ -61,6 +83,31 @@ namespace LLVMJIT
 		}
 
 		llvm::Module* emit();
+
+		// Whether the module's functions are called through their slots, rather than directly. Only code for a whole
+		// module that is never replaced calls the module's functions directly.
+		bool usesFunctionDefSlots() const
+		{
+			return tier != CodeTier::optimized || singleFunctionDefIndex != UINTPTR_MAX;
+		}
+
+		// Declares an external symbol that is bound to a process-specific address when the object code is loaded.
+		// Instance-specific addresses are instead loaded from the InstanceContext passed to each function.
+		llvm::Constant* emitImportedSymbol(const char* name,llvm::Type* type)
+		{
+			return new llvm::GlobalVariable(*llvmModule,type,false,llvm::GlobalVariable::ExternalLinkage,nullptr,name);
+		}
+		llvm::Constant* emitImportedSymbol(const std::string& name,llvm::Type* type) { return emitImportedSymbol(name.c_str(),type); }
+
+		// Declares an intrinsic function, which is bound to the intrinsic's native function when the object code is loaded.
+		llvm::Function* getIntrinsicFunction(const char* intrinsicName,const FunctionType* intrinsicType)
+		{
+			assert(Intrinsics::find(intrinsicName,intrinsicType));
+			const std::string symbolName = Intrinsics::getDecoratedName(intrinsicName,intrinsicType);
+			llvm::Function* function = llvmModule->getFunction(symbolName);
+			if(!function) { function = llvm::Function::Create(asLLVMType(intrinsicType),llvm::Function::ExternalLinkage,symbolName,llvmModule); }
+			return function;
+		}
 	};
 
 	// The context used by functions involved in JITing a single AST function.
@@ -70,13 +117,29 @@ namespace LLVMJIT
 
 		EmitModuleContext& moduleContext;
 		const Module& module;
+		const Uptr functionDefIndex;
 		const FunctionDef& functionDef;
 		const FunctionType* functionType;
-		FunctionInstance* functionInstance;
+		const std::string& debugName;
 		llvm::Function* llvmFunction;
 		llvm::IRBuilder<> irBuilder;
 
-		std::vector<llvm::Value*> localPointers;
+		llvm::Value* contextPointer;
+		llvm::Value* defaultMemoryBase;
+		llvm::Value* defaultMemoryEndOffset;
+		llvm::Value* defaultTableBase;
+		llvm::Value* defaultTableEndOffset;
+
+		// The current SSA value of each local, and the locals that may be set within each control structure, in the order
+		// the control structures occur in the function's code.
+		std::vector<llvm::Value*> localValues;
+		std::vector<std::vector<Uptr>> setLocalsByControlStructure;
+		Uptr nextControlStructureIndex;
+
+		// The basic block that boundsCheckedEnds is valid in, and the maximum number of bytes from each byte index
+		// that have been bounds checked in it.
+		llvm::BasicBlock* boundsCheckedBlock;
+		std::map<llvm::Value*,U64> boundsCheckedEnds;
 
 		llvm::DISubprogram* diFunction;
 
@@ -101,6 +164,12 @@ namespace LLVMJIT
 			Uptr outerBranchTargetStackSize;
 			bool isReachable;
 			bool isElseReachable;
+
+			// The locals that may be set within the control structure, the PHIs that merge their values at the end
+			// block, and for if structures, their values on entry to the else clause.
+			const std::vector<Uptr>* setLocalIndices;
+			std::vector<llvm::PHINode*> endLocalPHIs;
+			std::vector<llvm::Value*> elseLocalValues;
 		};
 
 		struct BranchTarget
@@ -108,23 +177,35 @@ namespace LLVMJIT
 			ResultType argumentType;
 			llvm::BasicBlock* block;
 			llvm::PHINode* phi;
+			const std::vector<Uptr>* localIndices;
+			std::vector<llvm::PHINode*> localPHIs;
 		};
 
 		std::vector<ControlContext> controlStack;
 		std::vector<BranchTarget> branchTargetStack;
 		std::vector<llvm::Value*> stack;
 
-		EmitFunctionContext(EmitModuleContext& inEmitModuleContext,const Module& inModule,const FunctionDef& inFunctionDef,FunctionInstance* inFunctionInstance,llvm::Function* inLLVMFunction)
+		EmitFunctionContext(EmitModuleContext& inEmitModuleContext,const Module& inModule,Uptr inFunctionDefIndex,const std::string& inDebugName,llvm::Function* inLLVMFunction)
 		: moduleContext(inEmitModuleContext)
 		, module(inModule)
-		, functionDef(inFunctionDef)
-		, functionType(inModule.types[inFunctionDef.type.index])
-		, functionInstance(inFunctionInstance)
+		, functionDefIndex(inFunctionDefIndex)
+		, functionDef(inModule.functions.defs[inFunctionDefIndex])
+		, functionType(inModule.types[functionDef.type.index])
+		, debugName(inDebugName)
 		, llvmFunction(inLLVMFunction)
 		, irBuilder(context)
+		, contextPointer(nullptr)
+		, defaultMemoryBase(nullptr)
+		, defaultMemoryEndOffset(nullptr)
+		, defaultTableBase(nullptr)
+		, defaultTableEndOffset(nullptr)
+		, nextControlStructureIndex(0)
+		, boundsCheckedBlock(nullptr)
+		, diFunction(nullptr)
 		{}
 
 		void emit();
+		void emitLazyStub();
 
 		// Operand stack manipulation
 		llvm::Value* pop()
@@ -166,6 +247,37 @@ namespace LLVMJIT
 			}
 		}
 
+		// Creates PHI nodes that merge the values of a set of locals for the branches to a basic block.
+		std::vector<llvm::PHINode*> createLocalPHIs(llvm::BasicBlock* basicBlock,const std::vector<Uptr>& localIndices)
+		{
+			auto originalBlock = irBuilder.GetInsertBlock();
+			irBuilder.SetInsertPoint(basicBlock);
+			std::vector<llvm::PHINode*> phis;
+			for(Uptr localIndex : localIndices) { phis.push_back(irBuilder.CreatePHI(localValues[localIndex]->getType(),2)); }
+			if(originalBlock) { irBuilder.SetInsertPoint(originalBlock); }
+			return phis;
+		}
+
+		// Adds the current values of a set of locals to the incoming values of the PHIs that merge them.
+		void addLocalPHIIncoming(const std::vector<Uptr>* localIndices,const std::vector<llvm::PHINode*>& phis)
+		{
+			for(Uptr phiIndex = 0;phiIndex < phis.size();++phiIndex)
+			{
+				phis[phiIndex]->addIncoming(localValues[(*localIndices)[phiIndex]],irBuilder.GetInsertBlock());
+			}
+		}
+
+		// Uses the PHIs that merge a set of locals as their current values. If there weren't any branches to the PHIs,
+		// removes them instead: the code that follows them is unreachable.
+		void useLocalPHIs(const std::vector<Uptr>* localIndices,const std::vector<llvm::PHINode*>& phis)
+		{
+			for(Uptr phiIndex = 0;phiIndex < phis.size();++phiIndex)
+			{
+				if(phis[phiIndex]->getNumIncomingValues()) { localValues[(*localIndices)[phiIndex]] = phis[phiIndex]; }
+				else { phis[phiIndex]->eraseFromParent(); }
+			}
+		}
+
 		// Debug logging.
 		void logOperator(const std::string& operatorDescription)
 		{
@@ -204,6 +316,71 @@ namespace LLVMJIT
 			}
 		}
 		
+		// Loads a value of the given type from an offset in the function's InstanceContext.
+		// Values that can't change during the lifetime of the instance may be marked invariant, allowing LLVM
+		// to hoist or eliminate redundant loads of them.
+		llvm::Value* loadFromContext(Uptr offset,llvm::Type* type,bool isInvariant)
+		{
+			auto valuePointer = irBuilder.CreatePointerCast(
+				irBuilder.CreateInBoundsGEP(contextPointer,{emitLiteral(U64(offset))}),
+				type->getPointerTo());
+			auto load = irBuilder.CreateLoad(valuePointer);
+			if(isInvariant) { load->setMetadata(llvm::LLVMContext::MD_invariant_load,llvm::MDNode::get(context,{})); }
+			return load;
+		}
+
+		// Loads a pointer to the default memory or table object as an i64, for passing to intrinsics.
+		llvm::Value* getDefaultMemoryObjectAsI64()
+		{
+			assert(module.memories.size());
+			return irBuilder.CreatePtrToInt(loadFromContext(offsetof(InstanceContext,defaultMemory),llvmI8PtrType,true),llvmI64Type);
+		}
+		llvm::Value* getDefaultTableObjectAsI64()
+		{
+			assert(module.tables.size());
+			return irBuilder.CreatePtrToInt(loadFromContext(offsetof(InstanceContext,defaultTable),llvmI8PtrType,true),llvmI64Type);
+		}
+
+		// Returns a pointer to the value of a global variable.
+		llvm::Value* getGlobalValuePointer(Uptr globalIndex)
+		{
+			assert(globalIndex < module.globals.size());
+			const ValueType valueType = module.globals.getType(globalIndex).valueType;
+			const Uptr offset = InstanceContext::getGlobalValuePointerOffset(module.functions.imports.size(),globalIndex);
+			return loadFromContext(offset,asLLVMType(valueType)->getPointerTo(),true);
+		}
+
+		// Loads a function definition's code from the slot that tiered and lazily compiled code calls it through. The
+		// slot may be replaced by another thread, so it's loaded with acquire ordering to see the code it points to.
+		llvm::Value* loadFunctionDefSlot(Uptr slotFunctionDefIndex)
+		{
+			assert(moduleContext.functionDefSlots);
+			auto slotPointer = irBuilder.CreateInBoundsGEP(moduleContext.functionDefSlots,{emitLiteral(U32(0)),emitLiteral(U32(slotFunctionDefIndex))});
+			auto slotLoad = irBuilder.CreateLoad(slotPointer);
+			slotLoad->setAlignment(sizeof(void*));
+			slotLoad->setAtomic(llvm::AtomicOrdering::Acquire);
+			return slotLoad;
+		}
+
+		// Decrements the function's tier-up counter, and requests optimized code for the function when it reaches zero.
+		void emitTierUpCounter()
+		{
+			assert(moduleContext.tier == CodeTier::baseline);
+			auto counterPointer = irBuilder.CreateInBoundsGEP(moduleContext.functionDefTierUpCounters,{emitLiteral(U32(0)),emitLiteral(U32(functionDefIndex))});
+			auto counter = irBuilder.CreateSub(irBuilder.CreateLoad(counterPointer),emitLiteral(U32(1)));
+			irBuilder.CreateStore(counter,counterPointer);
+
+			auto tierUpBlock = llvm::BasicBlock::Create(context,"tierUp",llvmFunction);
+			auto skipBlock = llvm::BasicBlock::Create(context,"tierUpSkip",llvmFunction);
+			irBuilder.CreateCondBr(irBuilder.CreateICmpEQ(counter,emitLiteral(U32(0))),tierUpBlock,skipBlock,moduleContext.likelyFalseBranchWeights);
+
+			irBuilder.SetInsertPoint(tierUpBlock);
+			emitRuntimeIntrinsic("wavmIntrinsics.requestTierUp",FunctionType::get(ResultType::none,{ValueType::i64}),{emitLiteral(U64(functionDefIndex))});
+			irBuilder.CreateBr(skipBlock);
+
+			irBuilder.SetInsertPoint(skipBlock);
+		}
+
 		// Coerces an I32 value to an I1, and vice-versa.
 		llvm::Value* coerceI32ToBool(llvm::Value* i32Value)
 		{
@@ -237,39 +414,74 @@ namespace LLVMJIT
 			}
 			else
 			{
-				// Add the offset to the byte index using a LLVM intrinsic that returns a carry bit if the add overflowed.
-				llvm::Value* overflowed = emitLiteral(false);
-				if(offset)
+				// Skip the bounds check if an earlier access in the same basic block already checked at least as many
+				// bytes from the same byte index. The end of the memory's reserved address space is constant for the
+				// lifetime of the instance, so the earlier check still holds.
+				const U64 checkedEnd = U64(offset) + memoryType->getPrimitiveSizeInBits() / 8;
+				if(irBuilder.GetInsertBlock() != boundsCheckedBlock)
 				{
-					auto offsetByteIndexWithOverflow = irBuilder.CreateCall(
-						getLLVMIntrinsic({llvmI32Type},llvm::Intrinsic::uadd_with_overflow),
-						{byteIndex,emitLiteral(U32(offset))}
-						);
-					byteIndex = irBuilder.CreateExtractValue(offsetByteIndexWithOverflow,{0});
-					overflowed = irBuilder.CreateExtractValue(offsetByteIndexWithOverflow,{1});
+					boundsCheckedBlock = irBuilder.GetInsertBlock();
+					boundsCheckedEnds.clear();
+				}
+				auto checkedEndIt = boundsCheckedEnds.find(byteIndex);
+				if(checkedEndIt == boundsCheckedEnds.end() || checkedEndIt->second < checkedEnd)
+				{
+					emitBoundsCheck(byteIndex,checkedEnd);
+					boundsCheckedEnds[byteIndex] = checkedEnd;
 				}
 
-				// Check that the offset didn't overflow, and that the final byte index is within the virtual address space
-				// allocated for the memory.
-				emitConditionalTrapIntrinsic(
-					irBuilder.CreateOr(
-						overflowed,
-						irBuilder.CreateICmpUGT(
-							byteIndex,
-							irBuilder.CreateSub(
-								moduleContext.defaultMemoryEndOffset,
-								emitLiteral(Uptr(memoryType->getPrimitiveSizeInBits() / 8) - 1)
-								)
-							)
-						),
-					"wavmIntrinsics.accessViolationTrap",FunctionType::get(),{});
+				// Once the bounds check has passed, adding the offset to the byte index can't overflow.
+				if(sizeof(Uptr) != 4) { byteIndex = irBuilder.CreateZExt(byteIndex,llvmI64Type); }
+				if(offset) { byteIndex = irBuilder.CreateAdd(byteIndex,emitLiteral(Uptr(offset))); }
 			}
 
 			// Cast the pointer to the appropriate type.
-			auto bytePointer = irBuilder.CreateInBoundsGEP(moduleContext.defaultMemoryBase,byteIndex);
+			auto bytePointer = irBuilder.CreateInBoundsGEP(defaultMemoryBase,byteIndex);
 			return irBuilder.CreatePointerCast(bytePointer,memoryType->getPointerTo());
 		}
 
+		// Traps unless byteIndex + checkedEnd is within the virtual address space allocated for the default memory.
+		// The check is emitted as "byteIndex < limit" with a loop invariant limit, branching to the in-bounds block on
+		// true, so the inductive range check elimination pass can remove it from loops that access memory through an
+		// induction variable.
+		void emitBoundsCheck(llvm::Value* byteIndex,U64 checkedEnd)
+		{
+			if(checkedEnd > UINTPTR_MAX)
+			{
+				emitConditionalTrapIntrinsic(emitLiteral(true),"wavmIntrinsics.accessViolationTrap",FunctionType::get(),{});
+				return;
+			}
+
+			// limit = max(endOffset + 1,checkedEnd) - checkedEnd. The byte index is always >= 0, so a limit of 0
+			// makes the check fail for accesses that are larger than the whole memory.
+			llvm::Value* endPlusOne = irBuilder.CreateAdd(defaultMemoryEndOffset,emitLiteral(Uptr(1)));
+			llvm::Value* checkedEndValue = emitLiteral(Uptr(checkedEnd));
+			llvm::Value* limit = irBuilder.CreateSub(
+				irBuilder.CreateSelect(irBuilder.CreateICmpUGT(endPlusOne,checkedEndValue),endPlusOne,checkedEndValue),
+				checkedEndValue
+				);
+			if(sizeof(Uptr) != 4) { limit = irBuilder.CreateTrunc(limit,llvmI32Type); }
+
+			auto inBoundsBlock = llvm::BasicBlock::Create(context,"inBounds",llvmFunction);
+			auto outOfBoundsBlock = llvm::BasicBlock::Create(context,"outOfBounds",llvmFunction);
+			irBuilder.CreateCondBr(irBuilder.CreateICmpULT(byteIndex,limit),inBoundsBlock,outOfBoundsBlock,moduleContext.likelyTrueBranchWeights);
+			auto conditionBlock = irBuilder.GetInsertBlock();
+
+			irBuilder.SetInsertPoint(outOfBoundsBlock);
+			emitRuntimeIntrinsic("wavmIntrinsics.accessViolationTrap",FunctionType::get(),{});
+			irBuilder.CreateUnreachable();
+
+			continueBoundsCheckedBlock(conditionBlock,inBoundsBlock);
+		}
+
+		// Continues emitting code in a block that is only reachable by falling through from previousBlock. Bounds
+		// checks that were done in previousBlock remain valid in the new block.
+		void continueBoundsCheckedBlock(llvm::BasicBlock* previousBlock,llvm::BasicBlock* nextBlock)
+		{
+			if(boundsCheckedBlock == previousBlock) { boundsCheckedBlock = nextBlock; }
+			irBuilder.SetInsertPoint(nextBlock);
+		}
+
 		// Traps a divide-by-zero
 		void trapDivideByZero(ValueType type,llvm::Value* divisor)
 		{
@@ -297,15 +509,14 @@ namespace LLVMJIT
 			return llvm::Intrinsic::getDeclaration(moduleContext.llvmModule,id,llvm::ArrayRef<llvm::Type*>(argTypes.begin(),argTypes.end()));
 		}
 		
-		// Emits a call to a WAVM intrinsic function.
+		// Emits a call to a WAVM intrinsic function, passing it the calling function's context.
 		llvm::Value* emitRuntimeIntrinsic(const char* intrinsicName,const FunctionType* intrinsicType,const std::initializer_list<llvm::Value*>& args)
 		{
-			ObjectInstance* intrinsicObject = Intrinsics::find(intrinsicName,intrinsicType);
-			assert(intrinsicObject);
-			FunctionInstance* intrinsicFunction = asFunction(intrinsicObject);
-			assert(intrinsicFunction->type == intrinsicType);
-			auto intrinsicFunctionPointer = emitLiteralPointer(intrinsicFunction->nativeFunction,asLLVMType(intrinsicType)->getPointerTo());
-			return irBuilder.CreateCall(intrinsicFunctionPointer,llvm::ArrayRef<llvm::Value*>(args.begin(),args.end()));
+			auto intrinsicFunction = moduleContext.getIntrinsicFunction(intrinsicName,intrinsicType);
+			llvm::SmallVector<llvm::Value*,8> llvmArgs;
+			llvmArgs.push_back(contextPointer);
+			llvmArgs.append(args.begin(),args.end());
+			return irBuilder.CreateCall(intrinsicFunction,llvmArgs);
 		}
 
 		// A helper function to emit a conditional call to a non-returning intrinsic function.
@@ -315,12 +526,13 @@ namespace LLVMJIT
 			auto endBlock = llvm::BasicBlock::Create(context,llvm::Twine(intrinsicName) + "Skip",llvmFunction);
 
 			irBuilder.CreateCondBr(booleanCondition,trueBlock,endBlock,moduleContext.likelyFalseBranchWeights);
+			auto conditionBlock = irBuilder.GetInsertBlock();
 
 			irBuilder.SetInsertPoint(trueBlock);
 			emitRuntimeIntrinsic(intrinsicName,intrinsicType,args);
 			irBuilder.CreateUnreachable();
 
-			irBuilder.SetInsertPoint(endBlock);
+			continueBoundsCheckedBlock(conditionBlock,endBlock);
 		}
 
 		//
@@ -339,31 +551,42 @@ namespace LLVMJIT
 			ResultType resultType,
 			llvm::BasicBlock* endBlock,
 			llvm::PHINode* endPHI,
-			llvm::BasicBlock* elseBlock = nullptr
+			llvm::BasicBlock* elseBlock = nullptr,
+			const std::vector<Uptr>* setLocalIndices = nullptr,
+			const std::vector<llvm::PHINode*>& endLocalPHIs = {}
 			)
 		{
 			// The unreachable operator filtering should filter out any opcodes that call pushControlStack.
 			if(controlStack.size()) { errorUnless(controlStack.back().isReachable); }
 
-			controlStack.push_back({type,endBlock,endPHI,elseBlock,resultType,stack.size(),branchTargetStack.size(),true,true});
+			controlStack.push_back({type,endBlock,endPHI,elseBlock,resultType,stack.size(),branchTargetStack.size(),true,true,
+				setLocalIndices,endLocalPHIs,{}});
 		}
 
-		void pushBranchTarget(ResultType branchArgumentType,llvm::BasicBlock* branchTargetBlock,llvm::PHINode* branchTargetPHI)
+		void pushBranchTarget(
+			ResultType branchArgumentType,
+			llvm::BasicBlock* branchTargetBlock,
+			llvm::PHINode* branchTargetPHI,
+			const std::vector<Uptr>* localIndices = nullptr,
+			const std::vector<llvm::PHINode*>& localPHIs = {}
+			)
 		{
-			branchTargetStack.push_back({branchArgumentType,branchTargetBlock,branchTargetPHI});
+			branchTargetStack.push_back({branchArgumentType,branchTargetBlock,branchTargetPHI,localIndices,localPHIs});
 		}
 
 		void block(ControlStructureImm imm)
 		{
-			// Create an end block+phi for the block result.
+			// Create an end block+phi for the block result, and phis for the locals that may be set in the block.
 			auto endBlock = llvm::BasicBlock::Create(context,"blockEnd",llvmFunction);
 			auto endPHI = createPHI(endBlock,imm.resultType);
+			const std::vector<Uptr>* setLocalIndices = &setLocalsByControlStructure[nextControlStructureIndex++];
+			auto endLocalPHIs = createLocalPHIs(endBlock,*setLocalIndices);
 
 			// Push a control context that ends at the end block/phi.
-			pushControlStack(ControlContext::Type::block,imm.resultType,endBlock,endPHI);
+			pushControlStack(ControlContext::Type::block,imm.resultType,endBlock,endPHI,nullptr,setLocalIndices,endLocalPHIs);
 			
 			// Push a branch target for the end block/phi.
-			pushBranchTarget(imm.resultType,endBlock,endPHI);
+			pushBranchTarget(imm.resultType,endBlock,endPHI,setLocalIndices,endLocalPHIs);
 		}
 		void loop(ControlStructureImm imm)
 		{
@@ -371,16 +594,26 @@ namespace LLVMJIT
 			auto loopBodyBlock = llvm::BasicBlock::Create(context,"loopBody",llvmFunction);
 			auto endBlock = llvm::BasicBlock::Create(context,"loopEnd",llvmFunction);
 			auto endPHI = createPHI(endBlock,imm.resultType);
+
+			// Create phis at the start of the loop body for the locals that may be set in the loop, and add their
+			// values on entry to the loop.
+			const std::vector<Uptr>* setLocalIndices = &setLocalsByControlStructure[nextControlStructureIndex++];
+			auto loopLocalPHIs = createLocalPHIs(loopBodyBlock,*setLocalIndices);
+			addLocalPHIIncoming(setLocalIndices,loopLocalPHIs);
 			
 			// Branch to the loop body and switch the IR builder to emit there.
 			irBuilder.CreateBr(loopBodyBlock);
 			irBuilder.SetInsertPoint(loopBodyBlock);
+			useLocalPHIs(setLocalIndices,loopLocalPHIs);
+
+			// In baseline code, count the loop's iterations towards the function's tier-up counter.
+			if(moduleContext.tier == CodeTier::baseline) { emitTierUpCounter(); }
 
 			// Push a control context that ends at the end block/phi.
 			pushControlStack(ControlContext::Type::loop,imm.resultType,endBlock,endPHI);
 			
 			// Push a branch target for the loop body start.
-			pushBranchTarget(ResultType::none,loopBodyBlock,nullptr);
+			pushBranchTarget(ResultType::none,loopBodyBlock,nullptr,setLocalIndices,loopLocalPHIs);
 		}
 		void if_(ControlStructureImm imm)
 		{
@@ -389,6 +622,8 @@ namespace LLVMJIT
 			auto elseBlock = llvm::BasicBlock::Create(context,"ifElse",llvmFunction);
 			auto endBlock = llvm::BasicBlock::Create(context,"ifElseEnd",llvmFunction);
 			auto endPHI = createPHI(endBlock,imm.resultType);
+			const std::vector<Uptr>* setLocalIndices = &setLocalsByControlStructure[nextControlStructureIndex++];
+			auto endLocalPHIs = createLocalPHIs(endBlock,*setLocalIndices);
 
 			// Pop the if condition from the operand stack.
 			auto condition = pop();
@@ -399,10 +634,13 @@ namespace LLVMJIT
 
 			// Push an ifThen control context that ultimately ends at the end block/phi, but may
 			// be terminated by an else operator that changes the control context to the else block.
-			pushControlStack(ControlContext::Type::ifThen,imm.resultType,endBlock,endPHI,elseBlock);
+			pushControlStack(ControlContext::Type::ifThen,imm.resultType,endBlock,endPHI,elseBlock,setLocalIndices,endLocalPHIs);
+
+			// Save the values of the locals that may be set in the then clause for the start of the else clause.
+			for(Uptr localIndex : *setLocalIndices) { controlStack.back().elseLocalValues.push_back(localValues[localIndex]); }
 			
 			// Push a branch target for the if end.
-			pushBranchTarget(imm.resultType,endBlock,endPHI);
+			pushBranchTarget(imm.resultType,endBlock,endPHI,setLocalIndices,endLocalPHIs);
 			
 		}
 		void else_(NoImm imm)
@@ -421,6 +659,7 @@ namespace LLVMJIT
 				}
 
 				// Branch to the control context's end.
+				addLocalPHIIncoming(currentContext.setLocalIndices,currentContext.endLocalPHIs);
 				irBuilder.CreateBr(currentContext.endBlock);
 			}
 			assert(stack.size() == currentContext.outerStackSize);
@@ -430,12 +669,22 @@ namespace LLVMJIT
 			assert(currentContext.type == ControlContext::Type::ifThen);
 			currentContext.elseBlock->moveAfter(irBuilder.GetInsertBlock());
 			irBuilder.SetInsertPoint(currentContext.elseBlock);
+			restoreElseLocalValues(currentContext);
 
 			// Change the top of the control stack to an else clause.
 			currentContext.type = ControlContext::Type::ifElse;
 			currentContext.isReachable = currentContext.isElseReachable;
 			currentContext.elseBlock = nullptr;
 		}
+		// Restores the values that the locals set in an if's then clause had on entry to the if.
+		void restoreElseLocalValues(const ControlContext& ifContext)
+		{
+			for(Uptr valueIndex = 0;valueIndex < ifContext.elseLocalValues.size();++valueIndex)
+			{
+				localValues[(*ifContext.setLocalIndices)[valueIndex]] = ifContext.elseLocalValues[valueIndex];
+			}
+		}
+
 		void end(NoImm)
 		{
 			assert(controlStack.size());
@@ -452,6 +701,7 @@ namespace LLVMJIT
 				}
 
 				// Branch to the control context's end.
+				addLocalPHIIncoming(currentContext.setLocalIndices,currentContext.endLocalPHIs);
 				irBuilder.CreateBr(currentContext.endBlock);
 			}
 			assert(stack.size() == currentContext.outerStackSize);
@@ -461,6 +711,8 @@ namespace LLVMJIT
 				// If this is the end of an if without an else clause, create a dummy else clause.
 				currentContext.elseBlock->moveAfter(irBuilder.GetInsertBlock());
 				irBuilder.SetInsertPoint(currentContext.elseBlock);
+				restoreElseLocalValues(currentContext);
+				addLocalPHIIncoming(currentContext.setLocalIndices,currentContext.endLocalPHIs);
 				irBuilder.CreateBr(currentContext.endBlock);
 			}
 
@@ -482,6 +734,9 @@ namespace LLVMJIT
 				}
 			}
 
+			// Use the phis that merge the locals set in the control structure as their values after it.
+			useLocalPHIs(currentContext.setLocalIndices,currentContext.endLocalPHIs);
+
 			// Pop and branch targets introduced by this control context.
 			assert(currentContext.outerBranchTargetStackSize <= branchTargetStack.size());
 			branchTargetStack.resize(currentContext.outerBranchTargetStackSize);
@@ -524,6 +779,7 @@ namespace LLVMJIT
 				llvm::Value* argument = getTopValue();
 				target.phi->addIncoming(argument,irBuilder.GetInsertBlock());
 			}
+			addLocalPHIIncoming(target.localIndices,target.localPHIs);
 
 			// Create a new basic block for the case where the branch is not taken.
 			auto falseBlock = llvm::BasicBlock::Create(context,"br_ifElse",llvmFunction);
@@ -544,6 +800,7 @@ namespace LLVMJIT
 				llvm::Value* argument = pop();
 				target.phi->addIncoming(argument,irBuilder.GetInsertBlock());
 			}
+			addLocalPHIIncoming(target.localIndices,target.localPHIs);
 
 			// Branch to the target block.
 			irBuilder.CreateBr(target.block);
@@ -566,6 +823,7 @@ namespace LLVMJIT
 				argument = pop();
 				defaultTarget.phi->addIncoming(argument,irBuilder.GetInsertBlock());
 			}
+			addLocalPHIIncoming(defaultTarget.localIndices,defaultTarget.localPHIs);
 
 			// Create a LLVM switch instruction.
 			assert(imm.branchTableIndex < functionDef.branchTables.size());
@@ -585,6 +843,7 @@ namespace LLVMJIT
 					// the target phi's incoming values.
 					target.phi->addIncoming(argument,irBuilder.GetInsertBlock());
 				}
+				addLocalPHIIncoming(target.localIndices,target.localPHIs);
 			}
 
 			enterUnreachable();
@@ -633,29 +892,46 @@ namespace LLVMJIT
 
 		void call(CallImm imm)
 		{
-			// Map the callee function index to either an imported function pointer or a function in this module.
+			// Map the callee function index to either an imported function or a function in this module.
+			// Imported functions are called through the native function pointer and context stored in this
+			// instance's context, and functions in this module are called directly with this function's context.
 			llvm::Value* callee;
+			llvm::Value* calleeContext;
 			const FunctionType* calleeType;
-			if(imm.functionIndex < moduleContext.importedFunctionPointers.size())
+			if(imm.functionIndex < module.functions.imports.size())
 			{
-				assert(imm.functionIndex < moduleContext.moduleInstance->functions.size());
-				callee = moduleContext.importedFunctionPointers[imm.functionIndex];
-				calleeType = moduleContext.moduleInstance->functions[imm.functionIndex]->type;
+				calleeType = module.types[module.functions.imports[imm.functionIndex].type.index];
+				const Uptr importOffset = InstanceContext::getImportedFunctionOffset(imm.functionIndex);
+				callee = loadFromContext(
+					importOffset + offsetof(InstanceContext::ImportedFunction,nativeFunction),
+					asLLVMType(calleeType)->getPointerTo(),
+					true);
+				calleeContext = loadFromContext(
+					importOffset + offsetof(InstanceContext::ImportedFunction,context),
+					llvmI8PtrType,
+					true);
 			}
 			else
 			{
-				const Uptr calleeIndex = imm.functionIndex - moduleContext.importedFunctionPointers.size();
+				const Uptr calleeIndex = imm.functionIndex - module.functions.imports.size();
 				assert(calleeIndex < moduleContext.functionDefs.size());
-				callee = moduleContext.functionDefs[calleeIndex];
+				calleeContext = contextPointer;
 				calleeType = module.types[module.functions.defs[calleeIndex].type.index];
+
+				// Tiered and lazily compiled code calls other functions in the module through their slots, so it will
+				// call the latest code for a function once it's available.
+				if(!moduleContext.usesFunctionDefSlots()) { callee = moduleContext.functionDefs[calleeIndex]; }
+				else { callee = irBuilder.CreatePointerCast(loadFunctionDefSlot(calleeIndex),asLLVMType(calleeType)->getPointerTo()); }
 			}
 
-			// Pop the call arguments from the operand stack.
-			auto llvmArgs = (llvm::Value**)alloca(sizeof(llvm::Value*) * calleeType->parameters.size());
-			popMultiple(llvmArgs,calleeType->parameters.size());
+			// Pop the call arguments from the operand stack, after the callee's context argument.
+			const Uptr numArgs = calleeType->parameters.size() + 1;
+			auto llvmArgs = (llvm::Value**)alloca(sizeof(llvm::Value*) * numArgs);
+			llvmArgs[0] = calleeContext;
+			popMultiple(llvmArgs + 1,calleeType->parameters.size());
 
 			// Call the function.
-			auto result = irBuilder.CreateCall(callee,llvm::ArrayRef<llvm::Value*>(llvmArgs,calleeType->parameters.size()));
+			auto result = irBuilder.CreateCall(callee,llvm::ArrayRef<llvm::Value*>(llvmArgs,numArgs));
 
 			// Push the result on the operand stack.
 			if(calleeType->ret != ResultType::none) { push(result); }
@@ -665,42 +941,93 @@ namespace LLVMJIT
 			assert(imm.type.index < module.types.size());
 			
 			auto calleeType = module.types[imm.type.index];
-			auto functionPointerType = asLLVMType(calleeType)->getPointerTo()->getPointerTo();
+			auto functionPointerType = asLLVMType(calleeType)->getPointerTo();
 
 			// Compile the function index.
 			auto tableElementIndex = pop();
 			
-			// Compile the call arguments.
-			auto llvmArgs = (llvm::Value**)alloca(sizeof(llvm::Value*) * calleeType->parameters.size());
-			popMultiple(llvmArgs,calleeType->parameters.size());
+			// Compile the call arguments, leaving space for the callee's context argument.
+			const Uptr numArgs = calleeType->parameters.size() + 1;
+			auto llvmArgs = (llvm::Value**)alloca(sizeof(llvm::Value*) * numArgs);
+			popMultiple(llvmArgs + 1,calleeType->parameters.size());
 
 			// Zero extend the function index to the pointer size.
 			auto functionIndexZExt = irBuilder.CreateZExt(tableElementIndex,sizeof(Uptr) == 4 ? llvmI32Type : llvmI64Type);
 			
 			// If the function index is larger than the function table size, trap.
 			emitConditionalTrapIntrinsic(
-				irBuilder.CreateICmpUGE(functionIndexZExt,moduleContext.defaultTableEndOffset),
+				irBuilder.CreateICmpUGE(functionIndexZExt,defaultTableEndOffset),
 				"wavmIntrinsics.indirectCallIndexOutOfBounds",FunctionType::get(),{});
 
-			// Load the type for this table entry.
-			auto functionTypePointerPointer = irBuilder.CreateInBoundsGEP(moduleContext.defaultTablePointer,{functionIndexZExt,emitLiteral((U32)0)});
-			auto functionTypePointer = irBuilder.CreateLoad(functionTypePointerPointer);
-			auto llvmCalleeType = emitLiteralPointer(calleeType,llvmI8PtrType);
+			// Load the function and context for this table entry. The function is loaded with acquire ordering, so the
+			// context index and type ID written before it by setTableElement on another thread are also seen.
+			auto functionPointerPointer = irBuilder.CreateInBoundsGEP(defaultTableBase,{functionIndexZExt,emitLiteral((U32)2)});
+			auto functionPointer = irBuilder.CreateLoad(functionPointerPointer);
+			functionPointer->setAlignment(sizeof(void*));
+			functionPointer->setAtomic(llvm::AtomicOrdering::Acquire);
+			auto functionContextIndexPointer = irBuilder.CreateInBoundsGEP(defaultTableBase,{functionIndexZExt,emitLiteral((U32)1)});
+			auto functionContextIndex = irBuilder.CreateZExt(irBuilder.CreateLoad(functionContextIndexPointer),llvmI64Type);
+			auto functionContextPointer = irBuilder.CreateInBoundsGEP(moduleContext.instanceContexts,{emitLiteral((U64)0),functionContextIndex});
+			llvmArgs[0] = irBuilder.CreateLoad(functionContextPointer);
+
+			// If the callee is predicted to be a function defined in this module, check whether the table entry is that
+			// function, and if so, call it directly so it may be inlined. The callee's type doesn't need to be checked
+			// in that case.
+			const Uptr predictedCalleeIndex = moduleContext.predictedIndirectCallees[imm.type.index];
+			llvm::BasicBlock* predictedCallBlock = nullptr;
+			llvm::Value* predictedResult = nullptr;
+			llvm::BasicBlock* endBlock = nullptr;
+			if(predictedCalleeIndex != UINTPTR_MAX)
+			{
+				llvm::Function* predictedCallee = moduleContext.functionDefs[predictedCalleeIndex];
+				predictedCallBlock = llvm::BasicBlock::Create(context,"callIndirectPredicted",llvmFunction);
+				auto unpredictedCallBlock = llvm::BasicBlock::Create(context,"callIndirectUnpredicted",llvmFunction);
+				endBlock = llvm::BasicBlock::Create(context,"callIndirectEnd",llvmFunction);
+				irBuilder.CreateCondBr(
+					irBuilder.CreateICmpEQ(functionPointer,llvm::ConstantExpr::getPointerCast(predictedCallee,llvmI8PtrType)),
+					predictedCallBlock,unpredictedCallBlock);
+
+				irBuilder.SetInsertPoint(predictedCallBlock);
+				predictedResult = irBuilder.CreateCall(predictedCallee,llvm::ArrayRef<llvm::Value*>(llvmArgs,numArgs));
+				irBuilder.CreateBr(endBlock);
+
+				irBuilder.SetInsertPoint(unpredictedCallBlock);
+			}
+
+			// Load the type ID for this table entry.
+			auto functionTypeIDPointer = irBuilder.CreateInBoundsGEP(defaultTableBase,{functionIndexZExt,emitLiteral((U32)0)});
+			auto functionTypeID = irBuilder.CreateLoad(functionTypeIDPointer);
+			auto calleeTypeID = moduleContext.typeIDs[imm.type.index];
 			
 			// If the function type doesn't match, trap.
 			emitConditionalTrapIntrinsic(
-				irBuilder.CreateICmpNE(llvmCalleeType,functionTypePointer),
+				irBuilder.CreateICmpNE(calleeTypeID,functionTypeID),
 				"wavmIntrinsics.indirectCallSignatureMismatch",
-				FunctionType::get(ResultType::none,{ValueType::i32,ValueType::i64,ValueType::i64}),
+				FunctionType::get(ResultType::none,{ValueType::i32,ValueType::i32,ValueType::i64}),
 				{	tableElementIndex,
-					irBuilder.CreatePtrToInt(llvmCalleeType,llvmI64Type),
-					emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultTable))	}
+					calleeTypeID,
+					getDefaultTableObjectAsI64()	}
 				);
 
-			// Call the function loaded from the table.
-			auto functionPointerPointer = irBuilder.CreateInBoundsGEP(moduleContext.defaultTablePointer,{functionIndexZExt,emitLiteral((U32)1)});
-			auto functionPointer = irBuilder.CreateLoad(irBuilder.CreatePointerCast(functionPointerPointer,functionPointerType));
-			auto result = irBuilder.CreateCall(functionPointer,llvm::ArrayRef<llvm::Value*>(llvmArgs,calleeType->parameters.size()));
+			// Call the function loaded from the table, passing it the context loaded from the table.
+			llvm::Value* result = irBuilder.CreateCall(
+				irBuilder.CreatePointerCast(functionPointer,functionPointerType),
+				llvm::ArrayRef<llvm::Value*>(llvmArgs,numArgs));
+
+			// Merge the result of the predicted and unpredicted calls.
+			if(endBlock)
+			{
+				auto unpredictedCallBlock = irBuilder.GetInsertBlock();
+				irBuilder.CreateBr(endBlock);
+				irBuilder.SetInsertPoint(endBlock);
+				if(calleeType->ret != ResultType::none)
+				{
+					auto resultPHI = irBuilder.CreatePHI(asLLVMType(calleeType->ret),2);
+					resultPHI->addIncoming(predictedResult,predictedCallBlock);
+					resultPHI->addIncoming(result,unpredictedCallBlock);
+					result = resultPHI;
+				}
+			}
 
 			// Push the result on the operand stack.
 			if(calleeType->ret != ResultType::none) { push(result); }
@@ -712,32 +1039,29 @@ namespace LLVMJIT
 
 		void get_local(GetOrSetVariableImm<false> imm)
 		{
-			assert(imm.variableIndex < localPointers.size());
-			push(irBuilder.CreateLoad(localPointers[imm.variableIndex]));
+			assert(imm.variableIndex < localValues.size());
+			push(localValues[imm.variableIndex]);
 		}
 		void set_local(GetOrSetVariableImm<false> imm)
 		{
-			assert(imm.variableIndex < localPointers.size());
-			auto value = irBuilder.CreateBitCast(pop(),localPointers[imm.variableIndex]->getType()->getPointerElementType());
-			irBuilder.CreateStore(value,localPointers[imm.variableIndex]);
+			assert(imm.variableIndex < localValues.size());
+			localValues[imm.variableIndex] = irBuilder.CreateBitCast(pop(),localValues[imm.variableIndex]->getType());
 		}
 		void tee_local(GetOrSetVariableImm<false> imm)
 		{
-			assert(imm.variableIndex < localPointers.size());
-			auto value = irBuilder.CreateBitCast(getTopValue(),localPointers[imm.variableIndex]->getType()->getPointerElementType());
-			irBuilder.CreateStore(value,localPointers[imm.variableIndex]);
+			assert(imm.variableIndex < localValues.size());
+			localValues[imm.variableIndex] = irBuilder.CreateBitCast(getTopValue(),localValues[imm.variableIndex]->getType());
 		}
 		
 		void get_global(GetOrSetVariableImm<true> imm)
 		{
-			assert(imm.variableIndex < moduleContext.globalPointers.size());
-			push(irBuilder.CreateLoad(moduleContext.globalPointers[imm.variableIndex]));
+			push(irBuilder.CreateLoad(getGlobalValuePointer(imm.variableIndex)));
 		}
 		void set_global(GetOrSetVariableImm<true> imm)
 		{
-			assert(imm.variableIndex < moduleContext.globalPointers.size());
-			auto value = irBuilder.CreateBitCast(pop(),moduleContext.globalPointers[imm.variableIndex]->getType()->getPointerElementType());
-			irBuilder.CreateStore(value,moduleContext.globalPointers[imm.variableIndex]);
+			auto globalValuePointer = getGlobalValuePointer(imm.variableIndex);
+			auto value = irBuilder.CreateBitCast(pop(),globalValuePointer->getType()->getPointerElementType());
+			irBuilder.CreateStore(value,globalValuePointer);
 		}
 
 		//
@@ -748,7 +1072,7 @@ namespace LLVMJIT
 		void grow_memory(MemoryImm)
 		{
 			auto deltaNumPages = pop();
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = getDefaultMemoryObjectAsI64();
 			auto previousNumPages = emitRuntimeIntrinsic(
 				"wavmIntrinsics.growMemory",
 				FunctionType::get(ResultType::i32,{ValueType::i32,ValueType::i64}),
@@ -757,7 +1081,7 @@ namespace LLVMJIT
 		}
 		void current_memory(MemoryImm)
 		{
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = getDefaultMemoryObjectAsI64();
 			auto currentNumPages = emitRuntimeIntrinsic(
 				"wavmIntrinsics.currentMemory",
 				FunctionType::get(ResultType::i32,{ValueType::i64}),
@@ -944,6 +1268,82 @@ namespace LLVMJIT
 		// FP operators
 		//
 
+		// Converts a NaN to a quiet NaN by setting the most significant bit of its significand.
+		llvm::Value* emitQuietNaN(llvm::Value* value)
+		{
+			const bool is64Bit = value->getType() == llvmF64Type;
+			auto bits = irBuilder.CreateBitCast(value,is64Bit ? llvmI64Type : llvmI32Type);
+			auto quietBits = irBuilder.CreateOr(bits,is64Bit ? emitLiteral(U64(1) << 51) : emitLiteral(U32(1) << 22));
+			return irBuilder.CreateBitCast(quietBits,value->getType());
+		}
+
+		// Emits min or max: if either operand is a NaN, it's returned as a quiet NaN, and -0 is less than +0.
+		llvm::Value* emitFloatMinMax(llvm::Value* left,llvm::Value* right,bool isMin)
+		{
+			// If neither operand is less than the other, they're either identical or zeros with different signs.
+			// ORing their bits gives -0 for min, and ANDing them gives +0 for max.
+			llvm::Type* intType = left->getType() == llvmF64Type ? llvmI64Type : llvmI32Type;
+			auto leftBits = irBuilder.CreateBitCast(left,intType);
+			auto rightBits = irBuilder.CreateBitCast(right,intType);
+			auto equalResult = irBuilder.CreateBitCast(
+				isMin ? irBuilder.CreateOr(leftBits,rightBits) : irBuilder.CreateAnd(leftBits,rightBits),
+				left->getType());
+
+			auto result = irBuilder.CreateSelect(
+				isMin ? irBuilder.CreateFCmpOLT(left,right) : irBuilder.CreateFCmpOGT(left,right),
+				left,
+				irBuilder.CreateSelect(
+					isMin ? irBuilder.CreateFCmpOLT(right,left) : irBuilder.CreateFCmpOGT(right,left),
+					right,
+					equalResult));
+			result = irBuilder.CreateSelect(irBuilder.CreateFCmpUNO(right,right),emitQuietNaN(right),result);
+			return irBuilder.CreateSelect(irBuilder.CreateFCmpUNO(left,left),emitQuietNaN(left),result);
+		}
+
+		// Rounds a float to an integral value with a LLVM intrinsic, but returns NaN operands as quiet NaNs.
+		llvm::Value* emitFloatRound(llvm::Value* operand,llvm::Intrinsic::ID id)
+		{
+			auto rounded = irBuilder.CreateCall(getLLVMIntrinsic({operand->getType()},id),llvm::ArrayRef<llvm::Value*>({operand}));
+			return irBuilder.CreateSelect(irBuilder.CreateFCmpUNO(operand,operand),emitQuietNaN(operand),rounded);
+		}
+
+		// Truncates a float to an integer, trapping if the operand is a NaN or the truncated value isn't representable.
+		llvm::Value* emitFloatToInt(ValueType destType,llvm::Value* operand,bool isSigned)
+		{
+			llvm::Type* floatType = operand->getType();
+			emitConditionalTrapIntrinsic(
+				irBuilder.CreateFCmpUNO(operand,operand),
+				"wavmIntrinsics.invalidFloatOperationTrap",FunctionType::get(),{});
+
+			// The bounds are powers of two, so they're exactly representable in both float types. If the integer just
+			// below the signed minimum is also representable (only for f64->i32), values between it and the minimum
+			// truncate to the minimum.
+			const bool is64BitDest = destType == ValueType::i64;
+			const F64 signedMin = is64BitDest ? -9223372036854775808.0 : -2147483648.0;
+			llvm::Value* isOutOfRange;
+			if(isSigned)
+			{
+				auto isTooLarge = irBuilder.CreateFCmpOGE(operand,llvm::ConstantFP::get(floatType,-signedMin));
+				auto isTooSmall = !is64BitDest && floatType == llvmF64Type
+					? irBuilder.CreateFCmpOLE(operand,llvm::ConstantFP::get(floatType,signedMin - 1.0))
+					: irBuilder.CreateFCmpOLT(operand,llvm::ConstantFP::get(floatType,signedMin));
+				isOutOfRange = irBuilder.CreateOr(isTooLarge,isTooSmall);
+			}
+			else
+			{
+				auto isTooLarge = irBuilder.CreateFCmpOGE(operand,llvm::ConstantFP::get(floatType,-2.0 * signedMin));
+				auto isTooSmall = irBuilder.CreateFCmpOLE(operand,llvm::ConstantFP::get(floatType,-1.0));
+				isOutOfRange = irBuilder.CreateOr(isTooLarge,isTooSmall);
+			}
+			emitConditionalTrapIntrinsic(
+				isOutOfRange,
+				"wavmIntrinsics.divideByZeroOrIntegerOverflowTrap",FunctionType::get(),{});
+
+			return isSigned
+				? irBuilder.CreateFPToSI(operand,asLLVMType(destType))
+				: irBuilder.CreateFPToUI(operand,asLLVMType(destType));
+		}
+
 		EMIT_FP_BINARY_OP(add,irBuilder.CreateFAdd(left,right))
 		EMIT_FP_BINARY_OP(sub,irBuilder.CreateFSub(left,right))
 		EMIT_FP_BINARY_OP(mul,irBuilder.CreateFMul(left,right))
@@ -977,17 +1377,18 @@ namespace LLVMJIT
 		EMIT_UNARY_OP(i32,reinterpret_f32,irBuilder.CreateBitCast(operand,llvmI32Type))
 		EMIT_UNARY_OP(i64,reinterpret_f64,irBuilder.CreateBitCast(operand,llvmI64Type))
 
-		// These operations don't match LLVM's semantics exactly, so just call out to C++ implementations.
-		EMIT_FP_BINARY_OP(min,emitRuntimeIntrinsic("wavmIntrinsics.floatMin",FunctionType::get(asResultType(type),{type,type}),{left,right}))
-		EMIT_FP_BINARY_OP(max,emitRuntimeIntrinsic("wavmIntrinsics.floatMax",FunctionType::get(asResultType(type),{type,type}),{left,right}))
-		EMIT_FP_UNARY_OP(ceil,emitRuntimeIntrinsic("wavmIntrinsics.floatCeil",FunctionType::get(asResultType(type),{type}),{operand}))
-		EMIT_FP_UNARY_OP(floor,emitRuntimeIntrinsic("wavmIntrinsics.floatFloor",FunctionType::get(asResultType(type),{type}),{operand}))
-		EMIT_FP_UNARY_OP(trunc,emitRuntimeIntrinsic("wavmIntrinsics.floatTrunc",FunctionType::get(asResultType(type),{type}),{operand}))
-		EMIT_FP_UNARY_OP(nearest,emitRuntimeIntrinsic("wavmIntrinsics.floatNearest",FunctionType::get(asResultType(type),{type}),{operand}))
-		EMIT_INT_UNARY_OP(trunc_s_f32,emitRuntimeIntrinsic("wavmIntrinsics.floatToSignedInt",FunctionType::get(asResultType(type),{ValueType::f32}),{operand}))
-		EMIT_INT_UNARY_OP(trunc_s_f64,emitRuntimeIntrinsic("wavmIntrinsics.floatToSignedInt",FunctionType::get(asResultType(type),{ValueType::f64}),{operand}))
-		EMIT_INT_UNARY_OP(trunc_u_f32,emitRuntimeIntrinsic("wavmIntrinsics.floatToUnsignedInt",FunctionType::get(asResultType(type),{ValueType::f32}),{operand}))
-		EMIT_INT_UNARY_OP(trunc_u_f64,emitRuntimeIntrinsic("wavmIntrinsics.floatToUnsignedInt",FunctionType::get(asResultType(type),{ValueType::f64}),{operand}))
+		// These operations don't match LLVM's semantics exactly, so they add explicit handling of NaNs, zero signs,
+		// and out-of-range values to LLVM's operations.
+		EMIT_FP_BINARY_OP(min,emitFloatMinMax(left,right,true))
+		EMIT_FP_BINARY_OP(max,emitFloatMinMax(left,right,false))
+		EMIT_FP_UNARY_OP(ceil,emitFloatRound(operand,llvm::Intrinsic::ceil))
+		EMIT_FP_UNARY_OP(floor,emitFloatRound(operand,llvm::Intrinsic::floor))
+		EMIT_FP_UNARY_OP(trunc,emitFloatRound(operand,llvm::Intrinsic::trunc))
+		EMIT_FP_UNARY_OP(nearest,emitFloatRound(operand,llvm::Intrinsic::nearbyint))
+		EMIT_INT_UNARY_OP(trunc_s_f32,emitFloatToInt(type,operand,true))
+		EMIT_INT_UNARY_OP(trunc_s_f64,emitFloatToInt(type,operand,true))
+		EMIT_INT_UNARY_OP(trunc_u_f32,emitFloatToInt(type,operand,false))
+		EMIT_INT_UNARY_OP(trunc_u_f64,emitFloatToInt(type,operand,false))
 
 		#if ENABLE_SIMD_PROTOTYPE
 		llvm::Value* emitAnyTrue(llvm::Value* boolVector)
@@ -1232,7 +1633,7 @@ namespace LLVMJIT
 		{
 			auto numWaiters = pop();
 			auto address = pop();
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = getDefaultMemoryObjectAsI64();
 			push(emitRuntimeIntrinsic(
 				"wavmIntrinsics.wake",
 				FunctionType::get(ResultType::i32,{ValueType::i32,ValueType::i32,ValueType::i64}),
@@ -1243,7 +1644,7 @@ namespace LLVMJIT
 			auto timeout = pop();
 			auto expectedValue = pop();
 			auto address = pop();
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = getDefaultMemoryObjectAsI64();
 			push(emitRuntimeIntrinsic(
 				"wavmIntrinsics.wait",
 				FunctionType::get(ResultType::i32,{ValueType::i32,ValueType::i32,ValueType::f64,ValueType::i64}),
@@ -1254,7 +1655,7 @@ namespace LLVMJIT
 			auto timeout = pop();
 			auto expectedValue = pop();
 			auto address = pop();
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = getDefaultMemoryObjectAsI64();
 			push(emitRuntimeIntrinsic(
 				"wavmIntrinsics.wait",
 				FunctionType::get(ResultType::i32,{ValueType::i32,ValueType::i64,ValueType::f64,ValueType::i64}),
@@ -1263,11 +1664,10 @@ namespace LLVMJIT
 
 		void launch_thread(LaunchThreadImm)
 		{
-			assert(moduleContext.moduleInstance->defaultTable);
 			auto errorFunctionIndex = pop();
 			auto argument = pop();
 			auto functionIndex = pop();
-			auto defaultTableAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultTable));
+			auto defaultTableAsI64 = getDefaultTableObjectAsI64();
 			emitRuntimeIntrinsic(
 				"wavmIntrinsics.launchThread",
 				FunctionType::get(ResultType::none,{ValueType::i32,ValueType::i32,ValueType::i32,ValueType::i64}),
@@ -1456,9 +1856,10 @@ namespace LLVMJIT
 		#undef VISIT_OP
 
 		// Keep track of control structure nesting level in unreachable code, so we know when we reach the end of the unreachable code.
-		void block(ControlStructureImm) { ++unreachableControlDepth; }
-		void loop(ControlStructureImm) { ++unreachableControlDepth; }
-		void if_(ControlStructureImm) { ++unreachableControlDepth; }
+		// The control structures are still counted, so the IR emitter can find the locals set in later control structures.
+		void block(ControlStructureImm) { ++unreachableControlDepth; ++context.nextControlStructureIndex; }
+		void loop(ControlStructureImm) { ++unreachableControlDepth; ++context.nextControlStructureIndex; }
+		void if_(ControlStructureImm) { ++unreachableControlDepth; ++context.nextControlStructureIndex; }
 
 		// If an else or end opcode would signal an end to the unreachable code, then pass it through to the IR emitter.
 		void else_(NoImm imm)
@@ -1476,23 +1877,83 @@ namespace LLVMJIT
 		Uptr unreachableControlDepth;
 	};
 
+	// A visitor that finds the locals that may be set within each control structure in a function.
+	struct SetLocalsVisitor
+	{
+		typedef void Result;
+
+		// The locals that may be set within each control structure, in the order the control structures occur.
+		std::vector<std::vector<Uptr>> setLocalsByControlStructure;
+
+		#define VISIT_OP(encoding,name,nameString,Imm,...) void name(Imm imm) { visitOp(Opcode::name,imm); }
+		ENUM_NONCONTROL_OPERATORS(VISIT_OP)
+		#undef VISIT_OP
+		void unknown(Opcode opcode) { Errors::unreachable(); }
+
+		void block(ControlStructureImm) { enterControlStructure(); }
+		void loop(ControlStructureImm) { enterControlStructure(); }
+		void if_(ControlStructureImm) { enterControlStructure(); }
+		void else_(NoImm) {}
+		void end(NoImm)
+		{
+			// The function's end doesn't have a corresponding control structure.
+			if(!openControlStructures.size()) { return; }
+
+			// Remove duplicate locals from the control structure's set, and add them to the enclosing control structure's.
+			std::vector<Uptr>& setLocals = setLocalsByControlStructure[openControlStructures.back()];
+			std::sort(setLocals.begin(),setLocals.end());
+			setLocals.erase(std::unique(setLocals.begin(),setLocals.end()),setLocals.end());
+			openControlStructures.pop_back();
+			if(openControlStructures.size())
+			{
+				std::vector<Uptr>& outerSetLocals = setLocalsByControlStructure[openControlStructures.back()];
+				outerSetLocals.insert(outerSetLocals.end(),setLocals.begin(),setLocals.end());
+			}
+		}
+
+	private:
+		std::vector<Uptr> openControlStructures;
+
+		void enterControlStructure()
+		{
+			openControlStructures.push_back(setLocalsByControlStructure.size());
+			setLocalsByControlStructure.emplace_back();
+		}
+
+		template<typename Imm>
+		void visitOp(Opcode,Imm) {}
+		void visitOp(Opcode opcode,GetOrSetVariableImm<false> imm)
+		{
+			if(opcode != Opcode::get_local && openControlStructures.size())
+			{
+				setLocalsByControlStructure[openControlStructures.back()].push_back(imm.variableIndex);
+			}
+		}
+	};
+
 	void EmitFunctionContext::emit()
 	{
-		// Create debug info for the function.
-		llvm::SmallVector<llvm::Metadata*,10> diFunctionParameterTypes;
-		for(auto parameterType : functionType->parameters) { diFunctionParameterTypes.push_back(moduleContext.diValueTypes[(Uptr)parameterType]); }
-		auto diFunctionType = moduleContext.diBuilder.createSubroutineType(moduleContext.diBuilder.getOrCreateTypeArray(diFunctionParameterTypes));
-		diFunction = moduleContext.diBuilder.createFunction(
-			moduleContext.diModuleScope,
-			functionInstance->debugName,
-			llvmFunction->getName(),
-			moduleContext.diModuleScope,
-			0,
-			diFunctionType,
-			false,
-			true,
-			0);
-		llvmFunction->setSubprogram(diFunction);
+		// Create debug info for the function, with the types of its parameters if the module has full debug info.
+		if(moduleContext.diCompileUnit)
+		{
+			llvm::SmallVector<llvm::Metadata*,10> diFunctionParameterTypes;
+			if(moduleContext.debugInfoLevel == Runtime::CompileOptions::DebugInfoLevel::full)
+			{
+				for(auto parameterType : functionType->parameters) { diFunctionParameterTypes.push_back(moduleContext.diValueTypes[(Uptr)parameterType]); }
+			}
+			auto diFunctionType = moduleContext.diBuilder.createSubroutineType(moduleContext.diBuilder.getOrCreateTypeArray(diFunctionParameterTypes));
+			diFunction = moduleContext.diBuilder.createFunction(
+				moduleContext.diModuleScope,
+				debugName,
+				llvmFunction->getName(),
+				moduleContext.diModuleScope,
+				0,
+				diFunctionType,
+				false,
+				true,
+				0);
+			llvmFunction->setSubprogram(diFunction);
+		}
 
 		// Create the return basic block, and push the root control context for the function.
 		auto returnBlock = llvm::BasicBlock::Create(context,"return",llvmFunction);
@@ -1504,39 +1965,79 @@ namespace LLVMJIT
 		auto entryBasicBlock = llvm::BasicBlock::Create(context,"entry",llvmFunction);
 		irBuilder.SetInsertPoint(entryBasicBlock);
 
+		// The first argument is the function's InstanceContext. Load the default memory and table addresses from it
+		// once in the entry block: they are constant for the lifetime of the instance.
+		auto llvmArgIt = llvmFunction->arg_begin();
+		contextPointer = (llvm::Argument*)&(*llvmArgIt);
+		++llvmArgIt;
+		llvm::Type* uptrType = sizeof(Uptr) == 8 ? llvmI64Type : llvmI32Type;
+		if(module.memories.size())
+		{
+			defaultMemoryBase = loadFromContext(offsetof(InstanceContext,defaultMemoryBase),llvmI8PtrType,true);
+			defaultMemoryEndOffset = loadFromContext(offsetof(InstanceContext,defaultMemoryEndOffset),uptrType,true);
+		}
+		if(module.tables.size())
+		{
+			defaultTableBase = loadFromContext(offsetof(InstanceContext,defaultTableBase),moduleContext.tableElementType->getPointerTo(),true);
+			defaultTableEndOffset = loadFromContext(offsetof(InstanceContext,defaultTableEndOffset),uptrType,true);
+		}
+
+		// The locals are kept in SSA form: initialize the parameters to the function's arguments, and the non-parameter
+		// locals to zero.
+		for(Uptr parameterIndex = 0;parameterIndex < functionType->parameters.size();++parameterIndex)
+		{
+			localValues.push_back((llvm::Argument*)&(*llvmArgIt));
+			++llvmArgIt;
+		}
+		for(auto localType : functionDef.nonParameterLocalTypes)
+		{
+			localValues.push_back(typedZeroConstants[(Uptr)localType]);
+		}
+
+		// Find the locals that may be set within each control structure, so only those need to be merged by phis at
+		// the control structure's branch targets.
+		{
+			SetLocalsVisitor setLocalsVisitor;
+			OperatorDecoderStream setLocalsDecoder(functionDef.code);
+			while(setLocalsDecoder) { setLocalsDecoder.decodeOp(setLocalsVisitor); }
+			setLocalsByControlStructure = std::move(setLocalsVisitor.setLocalsByControlStructure);
+		}
+
+		if(moduleContext.tier == CodeTier::baseline)
+		{
+			// If the function's slot has been updated with optimized code, then this baseline code was called through
+			// a stale pointer (e.g. from a table or an invoke): forward the call to the optimized code.
+			auto slotCode = loadFunctionDefSlot(functionDefIndex);
+			auto forwardBlock = llvm::BasicBlock::Create(context,"forwardToOptimizedCode",llvmFunction);
+			auto bodyBlock = llvm::BasicBlock::Create(context,"body",llvmFunction);
+			irBuilder.CreateCondBr(
+				irBuilder.CreateICmpNE(slotCode,llvm::ConstantExpr::getPointerCast(llvmFunction,llvmI8PtrType)),
+				forwardBlock,bodyBlock,
+				moduleContext.likelyFalseBranchWeights);
+
+			irBuilder.SetInsertPoint(forwardBlock);
+			llvm::SmallVector<llvm::Value*,8> forwardArgs;
+			for(llvm::Argument& arg : llvmFunction->args()) { forwardArgs.push_back(&arg); }
+			auto forwardCall = irBuilder.CreateCall(irBuilder.CreatePointerCast(slotCode,llvmFunction->getType()),forwardArgs);
+			forwardCall->setTailCall();
+			if(functionType->ret == ResultType::none) { irBuilder.CreateRetVoid(); }
+			else { irBuilder.CreateRet(forwardCall); }
+
+			// Otherwise, count the call towards the function's tier-up counter.
+			irBuilder.SetInsertPoint(bodyBlock);
+			emitTierUpCounter();
+		}
+
 		// If enabled, emit a call to the WAVM function enter hook (for debugging).
 		if(ENABLE_FUNCTION_ENTER_EXIT_HOOKS)
 		{
 			emitRuntimeIntrinsic(
 				"wavmIntrinsics.debugEnterFunction",
 				FunctionType::get(ResultType::none,{ValueType::i64}),
-				{emitLiteral(reinterpret_cast<U64>(functionInstance))}
+				{emitLiteral(U64(functionDefIndex))}
 				);
 		}
 
-		// Create and initialize allocas for all the locals and parameters.
-		auto llvmArgIt = llvmFunction->arg_begin();
-		for(Uptr localIndex = 0;localIndex < functionType->parameters.size() + functionDef.nonParameterLocalTypes.size();++localIndex)
-		{
-			auto localType = localIndex < functionType->parameters.size()
-				? functionType->parameters[localIndex]
-				: functionDef.nonParameterLocalTypes[localIndex - functionType->parameters.size()];
-			auto localPointer = irBuilder.CreateAlloca(asLLVMType(localType),nullptr,"");
-			localPointers.push_back(localPointer);
-
-			if(localIndex < functionType->parameters.size())
-			{
-				// Copy the parameter value into the local that stores it.
-				irBuilder.CreateStore((llvm::Argument*)&(*llvmArgIt),localPointer);
-				++llvmArgIt;
-			}
-			else
-			{
-				// Initialize non-parameter locals to zero.
-				irBuilder.CreateStore(typedZeroConstants[(Uptr)localType],localPointer);
-			}
-		}
-
 		// Decode the WebAssembly opcodes and emit LLVM IR for them.
 		OperatorDecoderStream decoder(functionDef.code);
 		UnreachableOpVisitor unreachableOpVisitor(*this);
@@ -1544,7 +2045,8 @@ namespace LLVMJIT
 		Uptr opIndex = 0;
 		while(decoder && controlStack.size())
 		{
-			irBuilder.SetCurrentDebugLocation(llvm::DILocation::get(context,(unsigned int)opIndex++,0,diFunction));
+			if(diFunction) { irBuilder.SetCurrentDebugLocation(llvm::DILocation::get(context,(unsigned int)opIndex,0,diFunction)); }
+			++opIndex;
 			if(ENABLE_LOGGING)
 			{
 				logOperator(decoder.decodeOpWithoutConsume(operatorPrinter));
@@ -1561,7 +2063,7 @@ namespace LLVMJIT
 			emitRuntimeIntrinsic(
 				"wavmIntrinsics.debugExitFunction",
 				FunctionType::get(ResultType::none,{ValueType::i64}),
-				{emitLiteral(reinterpret_cast<U64>(functionInstance))}
+				{emitLiteral(U64(functionDefIndex))}
 				);
 		}
 
@@ -1570,57 +2072,115 @@ namespace LLVMJIT
 		else { irBuilder.CreateRet(pop()); }
 	}
 
+	void EmitFunctionContext::emitLazyStub()
+	{
+		auto entryBlock = llvm::BasicBlock::Create(context,"entry",llvmFunction);
+		auto compileBlock = llvm::BasicBlock::Create(context,"compile",llvmFunction);
+		auto callBlock = llvm::BasicBlock::Create(context,"call",llvmFunction);
+		irBuilder.SetInsertPoint(entryBlock);
+		contextPointer = (llvm::Argument*)&*llvmFunction->arg_begin();
+
+		// If the function's slot still points to this stub, compile the function, which replaces the slot's code.
+		irBuilder.CreateCondBr(
+			irBuilder.CreateICmpEQ(loadFunctionDefSlot(functionDefIndex),llvm::ConstantExpr::getPointerCast(llvmFunction,llvmI8PtrType)),
+			compileBlock,callBlock);
+
+		irBuilder.SetInsertPoint(compileBlock);
+		emitRuntimeIntrinsic("wavmIntrinsics.compileFunctionDef",FunctionType::get(ResultType::none,{ValueType::i64}),{emitLiteral(U64(functionDefIndex))});
+		irBuilder.CreateBr(callBlock);
+
+		// Forward the call to the compiled function.
+		irBuilder.SetInsertPoint(callBlock);
+		llvm::SmallVector<llvm::Value*,8> forwardArgs;
+		for(llvm::Argument& arg : llvmFunction->args()) { forwardArgs.push_back(&arg); }
+		auto forwardCall = irBuilder.CreateCall(irBuilder.CreatePointerCast(loadFunctionDefSlot(functionDefIndex),llvmFunction->getType()),forwardArgs);
+		forwardCall->setTailCall();
+		if(functionType->ret == ResultType::none) { irBuilder.CreateRetVoid(); }
+		else { irBuilder.CreateRet(forwardCall); }
+	}
+
 	llvm::Module* EmitModuleContext::emit()
 	{
 		Timing::Timer emitTimer;
 
-		// Create literals for the default memory base and mask.
-		if(moduleInstance->defaultMemory)
+		// The LLVM type of a TableInstance::FunctionElement.
+		tableElementType = llvm::StructType::get(context,{
+			llvmI32Type,
+			llvmI32Type,
+			llvmI8PtrType
+			});
+
+		// Create a LLVM symbol for the array of instance contexts that table elements refer to by index.
+		if(module.tables.size())
 		{
-			defaultMemoryBase = emitLiteralPointer(moduleInstance->defaultMemory->baseAddress,llvmI8PtrType);
-			const Uptr defaultMemoryEndOffsetValue = Uptr(moduleInstance->defaultMemory->endOffset);
-			defaultMemoryEndOffset = emitLiteral(defaultMemoryEndOffsetValue);
+			instanceContexts = emitImportedSymbol("instanceContexts",llvm::ArrayType::get(llvmI8PtrType,0));
 		}
-		else { defaultMemoryBase = defaultMemoryEndOffset = nullptr; }
 
-		// Set up the LLVM values used to access the global table.
-		if(moduleInstance->defaultTable)
+		// Create LLVM symbols for the module's function types, which call_indirect compares against the type of table elements.
+		// The address of each symbol is the canonical ID of the type.
+		for(Uptr typeIndex = 0;typeIndex < module.types.size();++typeIndex)
 		{
-			auto tableElementType = llvm::StructType::get(context,{
-				llvmI8PtrType,
-				llvmI8PtrType
-				});
-			defaultTablePointer = emitLiteralPointer(moduleInstance->defaultTable->baseAddress,tableElementType->getPointerTo());
-			defaultTableEndOffset = emitLiteral((Uptr)moduleInstance->defaultTable->endOffset);
+			auto typeSymbol = emitImportedSymbol("type" + std::to_string(typeIndex),llvmI8Type);
+			typeIDs.push_back(llvm::ConstantExpr::getTrunc(llvm::ConstantExpr::getPtrToInt(typeSymbol,llvmI64Type),llvmI32Type));
 		}
-		else
+
+		// Statically predict the callee of call_indirect for each function type: if the module's table segments contain
+		// exactly one function with the type, and it's defined in this module, call_indirect checks for it and calls it
+		// directly. This is a single prediction per type shared by all call sites, rather than a cache of the callees
+		// seen at each call site.
+		predictedIndirectCallees.assign(module.types.size(),UINTPTR_MAX);
+		if(ENABLE_INDIRECT_CALL_PREDICTION && !usesFunctionDefSlots())
 		{
-			defaultTablePointer = defaultTableEndOffset = nullptr;
+			std::map<const FunctionType*,Uptr> functionDefIndicesByType;
+			for(const TableSegment& tableSegment : module.tableSegments)
+			{
+				for(Uptr functionIndex : tableSegment.indices)
+				{
+					const bool isImport = functionIndex < module.functions.imports.size();
+					const Uptr functionDefIndex = isImport ? UINTPTR_MAX : functionIndex - module.functions.imports.size();
+					const FunctionType* functionType = module.types[isImport
+						? module.functions.imports[functionIndex].type.index
+						: module.functions.defs[functionDefIndex].type.index];
+
+					auto typeIt = functionDefIndicesByType.find(functionType);
+					if(typeIt == functionDefIndicesByType.end()) { functionDefIndicesByType[functionType] = functionDefIndex; }
+					else if(typeIt->second != functionDefIndex) { typeIt->second = UINTPTR_MAX; }
+				}
+			}
+			for(Uptr typeIndex = 0;typeIndex < module.types.size();++typeIndex)
+			{
+				auto typeIt = functionDefIndicesByType.find(module.types[typeIndex]);
+				if(typeIt != functionDefIndicesByType.end()) { predictedIndirectCallees[typeIndex] = typeIt->second; }
+			}
 		}
 
-		// Create LLVM pointer constants for the module's imported functions.
-		for(Uptr functionIndex = 0;functionIndex < module.functions.imports.size();++functionIndex)
+		// Create LLVM symbols for the slots and tier-up counters used by tiered and lazily compiled code.
+		if(usesFunctionDefSlots())
 		{
-			const FunctionInstance* functionInstance = moduleInstance->functions[functionIndex];
-			importedFunctionPointers.push_back(emitLiteralPointer(functionInstance->nativeFunction,asLLVMType(functionInstance->type)->getPointerTo()));
+			functionDefSlots = emitImportedSymbol("functionDefSlots",llvm::ArrayType::get(llvmI8PtrType,0));
+		}
+		if(tier == CodeTier::baseline)
+		{
+			functionDefTierUpCounters = emitImportedSymbol("functionDefTierUpCounters",llvm::ArrayType::get(llvmI32Type,0));
 		}
-
-		// Create LLVM pointer constants for the module's globals.
-		for(auto global : moduleInstance->globals)
-		{ globalPointers.push_back(emitLiteralPointer(&global->value,asLLVMType(global->type.valueType)->getPointerTo())); }
 		
 		// Create the LLVM functions.
 		functionDefs.resize(module.functions.defs.size());
 		for(Uptr functionDefIndex = 0;functionDefIndex < module.functions.defs.size();++functionDefIndex)
 		{
 			auto llvmFunctionType = asLLVMType(module.types[module.functions.defs[functionDefIndex].type.index]);
-			auto externalName = getExternalFunctionName(moduleInstance,functionDefIndex);
+			auto externalName = getExternalFunctionName(functionDefIndex,functionDefDebugNames[functionDefIndex]);
 			functionDefs[functionDefIndex] = llvm::Function::Create(llvmFunctionType,llvm::Function::ExternalLinkage,externalName,llvmModule);
 		}
 
-		// Compile each function in the module.
+		// Compile each function in the module, or only the requested function.
 		for(Uptr functionDefIndex = 0;functionDefIndex < module.functions.defs.size();++functionDefIndex)
-		{ EmitFunctionContext(*this,module,module.functions.defs[functionDefIndex],moduleInstance->functionDefs[functionDefIndex],functionDefs[functionDefIndex]).emit(); }
+		{
+			if(singleFunctionDefIndex != UINTPTR_MAX && functionDefIndex != singleFunctionDefIndex) { continue; }
+			EmitFunctionContext functionContext(*this,module,functionDefIndex,functionDefDebugNames[functionDefIndex],functionDefs[functionDefIndex]);
+			if(tier == CodeTier::lazyStub) { functionContext.emitLazyStub(); }
+			else { functionContext.emit(); }
+		}
 		
 		// Finalize the debug info.
 		diBuilder.finalize();
@@ -1630,8 +2190,10 @@ namespace LLVMJIT
 		return llvmModule;
 	}
 
-	llvm::Module* emitModule(const Module& module,ModuleInstance* moduleInstance)
+	llvm::Module* emitModule(const Module& module,const std::vector<std::string>& functionDefDebugNames,CodeTier tier,Runtime::CompileOptions::DebugInfoLevel debugInfoLevel,Uptr singleFunctionDefIndex)
 	{
-		return EmitModuleContext(module,moduleInstance).emit();
+		assert(functionDefDebugNames.size() == module.functions.defs.size());
+		assert(singleFunctionDefIndex == UINTPTR_MAX || singleFunctionDefIndex < module.functions.defs.size());
+		return EmitModuleContext(module,functionDefDebugNames,tier,debugInfoLevel,singleFunctionDefIndex).emit();
 	}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "LLVMJIT.h"
 #include "Inline/BasicTypes.h"
 #include "Inline/Timing.h"
+#include "IR/Module.h"
 #include "Logging/Logging.h"
 #include "RuntimePrivate.h"
 
@@ -51,69 +52,538 @@ namespace LLVMJIT
 
 	llvm::Constant* typedZeroConstants[(Uptr)ValueType::num];
 	
-	// A map from address to loaded JIT symbols.
-	Platform::Mutex* addressToSymbolMapMutex = Platform::createMutex();
-	std::map<Uptr,struct JITSymbol*> addressToSymbolMap;
+	// Serializes use of the global LLVM context. Modules are emitted in it by any thread that compiles code, and then
+	// compiled in their own contexts without holding the lock.
+	Platform::Mutex* llvmContextMutex = Platform::createMutex();
 
-	// A map from function types to function indices in the invoke thunk unit.
-	std::map<const FunctionType*,struct JITSymbol*> invokeThunkTypeToSymbolMap;
+	// Whether modules are compiled to baseline code, and then hot functions are recompiled with optimization. This and
+	// the other compilation settings are atomic since they may be set while other threads are compiling modules.
+	static std::atomic<bool> isTieredCompilationEnabled(false);
+
+	// Whether modules are compiled to stubs that compile each function on its first call.
+	static std::atomic<bool> isLazyCompilationEnabled(false);
+
+	// Whether the code of large JIT units is given whole huge pages from a shared reserved region.
+	static std::atomic<bool> isHugePageCodeEnabled(false);
+
+	// Whether loaded objects are registered with debuggers through the GDB JIT interface. This is atomic since it may be
+	// set while other threads are loading objects.
+	static std::atomic<bool> isGDBRegistrationEnabled(false);
+
+	// The number of calls and loop iterations in a function's baseline code that cause it to be recompiled with
+	// optimization. Each module uses the threshold that was set when it was compiled.
+	static std::atomic<U32> tierUpThreshold(10000);
+
+	// Serializes requests for optimized code for hot functions.
+	Platform::Mutex* tierUpRequestMutex = Platform::createMutex();
+
+	// A hash table of the invoke thunks for each function type, which is read without locking. Thunks are only added
+	// while holding invokeThunkCacheMutex: the thunk is written to an empty entry before its function type is published.
+	// When the table becomes half full, it's replaced with a larger copy. Replaced tables are never freed, since other
+	// threads may still be reading them, but their total size is less than the size of the current table.
+	struct InvokeThunkCacheTable
+	{
+		struct Entry
+		{
+			std::atomic<const FunctionType*> functionType;
+			std::atomic<InvokeFunctionPointer> invokeThunk;
+		};
+
+		const Uptr numEntries;
+		Uptr numUsedEntries;
+		Entry* entries;
+
+		InvokeThunkCacheTable(Uptr inNumEntries)
+		: numEntries(inNumEntries), numUsedEntries(0), entries(new Entry[inNumEntries])
+		{
+			assert(!(numEntries & (numEntries - 1)));
+			for(Uptr entryIndex = 0;entryIndex < numEntries;++entryIndex)
+			{
+				entries[entryIndex].functionType.store(nullptr,std::memory_order_relaxed);
+				entries[entryIndex].invokeThunk.store(nullptr,std::memory_order_relaxed);
+			}
+		}
+	};
+	static std::atomic<InvokeThunkCacheTable*> invokeThunkCache(new InvokeThunkCacheTable(64));
+	static Platform::Mutex* invokeThunkCacheMutex = Platform::createMutex();
 
 	// Information about a JIT symbol, used to map instruction pointers to descriptive names.
 	struct JITSymbol
 	{
 		enum class Type
 		{
-			functionInstance,
+			functionDef,
 			invokeThunk
 		};
 		Type type;
 		union
 		{
-			FunctionInstance* functionInstance;
+			const char* functionDefDebugName;
 			const FunctionType* invokeThunkType;
 		};
 		Uptr baseAddress;
 		Uptr numBytes;
-		std::map<U32,U32> offsetToOpIndexMap;
-		
-		JITSymbol(FunctionInstance* inFunctionInstance,Uptr inBaseAddress,Uptr inNumBytes,std::map<U32,U32>&& inOffsetToOpIndexMap)
-		: type(Type::functionInstance), functionInstance(inFunctionInstance), baseAddress(inBaseAddress), numBytes(inNumBytes), offsetToOpIndexMap(inOffsetToOpIndexMap) {}
 
-		JITSymbol(const FunctionType* inInvokeThunkType,Uptr inBaseAddress,Uptr inNumBytes,std::map<U32,U32>&& inOffsetToOpIndexMap)
-		: type(Type::invokeThunk), invokeThunkType(inInvokeThunkType), baseAddress(inBaseAddress), numBytes(inNumBytes), offsetToOpIndexMap(inOffsetToOpIndexMap) {}
+		// The op index for each symbol-relative code offset that starts the code for an op, sorted by offset. It's
+		// decoded from the line table of the object the symbol was loaded from, if the object has one, when the symbol
+		// is created, so describing an instruction pointer never needs the object's DWARF context.
+		std::vector<std::pair<U32,U32>> offsetToOpIndexArray;
+
+		JITSymbol(const char* inFunctionDefDebugName,Uptr inBaseAddress,Uptr inNumBytes,llvm::DWARFContext* dwarfContext)
+		: type(Type::functionDef), functionDefDebugName(inFunctionDefDebugName), baseAddress(inBaseAddress), numBytes(inNumBytes)
+		{ decodeLineTable(dwarfContext); }
+
+		JITSymbol(const FunctionType* inInvokeThunkType,Uptr inBaseAddress,Uptr inNumBytes,llvm::DWARFContext* dwarfContext)
+		: type(Type::invokeThunk), invokeThunkType(inInvokeThunkType), baseAddress(inBaseAddress), numBytes(inNumBytes)
+		{ decodeLineTable(dwarfContext); }
+
+	private:
+
+		void decodeLineTable(llvm::DWARFContext* dwarfContext)
+		{
+			if(!dwarfContext) { return; }
+
+			// Get the DWARF line info for the symbol, which maps machine code addresses to WebAssembly op indices.
+			llvm::DILineInfoTable lineInfoTable = dwarfContext->getLineInfoForAddressRange(baseAddress,numBytes);
+			std::map<U32,U32> offsetToOpIndexMap;
+			for(auto lineInfo : lineInfoTable) { offsetToOpIndexMap.emplace(U32(lineInfo.first - baseAddress),lineInfo.second.Line); }
+			offsetToOpIndexArray.assign(offsetToOpIndexMap.begin(),offsetToOpIndexMap.end());
+		}
+	};
+
+	// An immutable table of the symbols loaded by a JIT unit, sorted by end address so it can be binary searched
+	// without locking. The table owns its symbols.
+	struct JITSymbolTable
+	{
+		Uptr baseAddress;
+		Uptr endAddress;
+		std::vector<Uptr> endAddresses;
+		std::vector<JITSymbol*> symbols;
+
+		JITSymbolTable(std::vector<JITSymbol*>&& inSymbols)
+		: baseAddress(UINTPTR_MAX), endAddress(0), symbols(std::move(inSymbols))
+		{
+			std::sort(symbols.begin(),symbols.end(),[](const JITSymbol* a,const JITSymbol* b)
+				{ return a->baseAddress + a->numBytes < b->baseAddress + b->numBytes; });
+			for(const JITSymbol* symbol : symbols)
+			{
+				endAddresses.push_back(symbol->baseAddress + symbol->numBytes);
+				baseAddress = std::min(baseAddress,symbol->baseAddress);
+				endAddress = std::max(endAddress,symbol->baseAddress + symbol->numBytes);
+			}
+		}
+		~JITSymbolTable() { for(JITSymbol* symbol : symbols) { delete symbol; } }
+	};
+
+	// The symbol tables of all loaded JIT units, which are searched without locking to look up instruction pointers.
+	// A unit's table is published in a slot of the directory when the unit is loaded, and the slot is cleared when the
+	// unit is freed, to be reused by a later unit. Slots are appended until the directory is full, and then it's
+	// replaced by a copy with twice as many slots, so publishing a table doesn't copy the other tables.
+	struct JITSymbolDirectory
+	{
+		const Uptr numSlots;
+		std::atomic<Uptr> numUsedSlots;
+		std::unique_ptr<std::atomic<const JITSymbolTable*>[]> slots;
+
+		JITSymbolDirectory(Uptr inNumSlots)
+		: numSlots(inNumSlots), numUsedSlots(0), slots(new std::atomic<const JITSymbolTable*>[inNumSlots])
+		{
+			for(Uptr slotIndex = 0;slotIndex < numSlots;++slotIndex) { slots[slotIndex].store(nullptr,std::memory_order_relaxed); }
+		}
+	};
+	static std::atomic<JITSymbolDirectory*> symbolDirectory(new JITSymbolDirectory(64));
+
+	// Readers increment numSymbolDirectoryReaders while they use the directory: replaced directories and unpublished
+	// tables are only deleted once there are no readers, since any reader that starts after that won't see them.
+	static std::atomic<Uptr> numSymbolDirectoryReaders(0);
+
+	// Serializes changes to the symbol directory. The free slots, and the replaced directories and unpublished tables
+	// that may still be used by a reader, are only accessed while holding it.
+	static Platform::Mutex* symbolDirectoryMutex = Platform::createMutex();
+	static std::vector<Uptr> freeSymbolDirectorySlots;
+	static std::vector<JITSymbolDirectory*> retiredSymbolDirectories;
+	static std::vector<const JITSymbolTable*> retiredSymbolTables;
+
+	// Frees the retired directories and tables if there are no readers. The caller must hold symbolDirectoryMutex.
+	static void freeRetiredSymbolTablesIfUnused()
+	{
+		if(numSymbolDirectoryReaders.load() == 0)
+		{
+			for(JITSymbolDirectory* retiredDirectory : retiredSymbolDirectories) { delete retiredDirectory; }
+			for(const JITSymbolTable* retiredTable : retiredSymbolTables) { delete retiredTable; }
+			retiredSymbolDirectories.clear();
+			retiredSymbolTables.clear();
+		}
+	}
+
+	// Publishes a symbol table in the directory, and returns the index of the slot it was published in.
+	static Uptr publishSymbolTable(const JITSymbolTable* table)
+	{
+		Platform::Lock symbolDirectoryLock(symbolDirectoryMutex);
+		JITSymbolDirectory* directory = symbolDirectory.load(std::memory_order_relaxed);
+
+		Uptr slotIndex;
+		if(freeSymbolDirectorySlots.size())
+		{
+			slotIndex = freeSymbolDirectorySlots.back();
+			freeSymbolDirectorySlots.pop_back();
+		}
+		else
+		{
+			slotIndex = directory->numUsedSlots.load(std::memory_order_relaxed);
+			if(slotIndex == directory->numSlots)
+			{
+				// Replace a full directory with a copy that has twice as many slots. Slot indices are preserved, so
+				// units don't need to know which directory their table was published in.
+				JITSymbolDirectory* newDirectory = new JITSymbolDirectory(directory->numSlots * 2);
+				for(Uptr copySlotIndex = 0;copySlotIndex < directory->numSlots;++copySlotIndex)
+				{
+					newDirectory->slots[copySlotIndex].store(directory->slots[copySlotIndex].load(std::memory_order_relaxed),std::memory_order_relaxed);
+				}
+				newDirectory->numUsedSlots.store(slotIndex,std::memory_order_relaxed);
+				symbolDirectory.store(newDirectory);
+				retiredSymbolDirectories.push_back(directory);
+				directory = newDirectory;
+			}
+		}
+
+		directory->slots[slotIndex].store(table,std::memory_order_release);
+		if(slotIndex == directory->numUsedSlots.load(std::memory_order_relaxed))
+		{
+			directory->numUsedSlots.store(slotIndex + 1,std::memory_order_release);
+		}
+		freeRetiredSymbolTablesIfUnused();
+		return slotIndex;
+	}
+
+	// Removes a symbol table from the directory, and deletes it once no reader can be using it.
+	static void unpublishSymbolTable(Uptr slotIndex)
+	{
+		Platform::Lock symbolDirectoryLock(symbolDirectoryMutex);
+		JITSymbolDirectory* directory = symbolDirectory.load(std::memory_order_relaxed);
+		retiredSymbolTables.push_back(directory->slots[slotIndex].exchange(nullptr));
+		freeSymbolDirectorySlots.push_back(slotIndex);
+		freeRetiredSymbolTablesIfUnused();
+	}
+
+	// A shared arena for the code and data of small JIT units, such as invoke thunks. Each unit is allocated a slice of
+	// the current chunk's code, read-only, and read-write regions instead of its own pages, so many small units share
+	// pages. The pages of each chunk are mapped twice: units are written through a read-write mapping, and executed from
+	// a mapping whose access is set once when the chunk is allocated. That way, loading a unit never makes the code of
+	// units that may be running on other threads writable. A chunk is freed once it's no longer the current chunk, and
+	// all the units allocated from it have been freed.
+	struct PooledCodeArena
+	{
+		static const Uptr numChunkCodePages = 64;
+		static const Uptr numChunkReadOnlyPages = 16;
+		static const Uptr numChunkReadWritePages = 16;
+		static const Uptr numChunkPages = numChunkCodePages + numChunkReadOnlyPages + numChunkReadWritePages;
+
+		// The alignment of each slice, and the largest section alignment that may be allocated from a slice.
+		static const Uptr sliceAlignment = 64;
+
+		struct Chunk
+		{
+			// The base addresses of the chunk's read-write mapping, and the mapping its code is executed from.
+			U8* writableBaseAddress;
+			U8* executableBaseAddress;
+
+			// The number of bytes allocated from each of the chunk's regions.
+			Uptr numCodeBytes;
+			Uptr numReadOnlyBytes;
+			Uptr numReadWriteBytes;
+
+			// The number of images allocated from the chunk that haven't been freed.
+			Uptr numImages;
+
+			// Returns the offset to add to an address in the read-write mapping to get the same address in the
+			// executable mapping.
+			Uptr getExecutableAddressOffset() const
+			{
+				return reinterpret_cast<Uptr>(executableBaseAddress) - reinterpret_cast<Uptr>(writableBaseAddress);
+			}
+		};
+
+		// Allocates slices of the current chunk's regions for an image with the given section sizes, starting a new
+		// chunk if any of the current chunk's regions doesn't have enough space left. Writes the addresses of the
+		// slices in the chunk's read-write mapping to the out parameters, and returns the chunk. Returns null if the
+		// sections are too large to allocate from the arena, or if the platform can't map the same pages twice.
+		static Chunk* allocateImage(Uptr numCodeBytes,Uptr numReadOnlyBytes,Uptr numReadWriteBytes,U8*& outCode,U8*& outReadOnly,U8*& outReadWrite)
+		{
+			if(numCodeBytes > getNumPageBytes(numChunkCodePages) / 4
+			|| numReadOnlyBytes > getNumPageBytes(numChunkReadOnlyPages) / 4
+			|| numReadWriteBytes > getNumPageBytes(numChunkReadWritePages) / 4)
+			{ return nullptr; }
+
+			Platform::Lock lock(mutex);
+			if(isUnsupported) { return nullptr; }
+
+			if(!currentChunk
+			|| currentChunk->numCodeBytes + numCodeBytes > getNumPageBytes(numChunkCodePages)
+			|| currentChunk->numReadOnlyBytes + numReadOnlyBytes > getNumPageBytes(numChunkReadOnlyPages)
+			|| currentChunk->numReadWriteBytes + numReadWriteBytes > getNumPageBytes(numChunkReadWritePages))
+			{
+				Chunk* newChunk = createChunk();
+				if(!newChunk)
+				{
+					isUnsupported = true;
+					return nullptr;
+				}
+				if(currentChunk && !currentChunk->numImages) { destroyChunk(currentChunk); }
+				currentChunk = newChunk;
+			}
+
+			U8* writableBaseAddress = currentChunk->writableBaseAddress;
+			outCode = writableBaseAddress + allocateSlice(currentChunk->numCodeBytes,numCodeBytes);
+			outReadOnly = writableBaseAddress + getNumPageBytes(numChunkCodePages) + allocateSlice(currentChunk->numReadOnlyBytes,numReadOnlyBytes);
+			outReadWrite = writableBaseAddress + getNumPageBytes(numChunkCodePages + numChunkReadOnlyPages) + allocateSlice(currentChunk->numReadWriteBytes,numReadWriteBytes);
+			++currentChunk->numImages;
+			return currentChunk;
+		}
+
+		// Frees an image allocated from a chunk by allocateImage.
+		static void freeImage(Chunk* chunk)
+		{
+			Platform::Lock lock(mutex);
+			assert(chunk->numImages);
+			if(!--chunk->numImages && chunk != currentChunk) { destroyChunk(chunk); }
+		}
+
+	private:
+		static Platform::Mutex* mutex;
+		static Chunk* currentChunk;
+		static bool isUnsupported;
+
+		static Uptr getNumPageBytes(Uptr numPages) { return numPages << Platform::getPageSizeLog2(); }
+
+		// Allocates a slice from a region, and returns its offset from the start of the region.
+		static Uptr allocateSlice(Uptr& numRegionBytes,Uptr numSliceBytes)
+		{
+			const Uptr sliceOffset = numRegionBytes;
+			numRegionBytes += (numSliceBytes + sliceAlignment - 1) & ~(sliceAlignment - 1);
+			return sliceOffset;
+		}
+
+		// Allocates a chunk, and sets the final access of each region of its executable mapping.
+		static Chunk* createChunk()
+		{
+			U8* writableBaseAddress;
+			U8* executableBaseAddress;
+			if(!Platform::allocateDualMappedPages(numChunkPages,writableBaseAddress,executableBaseAddress))
+			{
+				Log::printf(Log::Category::debug,"JIT code pages can't be mapped twice: small JIT units will use their own pages\n");
+				return nullptr;
+			}
+
+			const Platform::MemoryAccess codeAccess = USE_WRITEABLE_JIT_CODE_PAGES ? Platform::MemoryAccess::ReadWriteExecute : Platform::MemoryAccess::Execute;
+			if(!Platform::setVirtualPageAccess(executableBaseAddress,numChunkCodePages,codeAccess)
+			|| !Platform::setVirtualPageAccess(executableBaseAddress + getNumPageBytes(numChunkCodePages),numChunkReadOnlyPages,Platform::MemoryAccess::ReadOnly))
+			{
+				Log::printf(Log::Category::debug,"JIT code pages can't be made executable through a second mapping: small JIT units will use their own pages\n");
+				Platform::freeDualMappedPages(writableBaseAddress,executableBaseAddress,numChunkPages);
+				return nullptr;
+			}
+
+			return new Chunk {writableBaseAddress,executableBaseAddress,0,0,0,0};
+		}
+
+		static void destroyChunk(Chunk* chunk)
+		{
+			Platform::freeDualMappedPages(chunk->writableBaseAddress,chunk->executableBaseAddress,numChunkPages);
+			delete chunk;
+		}
 	};
+	Platform::Mutex* PooledCodeArena::mutex = Platform::createMutex();
+	PooledCodeArena::Chunk* PooledCodeArena::currentChunk = nullptr;
+	bool PooledCodeArena::isUnsupported = false;
+
+	// An arena for the code of JIT units in shared 2MB aligned regions that the OS is advised to back with huge pages,
+	// which reduces instruction TLB misses when running large modules. Changing the access of part of a huge page
+	// splits it into normal pages, so each unit is allocated whole huge pages of its own rather than being packed with
+	// other units: they are writable while the unit is loaded, and only executable once it's finalized. Since that
+	// wastes the rest of a unit's last huge page, only units with at least minAllocationBytes of code use the arena.
+	// The code of unloaded units is returned to a free list, and made writable again when it's reused by a later unit.
+	// Regions are never freed.
+	struct HugePageCodeArena
+	{
+		static const Uptr hugePageBytes = Uptr(2) * 1024 * 1024;
+		static const Uptr numRegionHugePages = 16;
+		static const Uptr regionBytes = hugePageBytes * numRegionHugePages;
+
+		// The smallest code section that is allocated from the arena.
+		static const Uptr minAllocationBytes = hugePageBytes / 2;
+
+		// Returns the number of bytes allocated for a code section of the given size: a whole number of huge pages.
+		static Uptr getAllocationBytes(Uptr numBytes) { return (numBytes + hugePageBytes - 1) & ~(hugePageBytes - 1); }
+
+		// Allocates writable code memory from the arena. Returns nullptr if the allocation is too large for a region, or
+		// if the OS doesn't support huge pages.
+		static U8* allocate(Uptr numBytes)
+		{
+			Platform::Lock lock(mutex);
+			numBytes = getAllocationBytes(numBytes);
+			if(isUnsupported || numBytes > regionBytes) { return nullptr; }
+
+			// Use the first free range that is large enough for the allocation.
+			U8* address = nullptr;
+			for(Uptr rangeIndex = 0;rangeIndex < freeRanges.size();++rangeIndex)
+			{
+				FreeRange& range = freeRanges[rangeIndex];
+				if(range.numBytes >= numBytes)
+				{
+					address = range.address;
+					range.address += numBytes;
+					range.numBytes -= numBytes;
+					if(!range.numBytes) { freeRanges.erase(freeRanges.begin() + rangeIndex); }
+					break;
+				}
+			}
+
+			if(!address)
+			{
+				// Reserve a new region aligned to the huge page size, and commit it.
+				U8* unalignedBaseAddress;
+				Uptr numUnalignedPages;
+				const Uptr numRegionPages = regionBytes >> Platform::getPageSizeLog2();
+				U8* regionBaseAddress = Runtime::allocateVirtualPagesAligned(regionBytes,hugePageBytes,unalignedBaseAddress,numUnalignedPages);
+				if(!regionBaseAddress || !Platform::commitVirtualPages(regionBaseAddress,numRegionPages,Platform::MemoryAccess::ReadWrite))
+				{ Errors::fatal("memory allocation for JIT code failed"); }
+
+				// If the OS won't back the region with huge pages, free it and let the caller use normal pages.
+				if(!Platform::adviseHugePages(regionBaseAddress,numRegionPages))
+				{
+					Log::printf(Log::Category::debug,"Huge pages aren't supported: JIT code will use normal pages\n");
+					Platform::decommitVirtualPages(regionBaseAddress,numRegionPages);
+					Platform::freeVirtualPages(unalignedBaseAddress,numUnalignedPages);
+					isUnsupported = true;
+					return nullptr;
+				}
+
+				regions.push_back({regionBaseAddress,0});
+				address = regionBaseAddress;
+				if(numBytes < regionBytes) { addFreeRange(regionBaseAddress + numBytes,regionBytes - numBytes); }
+			}
+			else
+			{
+				// The range may have been used for a unit's code, which was made executable when it was finalized.
+				if(!Platform::setVirtualPageAccess(address,numBytes >> Platform::getPageSizeLog2(),Platform::MemoryAccess::ReadWrite))
+				{ Errors::fatal("memory allocation for JIT code failed"); }
+			}
+
+			// Track the number of huge pages that have been used by each region.
+			Uptr numUsedHugePages = 0;
+			for(Region& region : regions)
+			{
+				if(address >= region.baseAddress && address < region.baseAddress + regionBytes)
+				{
+					region.numUsedBytes = std::max(region.numUsedBytes,Uptr(address + numBytes - region.baseAddress));
+				}
+				numUsedHugePages += (region.numUsedBytes + hugePageBytes - 1) / hugePageBytes;
+			}
+			if(numUsedHugePages > numLoggedHugePages)
+			{
+				Log::printf(Log::Category::metrics,"JIT code is using %u huge pages\n",(U32)numUsedHugePages);
+				numLoggedHugePages = numUsedHugePages;
+			}
+
+			return address;
+		}
+
+		// Returns code memory allocated by allocate to the arena.
+		static void free(U8* address,Uptr numBytes)
+		{
+			Platform::Lock lock(mutex);
+			addFreeRange(address,getAllocationBytes(numBytes));
+		}
+
+	private:
+		struct FreeRange
+		{
+			U8* address;
+			Uptr numBytes;
+		};
+
+		struct Region
+		{
+			U8* baseAddress;
+			Uptr numUsedBytes;
+		};
+
+		static Platform::Mutex* mutex;
+		static std::vector<FreeRange> freeRanges;
+		static std::vector<Region> regions;
+		static Uptr numLoggedHugePages;
+		static bool isUnsupported;
+
+		// Adds a range to the free list, which is sorted by address, and merges it with any adjacent free ranges.
+		static void addFreeRange(U8* address,Uptr numBytes)
+		{
+			auto nextIt = std::lower_bound(freeRanges.begin(),freeRanges.end(),address,
+				[](const FreeRange& range,U8* rangeAddress) { return range.address < rangeAddress; });
+			if(nextIt != freeRanges.begin() && (nextIt - 1)->address + (nextIt - 1)->numBytes == address)
+			{
+				auto previousIt = nextIt - 1;
+				previousIt->numBytes += numBytes;
+				if(nextIt != freeRanges.end() && previousIt->address + previousIt->numBytes == nextIt->address)
+				{
+					previousIt->numBytes += nextIt->numBytes;
+					freeRanges.erase(nextIt);
+				}
+			}
+			else if(nextIt != freeRanges.end() && address + numBytes == nextIt->address)
+			{
+				nextIt->address = address;
+				nextIt->numBytes += numBytes;
+			}
+			else { freeRanges.insert(nextIt,{address,numBytes}); }
+		}
+	};
+	Platform::Mutex* HugePageCodeArena::mutex = Platform::createMutex();
+	std::vector<HugePageCodeArena::FreeRange> HugePageCodeArena::freeRanges;
+	std::vector<HugePageCodeArena::Region> HugePageCodeArena::regions;
+	Uptr HugePageCodeArena::numLoggedHugePages = 0;
+	bool HugePageCodeArena::isUnsupported = false;
 
 	// Allocates memory for the LLVM object loader.
+	// The loader reserves space separately for each object it loads, so each object is given its own image. If the unit
+	// uses pooled memory, small images are allocated from the PooledCodeArena instead of their own pages: they are written
+	// through the arena's read-write mapping, and their sections are then relocated to its executable mapping. Otherwise,
+	// if huge page code is enabled, the code section of each image is allocated from the HugePageCodeArena.
 	struct UnitMemoryManager : llvm::RTDyldMemoryManager
 	{
-		UnitMemoryManager()
-		: imageBaseAddress(nullptr)
-		, isFinalized(false)
-		, codeSection({0})
-		, readOnlySection({0})
-		, readWriteSection({0})
-		, hasRegisteredEHFrames(false)
-		{}
+		UnitMemoryManager(bool inUsePooledMemory = false): usePooledMemory(inUsePooledMemory), isFinalized(false) {}
 		virtual ~UnitMemoryManager() override
 		{
 			// Deregister the exception handling frame info.
-			if(hasRegisteredEHFrames)
+			for(const EHFrames& ehFrames : registeredEHFrames)
 			{
-				hasRegisteredEHFrames = false;
-				deregisterEHFrames(ehFramesAddr,ehFramesLoadAddr,ehFramesNumBytes);
+				deregisterEHFrames(ehFrames.address,ehFrames.loadAddress,ehFrames.numBytes);
 			}
+			registeredEHFrames.clear();
 
 			// Decommit the image pages, but leave them reserved to catch any references to them that might erroneously remain.
-			Platform::decommitVirtualPages(imageBaseAddress,numAllocatedImagePages);
+			// Pooled images share pages with other units, so they are returned to the arena, which frees their chunk once
+			// none of its images are used.
+			for(const Image& image : images)
+			{
+				if(image.pooledChunk) { PooledCodeArena::freeImage(image.pooledChunk); }
+				else if(image.numPages) { Platform::decommitVirtualPages(image.baseAddress,image.numPages); }
+			}
+
+			// Return any code allocated from the huge page arena, which stays committed so its huge pages can be reused.
+			for(const Image& image : images)
+			{
+				if(image.isCodeInHugePages) { HugePageCodeArena::free(image.codeSection.baseAddress,image.codeSection.numReservedBytes); }
+			}
 		}
 		
 		void registerEHFrames(U8* addr, U64 loadAddr,uintptr_t numBytes) override
 		{
-			llvm::RTDyldMemoryManager::registerEHFrames(addr,loadAddr,numBytes);
-			hasRegisteredEHFrames = true;
-			ehFramesAddr = addr;
-			ehFramesLoadAddr = loadAddr;
-			ehFramesNumBytes = numBytes;
+			// Register the frames at the address they were relocated for, rather than the address they were written at,
+			// which is different for pooled images.
+			U8* loadedAddress = reinterpret_cast<U8*>(Uptr(loadAddr));
+			llvm::RTDyldMemoryManager::registerEHFrames(loadedAddress,loadAddr,numBytes);
+			registeredEHFrames.push_back({loadedAddress,loadAddr,Uptr(numBytes)});
 		}
 		void deregisterEHFrames(U8* addr, U64 loadAddr,uintptr_t numBytes) override
 		{
@@ -123,68 +593,151 @@ namespace LLVMJIT
 		virtual bool needsToReserveAllocationSpace() override { return true; }
 		virtual void reserveAllocationSpace(uintptr_t numCodeBytes,U32 codeAlignment,uintptr_t numReadOnlyBytes,U32 readOnlyAlignment,uintptr_t numReadWriteBytes,U32 readWriteAlignment) override
 		{
-			// Calculate the number of pages to be used by each section.
-			codeSection.numPages = shrAndRoundUp(numCodeBytes,Platform::getPageSizeLog2());
-			readOnlySection.numPages = shrAndRoundUp(numReadOnlyBytes,Platform::getPageSizeLog2());
-			readWriteSection.numPages = shrAndRoundUp(numReadWriteBytes,Platform::getPageSizeLog2());
-			numAllocatedImagePages = codeSection.numPages + readOnlySection.numPages + readWriteSection.numPages;
-			if(numAllocatedImagePages)
+			assert(!isFinalized);
+			Image image = {};
+
+			// Allocate small images from the pooled arena if the unit uses it.
+			U8* pooledCodeAddress;
+			U8* pooledReadOnlyAddress;
+			U8* pooledReadWriteAddress;
+			if(usePooledMemory
+			&& codeAlignment <= PooledCodeArena::sliceAlignment
+			&& readOnlyAlignment <= PooledCodeArena::sliceAlignment
+			&& readWriteAlignment <= PooledCodeArena::sliceAlignment
+			&& (image.pooledChunk = PooledCodeArena::allocateImage(
+				getPooledSectionBytes(numCodeBytes),
+				getPooledSectionBytes(numReadOnlyBytes),
+				getPooledSectionBytes(numReadWriteBytes),
+				pooledCodeAddress,pooledReadOnlyAddress,pooledReadWriteAddress)))
+			{
+				// The slices are written through the chunk's read-write mapping, which is never executable, so unlike
+				// other images, their access doesn't need to be changed while they are loaded.
+				image.codeSection = {pooledCodeAddress,getPooledSectionBytes(numCodeBytes),0};
+				image.readOnlySection = {pooledReadOnlyAddress,getPooledSectionBytes(numReadOnlyBytes),0};
+				image.readWriteSection = {pooledReadWriteAddress,getPooledSectionBytes(numReadWriteBytes),0};
+				image.baseAddress = image.codeSection.baseAddress + image.pooledChunk->getExecutableAddressOffset();
+			}
+			else
 			{
-				// Reserve enough contiguous pages for all sections.
-				imageBaseAddress = Platform::allocateVirtualPages(numAllocatedImagePages);
-				if(!imageBaseAddress || !Platform::commitVirtualPages(imageBaseAddress,numAllocatedImagePages)) { Errors::fatal("memory allocation for JIT code failed"); }
-				codeSection.baseAddress = imageBaseAddress;
-				readOnlySection.baseAddress = codeSection.baseAddress + (codeSection.numPages << Platform::getPageSizeLog2());
-				readWriteSection.baseAddress = readOnlySection.baseAddress + (readOnlySection.numPages << Platform::getPageSizeLog2());
+				// Allocate large code sections from the huge page arena if enabled, and the data sections from the image's pages.
+				if(isHugePageCodeEnabled
+				&& numCodeBytes >= HugePageCodeArena::minAllocationBytes
+				&& codeAlignment <= HugePageCodeArena::hugePageBytes)
+				{
+					const Uptr numReservedCodeBytes = HugePageCodeArena::getAllocationBytes(Uptr(numCodeBytes) + codeAlignment);
+					U8* codeBaseAddress = HugePageCodeArena::allocate(numReservedCodeBytes);
+					if(codeBaseAddress)
+					{
+						image.isCodeInHugePages = true;
+						image.codeSection = {codeBaseAddress,numReservedCodeBytes,0};
+					}
+				}
+
+				// Calculate the number of pages to be used by each section.
+				const Uptr numCodePages = image.isCodeInHugePages ? 0 : shrAndRoundUp(numCodeBytes,Platform::getPageSizeLog2());
+				const Uptr numReadOnlyPages = shrAndRoundUp(numReadOnlyBytes,Platform::getPageSizeLog2());
+				const Uptr numReadWritePages = shrAndRoundUp(numReadWriteBytes,Platform::getPageSizeLog2());
+				image.numPages = numCodePages + numReadOnlyPages + numReadWritePages;
+				if(image.numPages)
+				{
+					// Reserve enough contiguous pages for all sections.
+					image.baseAddress = Platform::allocateVirtualPages(image.numPages);
+					if(!image.baseAddress || !Platform::commitVirtualPages(image.baseAddress,image.numPages)) { Errors::fatal("memory allocation for JIT code failed"); }
+					if(!image.isCodeInHugePages) { image.codeSection = {image.baseAddress,numCodePages << Platform::getPageSizeLog2(),0}; }
+					image.readOnlySection = {image.baseAddress + (numCodePages << Platform::getPageSizeLog2()),numReadOnlyPages << Platform::getPageSizeLog2(),0};
+					image.readWriteSection = {image.readOnlySection.baseAddress + image.readOnlySection.numReservedBytes,numReadWritePages << Platform::getPageSizeLog2(),0};
+				}
 			}
+			images.push_back(image);
 		}
 		virtual U8* allocateCodeSection(uintptr_t numBytes,U32 alignment,U32 sectionID,llvm::StringRef sectionName) override
 		{
-			return allocateBytes((Uptr)numBytes,alignment,codeSection);
+			assert(images.size());
+			return allocateBytes((Uptr)numBytes,alignment,images.back().codeSection);
 		}
 		virtual U8* allocateDataSection(uintptr_t numBytes,U32 alignment,U32 sectionID,llvm::StringRef SectionName,bool isReadOnly) override
 		{
-			return allocateBytes((Uptr)numBytes,alignment,isReadOnly ? readOnlySection : readWriteSection);
+			assert(images.size());
+			return allocateBytes((Uptr)numBytes,alignment,isReadOnly ? images.back().readOnlySection : images.back().readWriteSection);
 		}
 		virtual bool finalizeMemory(std::string* ErrMsg = nullptr) override
 		{
 			assert(!isFinalized);
 			isFinalized = true;
 			// Set the requested final memory access for each section's pages.
+			// The executable mapping of pooled images already has its final access. Code in huge pages is allocated
+			// whole huge pages, so changing its access doesn't split them.
 			const Platform::MemoryAccess codeAccess = USE_WRITEABLE_JIT_CODE_PAGES ? Platform::MemoryAccess::ReadWriteExecute : Platform::MemoryAccess::Execute;
-			if(codeSection.numPages && !Platform::setVirtualPageAccess(codeSection.baseAddress,codeSection.numPages,codeAccess)) { return false; }
-			if(readOnlySection.numPages && !Platform::setVirtualPageAccess(readOnlySection.baseAddress,readOnlySection.numPages,Platform::MemoryAccess::ReadOnly)) { return false; }
-			if(readWriteSection.numPages && !Platform::setVirtualPageAccess(readWriteSection.baseAddress,readWriteSection.numPages,Platform::MemoryAccess::ReadWrite)) { return false; }
+			for(const Image& image : images)
+			{
+				if(image.pooledChunk) { continue; }
+				if(!setSectionAccess(image.codeSection,codeAccess)) { return false; }
+				if(!setSectionAccess(image.readOnlySection,Platform::MemoryAccess::ReadOnly)) { return false; }
+				if(!setSectionAccess(image.readWriteSection,Platform::MemoryAccess::ReadWrite)) { return false; }
+			}
 			return true;
 		}
 		virtual void invalidateInstructionCache()
 		{
-			// Invalidate the instruction cache for the whole image.
-			llvm::sys::Memory::InvalidateInstructionCache(imageBaseAddress,numAllocatedImagePages << Platform::getPageSizeLog2());
+			// Invalidate the instruction cache for all the images' code.
+			for(const Image& image : images)
+			{
+				if(image.codeSection.numReservedBytes)
+				{
+					llvm::sys::Memory::InvalidateInstructionCache(
+						image.codeSection.baseAddress + getExecutableAddressOffset(image),
+						image.codeSection.numReservedBytes);
+				}
+			}
 		}
 
-		U8* getImageBaseAddress() const { return imageBaseAddress; }
+		// Returns the base address that the image for the object with the given index (in load order) is executed at.
+		U8* getImageBaseAddress(Uptr objectIndex) const
+		{
+			assert(objectIndex < images.size());
+			return images[objectIndex].baseAddress;
+		}
+
+		// Returns the offset to add to the addresses that the object with the given index was written at to get the
+		// addresses it's executed at. It's only non-zero for pooled images.
+		Uptr getImageExecutableAddressOffset(Uptr objectIndex) const
+		{
+			assert(objectIndex < images.size());
+			return getExecutableAddressOffset(images[objectIndex]);
+		}
 
 	private:
 		struct Section
 		{
 			U8* baseAddress;
-			Uptr numPages;
+			Uptr numReservedBytes;
 			Uptr numCommittedBytes;
 		};
+
+		struct Image
+		{
+			U8* baseAddress;
+			Uptr numPages;
+			PooledCodeArena::Chunk* pooledChunk;
+			bool isCodeInHugePages;
+
+			Section codeSection;
+			Section readOnlySection;
+			Section readWriteSection;
+		};
 		
-		U8* imageBaseAddress;
-		Uptr numAllocatedImagePages;
+		struct EHFrames
+		{
+			U8* address;
+			U64 loadAddress;
+			Uptr numBytes;
+		};
+		
+		const bool usePooledMemory;
+		std::vector<Image> images;
 		bool isFinalized;
 
-		Section codeSection;
-		Section readOnlySection;
-		Section readWriteSection;
-
-		bool hasRegisteredEHFrames;
-		U8* ehFramesAddr;
-		U64 ehFramesLoadAddr;
-		Uptr ehFramesNumBytes;
+		std::vector<EHFrames> registeredEHFrames;
 
 		U8* allocateBytes(Uptr numBytes,Uptr alignment,Section& section)
 		{
@@ -198,11 +751,32 @@ namespace LLVMJIT
 			section.numCommittedBytes = align(section.numCommittedBytes,alignment) + align(numBytes,alignment);
 
 			// Check that enough space was reserved in the section.
-			if(section.numCommittedBytes > (section.numPages << Platform::getPageSizeLog2())) { Errors::fatal("didn't reserve enough space in section"); }
+			if(section.numCommittedBytes > section.numReservedBytes) { Errors::fatal("didn't reserve enough space in section"); }
 
 			return allocationBaseAddress;
 		}
+
+		// Sets the access of all the pages that contain part of a section.
+		static bool setSectionAccess(const Section& section,Platform::MemoryAccess access)
+		{
+			if(!section.numReservedBytes) { return true; }
+			const Uptr pageMask = (Uptr(1) << Platform::getPageSizeLog2()) - 1;
+			const Uptr beginAddress = reinterpret_cast<Uptr>(section.baseAddress) & ~pageMask;
+			const Uptr endAddress = reinterpret_cast<Uptr>(section.baseAddress) + section.numReservedBytes;
+			return Platform::setVirtualPageAccess(
+				reinterpret_cast<U8*>(beginAddress),
+				shrAndRoundUp(endAddress - beginAddress,Platform::getPageSizeLog2()),
+				access);
+		}
 		
+		static Uptr getExecutableAddressOffset(const Image& image)
+		{
+			return image.pooledChunk ? image.pooledChunk->getExecutableAddressOffset() : 0;
+		}
+
+		// Returns the number of bytes to reserve in the pooled arena for a section, including padding for alignment.
+		static Uptr getPooledSectionBytes(Uptr numBytes) { return numBytes ? numBytes + PooledCodeArena::sliceAlignment : 0; }
+
 		static Uptr align(Uptr size,Uptr alignment) { return (size + alignment - 1) & ~(alignment - 1); }
 		static Uptr shrAndRoundUp(Uptr value,Uptr shift) { return (value + (Uptr(1)<<shift) - 1) >> shift; }
 
@@ -214,27 +788,36 @@ namespace LLVMJIT
 	// Encapsulates the LLVM JIT compilation pipeline but allows subclasses to define how the resulting code is used.
 	struct JITUnit
 	{
-		JITUnit(bool inShouldLogMetrics = true)
-		: shouldLogMetrics(inShouldLogMetrics)
-		#ifdef _WIN32
-			, pdataCopy(nullptr)
-		#endif
+		JITUnit(bool usePooledMemory = false): memoryManager(usePooledMemory), symbolDirectorySlot(UINTPTR_MAX)
 		{
 			objectLayer = llvm::make_unique<ObjectLayer>(NotifyLoadedFunctor(this),NotifyFinalizedFunctor(this));
 			objectLayer->setProcessAllSections(true);
-			compileLayer = llvm::make_unique<CompileLayer>(*objectLayer,llvm::orc::SimpleCompiler(*targetMachine));
 		}
 		~JITUnit()
 		{
-			compileLayer->removeModuleSet(handle);
+			// Remove the unit's symbols from the symbol directory before its code is freed.
+			if(symbolDirectorySlot != UINTPTR_MAX) { unpublishSymbolTable(symbolDirectorySlot); }
+			for(JITSymbol* symbol : loadedSymbols) { delete symbol; }
+
+			// Deregister the objects from the GDB JIT interface before the object layer frees them.
+			for(llvm::object::ObjectFile* object : gdbRegisteredObjects)
+			{
+				llvm::JITEventListener::createGDBRegistrationListener()->NotifyFreeingObject(*object);
+			}
+
+			objectLayer->removeObjectSet(handle);
 			#ifdef _WIN64
-				if(pdataCopy) { Platform::deregisterSEHUnwindInfo(reinterpret_cast<Uptr>(pdataCopy)); }
+				for(U8* pdataCopy : pdataCopies) { Platform::deregisterSEHUnwindInfo(reinterpret_cast<Uptr>(pdataCopy)); }
 			#endif
 		}
 
-		void compile(llvm::Module* llvmModule);
+		// Loads a set of objects into memory, using the resolver to bind the symbols they import.
+		// Symbols defined by one of the objects may be referenced by the others.
+		void load(const std::vector<std::vector<U8>>& objectBytesSet,llvm::JITSymbolResolver* resolver);
 
-		virtual void notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,std::map<U32,U32>&& offsetToOpIndexMap) = 0;
+		// Called for each function symbol in the loaded objects. Returns a JITSymbol that describes the code, which is
+		// owned by the unit, or null if the symbol doesn't need to be described.
+		virtual JITSymbol* notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,llvm::DWARFContext* dwarfContext) = 0;
 
 	private:
 		
@@ -245,7 +828,7 @@ namespace LLVMJIT
 			NotifyLoadedFunctor(JITUnit* inJITUnit): jitUnit(inJITUnit) {}
 			void operator()(
 				const llvm::orc::ObjectLinkingLayerBase::ObjSetHandleT& objectSetHandle,
-				const std::vector<std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>>& objectSet,
+				const std::vector<llvm::object::ObjectFile*>& objectSet,
 				const std::vector<std::unique_ptr<llvm::RuntimeDyld::LoadedObjectInfo>>& loadedObjects
 				);
 		};
@@ -258,13 +841,10 @@ namespace LLVMJIT
 			void operator()(const llvm::orc::ObjectLinkingLayerBase::ObjSetHandleT& objectSetHandle);
 		};
 		typedef llvm::orc::ObjectLinkingLayer<NotifyLoadedFunctor> ObjectLayer;
-		typedef llvm::orc::IRCompileLayer<ObjectLayer> CompileLayer;
 
 		UnitMemoryManager memoryManager;
 		std::unique_ptr<ObjectLayer> objectLayer;
-		std::unique_ptr<CompileLayer> compileLayer;
-		CompileLayer::ModuleSetHandleT handle;
-		bool shouldLogMetrics;
+		ObjectLayer::ObjSetHandleT handle;
 
 		struct LoadedObject
 		{
@@ -274,51 +854,128 @@ namespace LLVMJIT
 
 		std::vector<LoadedObject> loadedObjects;
 
+		// The objects passed to the object layer.
+		std::vector<std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>> objects;
+
+		// The DWARF contexts for the loaded objects that have line tables.
+		std::vector<std::unique_ptr<llvm::DWARFContext>> dwarfContexts;
+
+		// The symbols that describe the unit's code, which are published in the symbol directory once all of the unit's
+		// objects have been loaded, and the slot they were published in.
+		std::vector<JITSymbol*> loadedSymbols;
+		Uptr symbolDirectorySlot;
+
+		// The loaded objects that were registered with the GDB JIT interface.
+		std::vector<llvm::object::ObjectFile*> gdbRegisteredObjects;
+
 		#ifdef _WIN32
-			U8* pdataCopy;
+			std::vector<U8*> pdataCopies;
 		#endif
 	};
 
-	// The JIT compilation unit for a WebAssembly module instance.
+	// The JIT compilation unit for a WebAssembly module. The loaded code may be shared by any number of instances of the module.
 	struct JITModule : JITUnit, JITModuleBase
 	{
-		ModuleInstance* moduleInstance;
-
-		std::vector<JITSymbol*> functionDefSymbols;
-
-		JITModule(ModuleInstance* inModuleInstance): moduleInstance(inModuleInstance) {}
-		~JITModule() override
+		// The tier of the code for the module's function bodies, whether they are compiled on their first call, the
+		// optimization level used for optimized code, and the debug info generated for all code.
+		const CodeTier tier;
+		const bool isLazy;
+		const llvm::CodeGenOpt::Level optimizedOptLevel;
+		const CompileOptions::DebugInfoLevel debugInfoLevel;
+		std::vector<std::string> functionDefDebugNames;
+
+		// The counters decremented by baseline code, and whether optimized code has been requested for each function.
+		// Baseline code calls functions through functionDefNativeFunctions, which is updated with the optimized code.
+		// isTierUpRequested is only accessed while tierUpRequestMutex is locked.
+		std::vector<U32> functionDefTierUpCounters;
+		std::vector<bool> isTierUpRequested;
+
+		// If the module is lazily compiled, the stub for each function that was loaded with the module, and whether each
+		// function's body has been compiled. Function bodies are compiled while holding lazyCompileMutex, and
+		// isFunctionDefCompiled is only accessed while it is locked.
+		std::vector<void*> functionDefLazyStubs;
+		std::vector<bool> isFunctionDefCompiled;
+		Platform::Mutex* lazyCompileMutex;
+
+		// The units for code compiled for individual functions after the module was loaded. Only accessed while
+		// functionUnitsMutex is locked.
+		std::vector<struct JITFunctionUnit*> functionUnits;
+		Platform::Mutex* functionUnitsMutex;
+
+		JITModule(CodeTier inTier,bool inIsLazy,llvm::CodeGenOpt::Level inOptimizedOptLevel,CompileOptions::DebugInfoLevel inDebugInfoLevel,const std::vector<std::string>& inFunctionDefDebugNames)
+		: JITModuleBase(inFunctionDefDebugNames.size())
+		, tier(inTier)
+		, isLazy(inIsLazy)
+		, optimizedOptLevel(inOptimizedOptLevel)
+		, debugInfoLevel(inDebugInfoLevel)
+		, functionDefDebugNames(inFunctionDefDebugNames)
+		, lazyCompileMutex(Platform::createMutex())
+		, functionUnitsMutex(Platform::createMutex())
 		{
-			// Delete the module's symbols, and remove them from the global address-to-symbol map.
-			Platform::Lock addressToSymbolMapLock(addressToSymbolMapMutex);
-			for(auto symbol : functionDefSymbols)
+			if(tier == CodeTier::baseline)
 			{
-				addressToSymbolMap.erase(addressToSymbolMap.find(symbol->baseAddress + symbol->numBytes));
-				delete symbol;
+				functionDefTierUpCounters.resize(functionDefDebugNames.size(),std::max(U32(1),tierUpThreshold.load()));
+				isTierUpRequested.resize(functionDefDebugNames.size(),false);
 			}
+			if(isLazy)
+			{
+				functionDefLazyStubs.resize(functionDefDebugNames.size(),nullptr);
+				isFunctionDefCompiled.resize(functionDefDebugNames.size(),false);
+			}
+		}
+		~JITModule() override;
+
+		llvm::CodeGenOpt::Level getOptLevel(CodeTier codeTier) const
+		{
+			return codeTier == CodeTier::optimized ? optimizedOptLevel : llvm::CodeGenOpt::None;
 		}
 
-		void notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,std::map<U32,U32>&& offsetToOpIndexMap) override
+		JITSymbol* notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,llvm::DWARFContext* dwarfContext) override
 		{
-			// Save the address range this function was loaded at for future address->symbol lookups.
 			Uptr functionDefIndex;
-			if(getFunctionIndexFromExternalName(name,functionDefIndex))
-			{
-				assert(moduleInstance);
-				assert(functionDefIndex < moduleInstance->functionDefs.size());
-				FunctionInstance* functionInstance = moduleInstance->functionDefs[functionDefIndex];
-				auto symbol = new JITSymbol(functionInstance,baseAddress,numBytes,std::move(offsetToOpIndexMap));
-				functionDefSymbols.push_back(symbol);
-				functionInstance->nativeFunction = reinterpret_cast<void*>(baseAddress);
+			if(!getFunctionIndexFromExternalName(name,functionDefIndex)) { return nullptr; }
+			if(isLazy) { functionDefLazyStubs[functionDefIndex] = reinterpret_cast<void*>(baseAddress); }
+			return addFunctionDefCode(functionDefIndex,baseAddress,numBytes,dwarfContext);
+		}
 
-				{
-					Platform::Lock addressToSymbolMapLock(addressToSymbolMapMutex);
-					addressToSymbolMap[baseAddress + numBytes] = symbol;
-				}
-			}
+		// Makes the code a function was loaded at the code called for the function, and returns a symbol that describes
+		// it. The symbol is visible to lookups once the loading unit's symbol table is published.
+		JITSymbol* addFunctionDefCode(Uptr functionDefIndex,Uptr baseAddress,Uptr numBytes,llvm::DWARFContext* dwarfContext)
+		{
+			assert(functionDefIndex < functionDefNativeFunctions.size());
+			functionDefNativeFunctions[functionDefIndex].store(reinterpret_cast<void*>(baseAddress),std::memory_order_release);
+			return new JITSymbol(functionDefDebugNames[functionDefIndex].c_str(),baseAddress,numBytes,dwarfContext);
 		}
 	};
 
+	// The JIT compilation unit for the code of a single function in a module: a lazily compiled function, or the
+	// optimized code for a hot function in a module compiled with baseline code.
+	struct JITFunctionUnit : JITUnit
+	{
+		JITModule* jitModule;
+		const Uptr functionDefIndex;
+
+		JITFunctionUnit(JITModule* inJITModule,Uptr inFunctionDefIndex)
+		: jitModule(inJITModule), functionDefIndex(inFunctionDefIndex) {}
+
+		JITSymbol* notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,llvm::DWARFContext* dwarfContext) override
+		{
+			// The symbol is loaded after the code is finalized, so it's safe to replace the function's code with it.
+			Uptr loadedFunctionDefIndex;
+			if(!getFunctionIndexFromExternalName(name,loadedFunctionDefIndex)) { return nullptr; }
+			assert(loadedFunctionDefIndex == functionDefIndex);
+			return jitModule->addFunctionDefCode(functionDefIndex,baseAddress,numBytes,dwarfContext);
+		}
+	};
+
+	JITModule::~JITModule()
+	{
+		// Each unit removes its symbols from the symbol directory when it's freed.
+		for(auto functionUnit : functionUnits) { delete functionUnit; }
+		Platform::destroyMutex(functionUnitsMutex);
+		Platform::destroyMutex(lazyCompileMutex);
+	}
+
 	// The JIT compilation unit for a single invoke thunk.
 	struct JITInvokeThunkUnit : JITUnit
 	{
@@ -326,16 +983,18 @@ namespace LLVMJIT
 
 		JITSymbol* symbol;
 
-		JITInvokeThunkUnit(const FunctionType* inFunctionType): JITUnit(false), functionType(inFunctionType), symbol(nullptr) {}
+		// Invoke thunks are small and never unloaded, so they are loaded into the pooled code arena.
+		JITInvokeThunkUnit(const FunctionType* inFunctionType): JITUnit(true), functionType(inFunctionType), symbol(nullptr) {}
 
-		void notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,std::map<U32,U32>&& offsetToOpIndexMap) override
+		JITSymbol* notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,llvm::DWARFContext* dwarfContext) override
 		{
 			#if defined(_WIN32) && !defined(_WIN64)
 				assert(!strcmp(name,"_invokeThunk"));
 			#else
 				assert(!strcmp(name,"invokeThunk"));
 			#endif
-			symbol = new JITSymbol(functionType,baseAddress,numBytes,std::move(offsetToOpIndexMap));
+			symbol = new JITSymbol(functionType,baseAddress,numBytes,dwarfContext);
+			return symbol;
 		}
 	};
 	
@@ -368,6 +1027,20 @@ namespace LLVMJIT
 		{"__aeabi_unwind_cpp_pr0","__aeabi_unwind_cpp_pr0"},
 		{"__aeabi_unwind_cpp_pr1","__aeabi_unwind_cpp_pr1"},
 		#endif
+
+		// The LLVM code generator calls the C library's rounding functions for the floor, ceil, trunc, and nearbyint
+		// intrinsics on targets without rounding instructions, such as ARM32 and x86 without SSE4.1.
+		#if defined(_WIN32) && !defined(_WIN64)
+			{"_floor","floor"},{"_floorf","floorf"},
+			{"_ceil","ceil"},{"_ceilf","ceilf"},
+			{"_trunc","trunc"},{"_truncf","truncf"},
+			{"_nearbyint","nearbyint"},{"_nearbyintf","nearbyintf"},
+		#else
+			{"floor","floor"},{"floorf","floorf"},
+			{"ceil","ceil"},{"ceilf","ceilf"},
+			{"trunc","trunc"},{"truncf","truncf"},
+			{"nearbyint","nearbyint"},{"nearbyintf","nearbyintf"},
+		#endif
 	};
 
 	NullResolver NullResolver::singleton;
@@ -387,21 +1060,99 @@ namespace LLVMJIT
 	}
 	llvm::JITSymbol NullResolver::findSymbolInLogicalDylib(const std::string& name) { return llvm::JITSymbol(nullptr); }
 
+	// Binds the symbols imported by a module's object code to the module's function types and the WAVM intrinsics.
+	// Instance-specific objects are accessed through the InstanceContext passed to the compiled code, so the object
+	// code doesn't import any symbols that depend on the instance.
+	struct ModuleResolver : NullResolver
+	{
+		const IR::Module& module;
+		JITModule* jitModule;
+
+		ModuleResolver(const IR::Module& inModule,JITModule* inJITModule): module(inModule), jitModule(inJITModule) {}
+
+		virtual llvm::JITSymbol findSymbol(const std::string& name) override;
+	};
+	
+	// If name is prefix followed by a decimal number, writes the number to outIndex and returns true.
+	static bool getSymbolIndex(const char* name,const char* prefix,Uptr& outIndex)
+	{
+		const Uptr numPrefixChars = strlen(prefix);
+		if(strncmp(name,prefix,numPrefixChars) || !isdigit(name[numPrefixChars])) { return false; }
+		char* numberEnd = nullptr;
+		const U64 index64 = std::strtoull(name + numPrefixChars,&numberEnd,10);
+		if(*numberEnd || index64 > UINTPTR_MAX) { return false; }
+		outIndex = Uptr(index64);
+		return true;
+	}
+
+	llvm::JITSymbol ModuleResolver::findSymbol(const std::string& mangledName)
+	{
+		#if defined(_WIN32) && !defined(_WIN64)
+			// Symbols have an underscore prefix on 32-bit Windows.
+			if(!mangledName.size() || mangledName[0] != '_') { return NullResolver::findSymbol(mangledName); }
+			const char* name = mangledName.c_str() + 1;
+		#else
+			const char* name = mangledName.c_str();
+		#endif
+
+		Uptr index;
+		const void* address = nullptr;
+		if(getSymbolIndex(name,"type",index))
+		{
+			// The address of a type symbol is the type's canonical ID, rather than a pointer.
+			if(index < module.types.size()) { address = reinterpret_cast<const void*>(Uptr(getFunctionTypeID(module.types[index]))); }
+		}
+		else if(!strcmp(name,"functionDefSlots"))
+		{
+			// Generated code loads the slots as pointers.
+			static_assert(sizeof(std::atomic<void*>) == sizeof(void*),"std::atomic<void*> must have the same layout as void*");
+			address = jitModule->functionDefNativeFunctions.data();
+		}
+		else if(!strcmp(name,"functionDefTierUpCounters")) { address = jitModule->functionDefTierUpCounters.data(); }
+		else if(!strcmp(name,"instanceContexts")) { address = getInstanceContexts(); }
+		else if(FunctionInstance* intrinsicFunction = Intrinsics::findFunctionByDecoratedName(name))
+		{
+			address = intrinsicFunction->nativeFunction.load(std::memory_order_acquire);
+		}
+		else { return NullResolver::findSymbol(mangledName); }
+
+		if(!address) { Errors::fatalf("couldn't bind symbol imported by module object code: %s\n",name); }
+		return llvm::JITSymbol(reinterpret_cast<Uptr>(address),llvm::JITSymbolFlags::None);
+	}
+
 	void JITUnit::NotifyLoadedFunctor::operator()(
 		const llvm::orc::ObjectLinkingLayerBase::ObjSetHandleT& objectSetHandle,
-		const std::vector<std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>>& objectSet,
+		const std::vector<llvm::object::ObjectFile*>& objectSet,
 		const std::vector<std::unique_ptr<llvm::RuntimeDyld::LoadedObjectInfo>>& loadedObjects
 		)
 	{
 		assert(objectSet.size() == loadedObjects.size());
 		for(Uptr objectIndex = 0;objectIndex < loadedObjects.size();++objectIndex)
 		{
-			llvm::object::ObjectFile* object = objectSet[objectIndex].get()->getBinary();
+			llvm::object::ObjectFile* object = objectSet[objectIndex];
 			llvm::RuntimeDyld::LoadedObjectInfo* loadedObject = loadedObjects[objectIndex].get();
 			
 			// Make a copy of the loaded object info for use by the finalizer.
 			jitUnit->loadedObjects.push_back({object,loadedObject});
 
+			// Pooled images are written through the pooled code arena's read-write mapping, but executed from its
+			// executable mapping, so relocate their sections for the executable mapping before relocations are applied.
+			const Uptr executableAddressOffset = jitUnit->memoryManager.getImageExecutableAddressOffset(objectIndex);
+			if(executableAddressOffset)
+			{
+				for(auto section : object->sections())
+				{
+					const Uptr writableAddress = Uptr(loadedObject->getSectionLoadAddress(section));
+					if(writableAddress)
+					{
+						jitUnit->objectLayer->mapSectionAddress(
+							objectSetHandle,
+							reinterpret_cast<const void*>(writableAddress),
+							writableAddress + executableAddressOffset);
+					}
+				}
+			}
+
 			#ifdef _WIN64
 				// On Windows, look for .pdata and .xdata sections containing information about how to unwind the stack.
 				// This needs to be done before the below emitAndFinalize call, which will incorrectly apply relocations to the unwind info.
@@ -420,14 +1171,15 @@ namespace LLVMJIT
 				// Pass the pdata section to the platform to register unwind info.
 				if(pdataSection.getObject())
 				{
-					const Uptr imageBaseAddress = reinterpret_cast<Uptr>(jitUnit->memoryManager.getImageBaseAddress());
+					const Uptr imageBaseAddress = reinterpret_cast<Uptr>(jitUnit->memoryManager.getImageBaseAddress(objectIndex));
 					const Uptr pdataSectionLoadAddress = (Uptr)loadedObject->getSectionLoadAddress(pdataSection);
 					
 					// The LLVM COFF dynamic loader doesn't handle the image-relative relocations used by the pdata section,
 					// and overwrites those values with o: https://github.com/llvm-mirror/llvm/blob/e84d8c12d5157a926db15976389f703809c49aa5/lib/ExecutionEngine/RuntimeDyld/Targets/RuntimeDyldCOFFX86_64.h#L96
 					// This works around that by making a copy of the pdata section and doing the pdata relocations manually.
-					jitUnit->pdataCopy = new U8[pdataSection.getSize()];
-					memcpy(jitUnit->pdataCopy,reinterpret_cast<U8*>(pdataSectionLoadAddress),pdataSection.getSize());
+					U8* pdataCopy = new U8[pdataSection.getSize()];
+					jitUnit->pdataCopies.push_back(pdataCopy);
+					memcpy(pdataCopy,reinterpret_cast<U8*>(pdataSectionLoadAddress),pdataSection.getSize());
 
 					for(auto pdataRelocIt : pdataSection.relocations())
 					{
@@ -437,7 +1189,7 @@ namespace LLVMJIT
 						const auto symbol = pdataRelocIt.getSymbol();
 						const U64 symbolAddress = symbol->getAddress().get();
 						const llvm::object::section_iterator symbolSection = symbol->getSection().get();
-						U32* valueToRelocate = (U32*)(jitUnit->pdataCopy + pdataRelocIt.getOffset());
+						U32* valueToRelocate = (U32*)(pdataCopy + pdataRelocIt.getOffset());
 						const U64 relocatedValue64 =
 							+ (symbolAddress - symbolSection->getAddress())
 							+ loadedObject->getSectionLoadAddress(*symbolSection)
@@ -447,7 +1199,7 @@ namespace LLVMJIT
 						*valueToRelocate = (U32)relocatedValue64;
 					}
 
-					Platform::registerSEHUnwindInfo(imageBaseAddress,reinterpret_cast<Uptr>(jitUnit->pdataCopy),pdataSection.getSize());
+					Platform::registerSEHUnwindInfo(imageBaseAddress,reinterpret_cast<Uptr>(pdataCopy),pdataSection.getSize());
 				}
 			#endif
 		}
@@ -491,8 +1243,28 @@ namespace LLVMJIT
 			llvm::object::ObjectFile* object = jitUnit->loadedObjects[objectIndex].object;
 			llvm::RuntimeDyld::LoadedObjectInfo* loadedObject = jitUnit->loadedObjects[objectIndex].loadedObject;
 
-			// Create a DWARF context to interpret the debug information in this compilation unit.
-			auto dwarfContext = llvm::make_unique<llvm::DWARFContextInMemory>(*object,loadedObject);
+			// Register the object with the GDB JIT interface (__jit_debug_register_code), so debuggers and core dumps
+			// can symbolize its code. The listener registers a copy of the object with the loaded section addresses.
+			if(isGDBRegistrationEnabled)
+			{
+				llvm::JITEventListener::createGDBRegistrationListener()->NotifyObjectEmitted(*object,*loadedObject);
+				jitUnit->gdbRegisteredObjects.push_back(object);
+			}
+
+			// If the object has line tables, create a DWARF context to interpret them. The context applies the object's
+			// relocations to the debug info while the loaded object info is available, and each symbol's line table is
+			// decoded when the symbol is created.
+			llvm::DWARFContext* dwarfContext = nullptr;
+			for(auto section : object->sections())
+			{
+				llvm::StringRef sectionName;
+				if(!section.getName(sectionName) && sectionName.endswith("debug_line"))
+				{
+					jitUnit->dwarfContexts.push_back(llvm::make_unique<llvm::DWARFContextInMemory>(*object,loadedObject));
+					dwarfContext = jitUnit->dwarfContexts.back().get();
+					break;
+				}
+			}
 
 			// Iterate over the functions in the loaded object.
 			for(auto symbolSizePair : llvm::object::computeSymbolSizes(*object))
@@ -513,11 +1285,6 @@ namespace LLVMJIT
 						loadedAddress += (Uptr)loadedObject->getSectionLoadAddress(*symbolSection.get());
 					}
 
-					// Get the DWARF line info for this symbol, which maps machine code addresses to WebAssembly op indices.
-					llvm::DILineInfoTable lineInfoTable = dwarfContext->getLineInfoForAddressRange(loadedAddress,symbolSizePair.second);
-					std::map<U32,U32> offsetToOpIndexMap;
-					for(auto lineInfo : lineInfoTable) { offsetToOpIndexMap.emplace(U32(lineInfo.first - loadedAddress),lineInfo.second.Line); }
-					
 					#if PRINT_DISASSEMBLY
 					Log::printf(Log::Category::error,"Disassembly for function %s\n",name.get().data());
 					disassembleFunction(reinterpret_cast<U8*>(loadedAddress),Uptr(symbolSizePair.second));
@@ -525,19 +1292,28 @@ namespace LLVMJIT
 
 					// Notify the JIT unit that the symbol was loaded.
 					assert(symbolSizePair.second <= UINTPTR_MAX);
-					jitUnit->notifySymbolLoaded(
+					JITSymbol* jitSymbol = jitUnit->notifySymbolLoaded(
 						name->data(),loadedAddress,
 						Uptr(symbolSizePair.second),
-						std::move(offsetToOpIndexMap)
+						dwarfContext
 						);
+					if(jitSymbol) { jitUnit->loadedSymbols.push_back(jitSymbol); }
+					addPerfMapSymbol(name->str(),loadedAddress,Uptr(symbolSizePair.second),dwarfContext);
 				}
 			}
 		}
 
 		jitUnit->loadedObjects.clear();
+
+		// Make the symbols loaded by the unit visible to describeInstructionPointer.
+		if(jitUnit->loadedSymbols.size())
+		{
+			jitUnit->symbolDirectorySlot = publishSymbolTable(new JITSymbolTable(std::move(jitUnit->loadedSymbols)));
+			jitUnit->loadedSymbols.clear();
+		}
 	}
 
-	static Uptr printedModuleId = 0;
+	static std::atomic<Uptr> printedModuleId(0);
 
 	void printModule(const llvm::Module* llvmModule,const char* filename)
 	{
@@ -548,12 +1324,11 @@ namespace LLVMJIT
 		Log::printf(Log::Category::debug,"Dumped LLVM module to: %s\n",augmentedFilename.c_str());
 	}
 
-	void JITUnit::compile(llvm::Module* llvmModule)
+	// Sets the module's data layout for the target machine, and verifies it.
+	static void prepareLLVMModule(llvm::Module* llvmModule)
 	{
-		// Get a target machine object for this host, and set the module to use its data layout.
 		llvmModule->setDataLayout(targetMachine->createDataLayout());
 
-		// Verify the module.
 		if(DUMP_UNOPTIMIZED_MODULE) { printModule(llvmModule,"llvmDump"); }
 		if(VERIFY_MODULE)
 		{
@@ -563,62 +1338,613 @@ namespace LLVMJIT
 			{ Errors::fatalf("LLVM verification errors:\n%s\n",verifyOutputString.c_str()); }
 			Log::printf(Log::Category::debug,"Verified LLVM module\n");
 		}
+	}
 
-		// Run some optimization on the module's functions.
-		Timing::Timer optimizationTimer;
+	// Creates a copy of the target machine with the given optimization level, for use by another thread or for code
+	// generated with a different optimization level.
+	static std::unique_ptr<llvm::TargetMachine> createTargetMachine(llvm::CodeGenOpt::Level optLevel)
+	{
+		std::unique_ptr<llvm::TargetMachine> result(targetMachine->getTarget().createTargetMachine(
+			targetMachine->getTargetTriple().str(),
+			targetMachine->getTargetCPU(),
+			targetMachine->getTargetFeatureString(),
+			targetMachine->Options,
+			targetMachine->getRelocationModel(),
+			targetMachine->getCodeModel(),
+			optLevel
+			));
+		if(!result) { Errors::fatal("failed to create target machine"); }
+		return result;
+	}
+
+	// Runs some optimization on the module. The passes depend on the optimization level:
+	//	None: no IR passes.
+	//	Less: a few cheap function passes that clean up the emitted IR.
+	//	Default/Aggressive: the standard -O2/-O3 module pipeline, with inlining, GVN, LICM, and loop and SLP vectorization,
+	//		and inductive range check elimination if memory accesses are explicitly bounds checked.
+	// The target machine must not be used by another thread, since it's used to get target information for the passes.
+	static void optimizeLLVMModule(llvm::Module* llvmModule,llvm::CodeGenOpt::Level optLevel,llvm::TargetMachine* passTargetMachine)
+	{
+		if(optLevel == llvm::CodeGenOpt::None) { return; }
 
 		auto fpm = new llvm::legacy::FunctionPassManager(llvmModule);
-		fpm->add(llvm::createPromoteMemoryToRegisterPass());
-		fpm->add(llvm::createInstructionCombiningPass());
-		fpm->add(llvm::createCFGSimplificationPass());
-		fpm->add(llvm::createJumpThreadingPass());
-		fpm->add(llvm::createConstantPropagationPass());
-		fpm->doInitialization();
-		for(auto functionIt = llvmModule->begin();functionIt != llvmModule->end();++functionIt)
-		{ fpm->run(*functionIt); }
+		if(optLevel == llvm::CodeGenOpt::Less)
+		{
+			fpm->add(llvm::createInstructionCombiningPass());
+			fpm->add(llvm::createCFGSimplificationPass());
+			fpm->add(llvm::createJumpThreadingPass());
+			fpm->add(llvm::createConstantPropagationPass());
+			fpm->doInitialization();
+			for(auto functionIt = llvmModule->begin();functionIt != llvmModule->end();++functionIt)
+			{ fpm->run(*functionIt); }
+		}
+		else
+		{
+			llvm::PassManagerBuilder passManagerBuilder;
+			passManagerBuilder.OptLevel = optLevel == llvm::CodeGenOpt::Aggressive ? 3 : 2;
+			passManagerBuilder.SizeLevel = 0;
+			passManagerBuilder.Inliner = llvm::createFunctionInliningPass(passManagerBuilder.OptLevel,passManagerBuilder.SizeLevel);
+			passManagerBuilder.LoopVectorize = true;
+			passManagerBuilder.SLPVectorize = true;
+
+			// Without a 64-bit address space, memory accesses are explicitly bounds checked. Split loops that access
+			// memory through an induction variable so the checks are done once per loop instead of once per access.
+			if(!HAS_64BIT_ADDRESS_SPACE)
+			{
+				passManagerBuilder.addExtension(llvm::PassManagerBuilder::EP_LoopOptimizerEnd,
+					[](const llvm::PassManagerBuilder&,llvm::legacy::PassManagerBase& passManager)
+					{ passManager.add(llvm::createInductiveRangeCheckEliminationPass()); });
+			}
+
+			fpm->add(llvm::createTargetTransformInfoWrapperPass(passTargetMachine->getTargetIRAnalysis()));
+			passManagerBuilder.populateFunctionPassManager(*fpm);
+
+			llvm::legacy::PassManager modulePassManager;
+			modulePassManager.add(llvm::createTargetTransformInfoWrapperPass(passTargetMachine->getTargetIRAnalysis()));
+			passManagerBuilder.populateModulePassManager(modulePassManager);
+
+			fpm->doInitialization();
+			for(auto functionIt = llvmModule->begin();functionIt != llvmModule->end();++functionIt)
+			{ fpm->run(*functionIt); }
+			fpm->doFinalization();
+			modulePassManager.run(*llvmModule);
+		}
 		delete fpm;
-		
+
+		if(DUMP_OPTIMIZED_MODULE) { printModule(llvmModule,"llvmOptimizedDump"); }
+	}
+
+	// Generates machine code for the module, and returns the resulting object file.
+	static std::vector<U8> generateObjectCode(llvm::Module* llvmModule,llvm::TargetMachine* objectTargetMachine)
+	{
+		auto object = llvm::orc::SimpleCompiler(*objectTargetMachine)(*llvmModule);
+		if(!object.getBinary()) { Errors::fatal("failed to generate machine code"); }
+		const llvm::StringRef objectData = object.getBinary()->getData();
+		return std::vector<U8>((const U8*)objectData.begin(),(const U8*)objectData.end());
+	}
+
+	std::vector<U8> compileLLVMModule(llvm::Module* llvmModule,llvm::CodeGenOpt::Level optLevel,bool shouldLogMetrics)
+	{
+		prepareLLVMModule(llvmModule);
+
+		// Use the global target machine if it has the right optimization level.
+		std::unique_ptr<llvm::TargetMachine> optLevelTargetMachine;
+		if(optLevel != targetMachine->getOptLevel()) { optLevelTargetMachine = createTargetMachine(optLevel); }
+		llvm::TargetMachine* moduleTargetMachine = optLevelTargetMachine ? optLevelTargetMachine.get() : targetMachine;
+
+		// Run some optimization on the module's functions.
+		Timing::Timer optimizationTimer;
+		optimizeLLVMModule(llvmModule,optLevel,moduleTargetMachine);
 		if(shouldLogMetrics)
 		{
 			Timing::logRatePerSecond("Optimized LLVM module",optimizationTimer,(F64)llvmModule->size(),"functions");
 		}
 
-		if(DUMP_OPTIMIZED_MODULE) { printModule(llvmModule,"llvmOptimizedDump"); }
-
-		// Pass the module to the JIT compiler.
+		// Generate machine code for the module.
 		Timing::Timer machineCodeTimer;
-		handle = compileLayer->addModuleSet(
-			std::vector<llvm::Module*>{llvmModule},
-			&memoryManager,
-			&NullResolver::singleton);
-		compileLayer->emitAndFinalize(handle);
-
+		std::vector<U8> objectBytes = generateObjectCode(llvmModule,moduleTargetMachine);
 		if(shouldLogMetrics)
 		{
 			Timing::logRatePerSecond("Generated machine code",machineCodeTimer,(F64)llvmModule->size(),"functions");
 		}
 
 		delete llvmModule;
+
+		return objectBytes;
+	}
+
+	// A pool of threads that optimize and generate machine code for LLVM modules in their own LLVM contexts. It runs the
+	// partitions of modules that are compiled in parallel, and background tasks such as compiling optimized code for hot
+	// functions. Partitions are run before background tasks, since another thread is waiting for them. The threads are
+	// started when the first task is added, and are stopped when the pool is destroyed at exit.
+	struct CompileThreadPool
+	{
+		CompileThreadPool()
+		: mutex(Platform::createMutex())
+		, taskEvent(Platform::createEvent())
+		, backgroundTasksFinishedEvent(Platform::createEvent())
+		, numUnfinishedBackgroundTasks(0)
+		, isStopping(false)
+		{}
+
+		~CompileThreadPool()
+		{
+			// Wait for the threads to finish the tasks they are running, and drop any background tasks that haven't started.
+			{
+				Platform::Lock lock(mutex);
+				isStopping = true;
+				backgroundTasks.clear();
+			}
+			Platform::signalEvent(taskEvent);
+			for(std::thread& thread : threads) { thread.join(); }
+
+			Platform::destroyEvent(backgroundTasksFinishedEvent);
+			Platform::destroyEvent(taskEvent);
+			Platform::destroyMutex(mutex);
+		}
+
+		// Runs tasks on the pool's threads, and waits for them to finish.
+		void runTasks(const std::vector<std::function<void()>>& tasks)
+		{
+			Uptr numUnfinishedTasks = tasks.size();
+			Platform::Event* finishedEvent = Platform::createEvent();
+			{
+				Platform::Lock lock(mutex);
+				startThreadsIfNeeded();
+				for(const std::function<void()>& task : tasks)
+				{
+					foregroundTasks.push_back([this,task,&numUnfinishedTasks,finishedEvent]()
+					{
+						task();
+
+						// The event is signaled while holding the mutex, so it isn't destroyed until after it's signaled.
+						Platform::Lock lock(mutex);
+						if(!--numUnfinishedTasks) { Platform::signalEvent(finishedEvent); }
+					});
+				}
+			}
+			Platform::signalEvent(taskEvent);
+
+			while(true)
+			{
+				{
+					Platform::Lock lock(mutex);
+					if(!numUnfinishedTasks) { break; }
+				}
+				Platform::waitForEvent(finishedEvent,UINT64_MAX);
+			}
+			Platform::destroyEvent(finishedEvent);
+		}
+
+		// Adds a task that is run on one of the pool's threads when there are no partitions waiting to be compiled.
+		void addBackgroundTask(std::function<void()>&& task)
+		{
+			{
+				Platform::Lock lock(mutex);
+				if(isStopping) { return; }
+				startThreadsIfNeeded();
+				++numUnfinishedBackgroundTasks;
+				backgroundTasks.push_back([this,task]()
+				{
+					task();
+
+					Platform::Lock lock(mutex);
+					if(!--numUnfinishedBackgroundTasks) { Platform::signalEvent(backgroundTasksFinishedEvent); }
+				});
+			}
+			Platform::signalEvent(taskEvent);
+		}
+
+		// Waits until all background tasks, including any that are added while waiting, have finished.
+		void waitForBackgroundTasks()
+		{
+			while(true)
+			{
+				{
+					Platform::Lock lock(mutex);
+					if(!numUnfinishedBackgroundTasks)
+					{
+						// Pass the signal on to any other thread that is waiting.
+						Platform::signalEvent(backgroundTasksFinishedEvent);
+						break;
+					}
+				}
+				Platform::waitForEvent(backgroundTasksFinishedEvent,UINT64_MAX);
+			}
+		}
+
+	private:
+		Platform::Mutex* mutex;
+
+		// Signaled when a task is added, or when the pool is stopping. Each signal only wakes one thread, so a thread
+		// that takes a task signals it again if there are more tasks.
+		Platform::Event* taskEvent;
+
+		// Signaled when the last unfinished background task finishes.
+		Platform::Event* backgroundTasksFinishedEvent;
+
+		std::deque<std::function<void()>> foregroundTasks;
+		std::deque<std::function<void()>> backgroundTasks;
+		Uptr numUnfinishedBackgroundTasks;
+		std::vector<std::thread> threads;
+		bool isStopping;
+
+		// Starts a thread for each hardware thread. The caller must hold the mutex.
+		void startThreadsIfNeeded()
+		{
+			if(threads.size()) { return; }
+			const Uptr numHardwareThreads = std::max(Uptr(1),Uptr(std::thread::hardware_concurrency()));
+			for(Uptr threadIndex = 0;threadIndex < numHardwareThreads;++threadIndex)
+			{
+				threads.push_back(std::thread([this]() { runThread(); }));
+			}
+		}
+
+		void runThread()
+		{
+			while(true)
+			{
+				std::function<void()> task;
+				bool isPoolStopping;
+				bool hasMoreTasks;
+				{
+					Platform::Lock lock(mutex);
+					isPoolStopping = isStopping;
+					if(!isPoolStopping && foregroundTasks.size())
+					{
+						task = std::move(foregroundTasks.front());
+						foregroundTasks.pop_front();
+					}
+					else if(!isPoolStopping && backgroundTasks.size())
+					{
+						task = std::move(backgroundTasks.front());
+						backgroundTasks.pop_front();
+					}
+					hasMoreTasks = foregroundTasks.size() || backgroundTasks.size();
+				}
+
+				// Wake the next thread, so it can stop too, or run one of the remaining tasks.
+				if(isPoolStopping || hasMoreTasks) { Platform::signalEvent(taskEvent); }
+				if(isPoolStopping) { return; }
+
+				if(task) { task(); }
+				else { Platform::waitForEvent(taskEvent,UINT64_MAX); }
+			}
+		}
+	};
+
+	static CompileThreadPool& getCompileThreadPool()
+	{
+		static CompileThreadPool compileThreadPool;
+		return compileThreadPool;
+	}
+
+	// Loads a LLVM module from bitcode into a new LLVM context, and optimizes and generates machine code for it.
+	// It doesn't use the global LLVM context, so it may run without holding llvmContextMutex.
+	static std::vector<U8> compileBitcode(const llvm::SmallVector<char,0>& bitcode,llvm::CodeGenOpt::Level optLevel)
+	{
+		llvm::LLVMContext bitcodeContext;
+		auto bitcodeModule = llvm::parseBitcodeFile(
+			llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(),bitcode.size()),"partition"),
+			bitcodeContext);
+		if(!bitcodeModule)
+		{
+			llvm::consumeError(bitcodeModule.takeError());
+			Errors::fatal("failed to load partition bitcode");
+		}
+
+		// The global target machine may be in use by another thread, so use a copy of it.
+		std::unique_ptr<llvm::TargetMachine> bitcodeTargetMachine = createTargetMachine(optLevel);
+		optimizeLLVMModule(bitcodeModule->get(),optLevel,bitcodeTargetMachine.get());
+		return generateObjectCode(bitcodeModule->get(),bitcodeTargetMachine.get());
+	}
+
+	// The minimum number of function definitions in each partition of a module that is compiled in parallel.
+	// Smaller partitions aren't worth the cost of splitting the module.
+	static const Uptr minFunctionsPerPartition = 64;
+
+	std::vector<std::vector<U8>> compileLLVMModuleInParallel(const std::function<llvm::Module*()>& emitLLVMModule,llvm::CodeGenOpt::Level optLevel,bool shouldLogMetrics)
+	{
+		// Emit the module and split it into partitions while holding llvmContextMutex. The partitions are serialized
+		// to bitcode, which is loaded into a separate LLVM context for each partition, so the lock isn't held while
+		// they are optimized and compiled.
+		Uptr numFunctionDefs = 0;
+		std::vector<llvm::SmallVector<char,0>> partitionBitcode;
+		{
+			Platform::Lock llvmContextLock(llvmContextMutex);
+			llvm::Module* llvmModule = emitLLVMModule();
+
+			// Decide how many partitions to split the module into.
+			for(const llvm::Function& function : *llvmModule) { if(!function.isDeclaration()) { ++numFunctionDefs; } }
+			const Uptr numHardwareThreads = std::max(Uptr(1),Uptr(std::thread::hardware_concurrency()));
+			const Uptr numPartitions = std::max(Uptr(1),std::min(numHardwareThreads,numFunctionDefs / minFunctionsPerPartition));
+
+			prepareLLVMModule(llvmModule);
+
+			partitionBitcode.resize(numPartitions);
+			if(numPartitions == 1)
+			{
+				llvm::raw_svector_ostream bitcodeStream(partitionBitcode[0]);
+				llvm::WriteBitcodeToFile(llvmModule,bitcodeStream);
+			}
+			else
+			{
+				// Assign each function definition to a partition, balancing the number of instructions in each partition:
+				// the largest functions are assigned first, each to the partition with the fewest instructions so far.
+				Timing::Timer splitTimer;
+				std::vector<std::pair<Uptr,const llvm::Function*>> functionSizes;
+				for(const llvm::Function& function : *llvmModule)
+				{
+					if(function.isDeclaration()) { continue; }
+					Uptr numInstructions = 0;
+					for(const llvm::BasicBlock& basicBlock : function) { numInstructions += basicBlock.size(); }
+					functionSizes.push_back({numInstructions,&function});
+				}
+				std::sort(functionSizes.begin(),functionSizes.end(),
+					[](const std::pair<Uptr,const llvm::Function*>& a,const std::pair<Uptr,const llvm::Function*>& b)
+					{ return a.first > b.first; });
+
+				std::vector<Uptr> partitionSizes(numPartitions,0);
+				std::map<const llvm::GlobalValue*,Uptr> functionToPartitionMap;
+				for(const auto& functionSize : functionSizes)
+				{
+					const Uptr partitionIndex = std::min_element(partitionSizes.begin(),partitionSizes.end()) - partitionSizes.begin();
+					partitionSizes[partitionIndex] += functionSize.first;
+					functionToPartitionMap[functionSize.second] = partitionIndex;
+				}
+
+				// Split the module into a module for each partition that contains definitions of the partition's
+				// functions, and declarations of everything else.
+				for(Uptr partitionIndex = 0;partitionIndex < numPartitions;++partitionIndex)
+				{
+					llvm::ValueToValueMapTy valueMap;
+					std::unique_ptr<llvm::Module> partitionModule = llvm::CloneModule(llvmModule,valueMap,
+						[&](const llvm::GlobalValue* globalValue)
+						{
+							// Definitions of anything other than functions are put in the first partition.
+							auto partitionIt = functionToPartitionMap.find(globalValue);
+							return partitionIt == functionToPartitionMap.end()
+								? partitionIndex == 0
+								: partitionIt->second == partitionIndex;
+						});
+					llvm::raw_svector_ostream bitcodeStream(partitionBitcode[partitionIndex]);
+					llvm::WriteBitcodeToFile(partitionModule.get(),bitcodeStream);
+				}
+				Timing::logTimer("Split LLVM module",splitTimer);
+			}
+
+			delete llvmModule;
+		}
+
+		// Optimize and generate machine code for the partitions. A single partition is compiled on this thread, and
+		// multiple partitions are compiled in parallel by the compile thread pool.
+		Timing::Timer compileTimer;
+		std::vector<std::vector<U8>> objects(partitionBitcode.size());
+		if(partitionBitcode.size() == 1) { objects[0] = compileBitcode(partitionBitcode[0],optLevel); }
+		else
+		{
+			std::vector<std::function<void()>> partitionTasks;
+			for(Uptr partitionIndex = 0;partitionIndex < partitionBitcode.size();++partitionIndex)
+			{
+				partitionTasks.push_back([&,partitionIndex]()
+				{
+					objects[partitionIndex] = compileBitcode(partitionBitcode[partitionIndex],optLevel);
+				});
+			}
+			getCompileThreadPool().runTasks(partitionTasks);
+		}
+
+		if(shouldLogMetrics)
+		{
+			Timing::logRatePerSecond("Optimized and generated machine code",compileTimer,(F64)numFunctionDefs,"functions");
+			if(objects.size() > 1) { Log::printf(Log::Category::metrics,"Compiled module in %u partitions\n",(U32)objects.size()); }
+		}
+
+		return objects;
+	}
+
+	void JITUnit::load(const std::vector<std::vector<U8>>& objectBytesSet,llvm::JITSymbolResolver* resolver)
+	{
+		std::vector<llvm::object::ObjectFile*> objectSet;
+		for(const std::vector<U8>& objectBytes : objectBytesSet)
+		{
+			// Make a copy of the object code that is owned by the unit.
+			auto objectBuffer = llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef((const char*)objectBytes.data(),objectBytes.size()));
+			auto object = llvm::object::ObjectFile::createObjectFile(objectBuffer->getMemBufferRef());
+			if(!object)
+			{
+				llvm::consumeError(object.takeError());
+				Errors::fatal("failed to parse object code");
+			}
+			objects.push_back(llvm::make_unique<llvm::object::OwningBinary<llvm::object::ObjectFile>>(std::move(*object),std::move(objectBuffer)));
+			objectSet.push_back(objects.back()->getBinary());
+		}
+
+		// Pass the objects to the object layer, which loads them, binds their imported symbols, and applies relocations.
+		handle = objectLayer->addObjectSet(std::move(objectSet),&memoryManager,resolver);
+		objectLayer->emitAndFinalize(handle);
+	}
+
+	static llvm::CodeGenOpt::Level getOptLevel(const CompileOptions& options)
+	{
+		switch(options.optimizationLevel)
+		{
+		case 0: return llvm::CodeGenOpt::None;
+		case 1: return llvm::CodeGenOpt::Less;
+		case 2: return llvm::CodeGenOpt::Default;
+		case 3: return llvm::CodeGenOpt::Aggressive;
+		default: Errors::unreachable();
+		};
 	}
 
-	void instantiateModule(const IR::Module& module,ModuleInstance* moduleInstance)
+	JITModuleBase* compileModule(const IR::Module& module,const std::vector<std::string>& functionDefDebugNames,const CompileOptions& options)
 	{
-		// Emit LLVM IR for the module.
-		auto llvmModule = emitModule(module,moduleInstance);
+		const llvm::CodeGenOpt::Level optLevel = getOptLevel(options);
+
+		// If the embedder trusts precompiled code, and the module contains precompiled object code for this target and
+		// version of WAVM, just load it. The code was compiled with the levels stored with it, not the options' levels.
+		std::vector<std::vector<U8>> objects;
+		llvm::CodeGenOpt::Level precompiledOptLevel;
+		CompileOptions::DebugInfoLevel precompiledDebugInfoLevel;
+		if(options.allowPrecompiledCode && loadPrecompiledObjects(module,objects,precompiledOptLevel,precompiledDebugInfoLevel))
+		{
+			auto jitModule = new JITModule(CodeTier::optimized,false,precompiledOptLevel,precompiledDebugInfoLevel,functionDefDebugNames);
+			Timing::Timer loadTimer;
+			ModuleResolver resolver(module,jitModule);
+			jitModule->load(objects,&resolver);
+			Timing::logTimer("Loaded precompiled object code",loadTimer);
+			return jitModule;
+		}
+
+		// With tiered compilation, quickly compile unoptimized code, and only optimize the functions that turn out to be hot.
+		// There's nothing to gain from it if the optimized code wouldn't be optimized.
+		const CodeTier tier = isTieredCompilationEnabled && optLevel != llvm::CodeGenOpt::None ? CodeTier::baseline : CodeTier::optimized;
 
 		// Construct the JIT compilation pipeline for this module.
-		auto jitModule = new JITModule(moduleInstance);
-		moduleInstance->jitModule = jitModule;
+		auto jitModule = new JITModule(tier,isLazyCompilationEnabled,optLevel,options.debugInfoLevel,functionDefDebugNames);
+
+		if(isLazyCompilationEnabled)
+		{
+			// Only compile a stub for each function, which compiles the function's body on its first call.
+			// The stubs are cheap to compile, so they aren't cached.
+			objects = compileLLVMModuleInParallel(
+				[&]() { return emitModule(module,functionDefDebugNames,CodeTier::lazyStub,options.debugInfoLevel); },
+				llvm::CodeGenOpt::None,
+				true);
+		}
+		else
+		{
+			// Look for the module's object code in the object cache, and only compile the module if it's not there.
+			const bool useObjectCache = isObjectCacheEnabled();
+			const SHA256::Digest objectCacheKey = useObjectCache ? getObjectCacheKey(module,tier,jitModule->getOptLevel(tier),options.debugInfoLevel) : SHA256::Digest();
+			if(!useObjectCache || !loadCachedObjects(objectCacheKey,objects))
+			{
+				// Emit LLVM IR for the module, and compile it.
+				objects = compileLLVMModuleInParallel(
+					[&]() { return emitModule(module,functionDefDebugNames,tier,options.debugInfoLevel); },
+					jitModule->getOptLevel(tier),
+					true);
+				if(useObjectCache) { storeCachedObjects(objectCacheKey,objects); }
+			}
+		}
+
+		// Load the object code, binding its imported symbols to the module's types and the WAVM intrinsics.
+		Timing::Timer loadTimer;
+		ModuleResolver resolver(module,jitModule);
+		jitModule->load(objects,&resolver);
+		Timing::logTimer("Loaded object code",loadTimer);
+
+		return jitModule;
+	}
+
+	void precompileModule(IR::Module& module,const std::vector<std::string>& functionDefDebugNames,const CompileOptions& options)
+	{
+		const llvm::CodeGenOpt::Level optLevel = getOptLevel(options);
+
+		// Compile optimized code for the whole module, and add it to the module.
+		std::vector<std::vector<U8>> objects = compileLLVMModuleInParallel(
+			[&]() { return emitModule(module,functionDefDebugNames,CodeTier::optimized,options.debugInfoLevel); },
+			optLevel,
+			true);
+		addPrecompiledObjects(module,optLevel,options.debugInfoLevel,objects);
+	}
+
+	// Compiles and loads code for a single function of a module, which replaces the function's current code.
+	// The function is emitted while holding llvmContextMutex, but is compiled without holding it.
+	static void compileFunctionUnit(Runtime::CompiledModule* compiledModule,Uptr functionDefIndex,CodeTier tier,llvm::CodeGenOpt::Level optLevel)
+	{
+		JITModule* jitModule = static_cast<JITModule*>(compiledModule->jitModule);
+		auto functionUnit = new JITFunctionUnit(jitModule,functionDefIndex);
+
+		Timing::Timer compileTimer;
+		std::vector<std::vector<U8>> objects = compileLLVMModuleInParallel(
+			[&]() { return emitModule(compiledModule->module,compiledModule->functionDefDebugNames,tier,jitModule->debugInfoLevel,functionDefIndex); },
+			optLevel,
+			false);
+
+		ModuleResolver resolver(compiledModule->module,jitModule);
+		functionUnit->load(objects,&resolver);
+		{
+			Platform::Lock functionUnitsLock(jitModule->functionUnitsMutex);
+			jitModule->functionUnits.push_back(functionUnit);
+		}
+
+		Log::printf(Log::Category::debug,"Compiled %s code for %s in %.2fms\n",
+			tier == CodeTier::optimized ? "optimized" : "baseline",
+			jitModule->functionDefDebugNames[functionDefIndex].c_str(),
+			compileTimer.getMilliseconds());
+	}
+
+	void compileFunctionDef(ModuleInstance* moduleInstance,Uptr functionDefIndex)
+	{
+		CompiledModule* compiledModule = moduleInstance->compiledModule;
+		JITModule* jitModule = static_cast<JITModule*>(compiledModule->jitModule);
+		assert(jitModule->isLazy);
+		assert(functionDefIndex < jitModule->isFunctionDefCompiled.size());
+
+		// Another thread may have compiled the function while this thread was waiting for the lock.
+		{
+			Platform::Lock lazyCompileLock(jitModule->lazyCompileMutex);
+			if(!jitModule->isFunctionDefCompiled[functionDefIndex])
+			{
+				compileFunctionUnit(compiledModule,functionDefIndex,jitModule->tier,jitModule->getOptLevel(jitModule->tier));
+				jitModule->isFunctionDefCompiled[functionDefIndex] = true;
+			}
+		}
+		void* nativeFunction = jitModule->functionDefNativeFunctions[functionDefIndex].load(std::memory_order_acquire);
+
+		// Patch the function instance and the default table's elements that still call the function's stub, so later
+		// calls through them don't need to go through it. Other threads may be patching them for the same function,
+		// or setting table elements, so each is only replaced if it still points to the stub. The stub is shared by
+		// all instances of the module, and any element that points to it is for this function, so its context is
+		// already correct for the compiled code.
+		void* lazyStub = jitModule->functionDefLazyStubs[functionDefIndex];
+		FunctionInstance* function = moduleInstance->functionDefs[functionDefIndex];
+		void* expectedNativeFunction = lazyStub;
+		function->nativeFunction.compare_exchange_strong(expectedNativeFunction,nativeFunction,std::memory_order_release,std::memory_order_relaxed);
+		if(TableInstance* table = moduleInstance->defaultTable)
+		{
+			for(Uptr elementIndex = 0;elementIndex < table->elements.size();++elementIndex)
+			{
+				void* expectedValue = lazyStub;
+				table->baseAddress[elementIndex].value.compare_exchange_strong(expectedValue,nativeFunction,std::memory_order_release,std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void requestTierUp(Runtime::CompiledModule* compiledModule,Uptr functionDefIndex)
+	{
+		JITModule* jitModule = static_cast<JITModule*>(compiledModule->jitModule);
+		if(jitModule->tier != CodeTier::baseline) { return; }
+
+		{
+			Platform::Lock tierUpRequestLock(tierUpRequestMutex);
+			assert(functionDefIndex < jitModule->isTierUpRequested.size());
+			if(jitModule->isTierUpRequested[functionDefIndex]) { return; }
+			jitModule->isTierUpRequested[functionDefIndex] = true;
+
+			// Keep the compiled module alive until the optimized code has been compiled.
+			++compiledModule->numReferences;
+		}
+
+		// Compile the optimized code on the compile thread pool. If the pool is stopped at exit before the task runs,
+		// the task is dropped without releasing the compiled module, which is then never freed.
+		getCompileThreadPool().addBackgroundTask([compiledModule,functionDefIndex]()
+		{
+			JITModule* jitModule = static_cast<JITModule*>(compiledModule->jitModule);
+			compileFunctionUnit(compiledModule,functionDefIndex,CodeTier::optimized,jitModule->optimizedOptLevel);
+			Runtime::releaseCompiledModule(compiledModule);
+		});
+	}
 
-		// Compile the module.
-		jitModule->compile(llvmModule);
+	void waitForTierUp()
+	{
+		getCompileThreadPool().waitForBackgroundTasks();
 	}
 
-	std::string getExternalFunctionName(ModuleInstance* moduleInstance,Uptr functionDefIndex)
+	std::string getExternalFunctionName(Uptr functionDefIndex,const std::string& debugName)
 	{
-		assert(functionDefIndex < moduleInstance->functionDefs.size());
-		return "wasmFunc" + std::to_string(functionDefIndex)
-			+ "_" + moduleInstance->functionDefs[functionDefIndex]->debugName;
+		return "wasmFunc" + std::to_string(functionDefIndex) + "_" + debugName;
 	}
 
 	bool getFunctionIndexFromExternalName(const char* externalName,Uptr& outFunctionDefIndex)
@@ -642,19 +1968,32 @@ namespace LLVMJIT
 
 	bool describeInstructionPointer(Uptr ip,std::string& outDescription)
 	{
-		JITSymbol* symbol;
+		// Find the symbol that contains ip in the published symbol tables, without locking. In each table whose
+		// address range contains ip, find the symbol with the lowest end address > ip.
+		struct SymbolDirectoryReader
 		{
-			Platform::Lock addressToSymbolMapLock(addressToSymbolMapMutex);
-			auto symbolIt = addressToSymbolMap.upper_bound(ip);
-			if(symbolIt == addressToSymbolMap.end()) { return false; }
-			symbol = symbolIt->second;
+			SymbolDirectoryReader() { ++numSymbolDirectoryReaders; }
+			~SymbolDirectoryReader() { --numSymbolDirectoryReaders; }
+		} symbolDirectoryReader;
+		const JITSymbolDirectory* directory = symbolDirectory.load();
+		const Uptr numUsedSlots = directory->numUsedSlots.load(std::memory_order_acquire);
+		const JITSymbol* symbol = nullptr;
+		for(Uptr slotIndex = 0;slotIndex < numUsedSlots && !symbol;++slotIndex)
+		{
+			const JITSymbolTable* table = directory->slots[slotIndex].load(std::memory_order_acquire);
+			if(!table || ip < table->baseAddress || ip >= table->endAddress) { continue; }
+
+			auto endAddressIt = std::upper_bound(table->endAddresses.begin(),table->endAddresses.end(),ip);
+			if(endAddressIt == table->endAddresses.end()) { continue; }
+			const JITSymbol* candidateSymbol = table->symbols[endAddressIt - table->endAddresses.begin()];
+			if(ip >= candidateSymbol->baseAddress && ip < candidateSymbol->baseAddress + candidateSymbol->numBytes) { symbol = candidateSymbol; }
 		}
-		if(ip < symbol->baseAddress || ip >= symbol->baseAddress + symbol->numBytes) { return false; }
+		if(!symbol) { return false; }
 
 		switch(symbol->type)
 		{
-		case JITSymbol::Type::functionInstance:
-			outDescription = symbol->functionInstance->debugName;
+		case JITSymbol::Type::functionDef:
+			outDescription = symbol->functionDefDebugName;
 			if(!outDescription.size()) { outDescription = "<unnamed function>"; }
 			break;
 		case JITSymbol::Type::invokeThunk:
@@ -663,38 +2002,66 @@ namespace LLVMJIT
 		default: Errors::unreachable();
 		};
 		
-		// Find the highest entry in the offsetToOpIndexMap whose offset is <= the symbol-relative IP.
-		U32 ipOffset = (U32)(ip - symbol->baseAddress);
-		Iptr opIndex = -1;
-		for(auto offsetMapIt : symbol->offsetToOpIndexMap)
+		// Find the highest entry in the symbol's offsetToOpIndexArray whose offset is <= the symbol-relative IP.
+		const U32 ipOffset = (U32)(ip - symbol->baseAddress);
+		auto offsetIt = std::upper_bound(symbol->offsetToOpIndexArray.begin(),symbol->offsetToOpIndexArray.end(),ipOffset,
+			[](U32 offset,const std::pair<U32,U32>& offsetOpIndexPair) { return offset < offsetOpIndexPair.first; });
+		if(offsetIt != symbol->offsetToOpIndexArray.begin())
 		{
-			if(offsetMapIt.first <= ipOffset) { opIndex = offsetMapIt.second; }
-			else { break; }
+			outDescription += " (op " + std::to_string((offsetIt - 1)->second) + ")";
 		}
-		if(opIndex >= 0) { outDescription += " (op " + std::to_string(opIndex) + ")"; }
 		return true;
 	}
 
-	InvokeFunctionPointer getInvokeThunk(const FunctionType* functionType)
+	// Returns the cached invoke thunk for a function type, or null if there isn't one in the table.
+	static InvokeFunctionPointer findCachedInvokeThunk(InvokeThunkCacheTable* table,const FunctionType* functionType)
+	{
+		const Uptr entryIndexMask = table->numEntries - 1;
+		for(Uptr entryIndex = (Uptr(functionType) >> 4) & entryIndexMask;;entryIndex = (entryIndex + 1) & entryIndexMask)
+		{
+			const FunctionType* entryFunctionType = table->entries[entryIndex].functionType.load(std::memory_order_acquire);
+			if(entryFunctionType == functionType) { return table->entries[entryIndex].invokeThunk.load(std::memory_order_relaxed); }
+			else if(!entryFunctionType) { return nullptr; }
+		}
+	}
+
+	// Adds an invoke thunk to the table. Must be called while holding invokeThunkCacheMutex.
+	static void addCachedInvokeThunk(InvokeThunkCacheTable* table,const FunctionType* functionType,InvokeFunctionPointer invokeThunk)
+	{
+		assert((table->numUsedEntries + 1) * 2 <= table->numEntries);
+		const Uptr entryIndexMask = table->numEntries - 1;
+		Uptr entryIndex = (Uptr(functionType) >> 4) & entryIndexMask;
+		while(table->entries[entryIndex].functionType.load(std::memory_order_relaxed))
+		{
+			entryIndex = (entryIndex + 1) & entryIndexMask;
+		}
+		table->entries[entryIndex].invokeThunk.store(invokeThunk,std::memory_order_relaxed);
+		table->entries[entryIndex].functionType.store(functionType,std::memory_order_release);
+		++table->numUsedEntries;
+	}
+
+	// Compiles an invoke thunk for a function type.
+	static InvokeFunctionPointer compileInvokeThunk(const FunctionType* functionType)
 	{
-		// Reuse cached invoke thunks for the same function type.
-		auto mapIt = invokeThunkTypeToSymbolMap.find(functionType);
-		if(mapIt != invokeThunkTypeToSymbolMap.end()) { return reinterpret_cast<InvokeFunctionPointer>(mapIt->second->baseAddress); }
+		Platform::Lock llvmContextLock(llvmContextMutex);
 
 		auto llvmModule = new llvm::Module("",context);
 		auto llvmFunctionType = llvm::FunctionType::get(
 			llvmVoidType,
-			{asLLVMType(functionType)->getPointerTo(),llvmI64Type->getPointerTo()},
+			{asLLVMType(functionType)->getPointerTo(),llvmI8PtrType,llvmI64Type->getPointerTo()},
 			false);
 		auto llvmFunction = llvm::Function::Create(llvmFunctionType,llvm::Function::ExternalLinkage,"invokeThunk",llvmModule);
 		auto argIt = llvmFunction->args().begin();
 		llvm::Value* functionPointer = &*argIt++;
+		llvm::Value* functionContext = &*argIt++;
 		llvm::Value* argBaseAddress = &*argIt;
 		auto entryBlock = llvm::BasicBlock::Create(context,"entry",llvmFunction);
 		llvm::IRBuilder<> irBuilder(entryBlock);
 
-		// Load the function's arguments from an array of 64-bit values at an address provided by the caller.
+		// Load the function's arguments from an array of 64-bit values at an address provided by the caller,
+		// following the function's context.
 		std::vector<llvm::Value*> structArgLoads;
+		structArgLoads.push_back(functionContext);
 		for(Uptr parameterIndex = 0;parameterIndex < functionType->parameters.size();++parameterIndex)
 		{
 			structArgLoads.push_back(irBuilder.CreateLoad(
@@ -725,17 +2092,45 @@ namespace LLVMJIT
 
 		// Compile the invoke thunk.
 		auto jitUnit = new JITInvokeThunkUnit(functionType);
-		jitUnit->compile(llvmModule);
+		jitUnit->load({compileLLVMModule(llvmModule,llvm::CodeGenOpt::Default,false)},&NullResolver::singleton);
 
 		assert(jitUnit->symbol);
-		invokeThunkTypeToSymbolMap[functionType] = jitUnit->symbol;
+		return reinterpret_cast<InvokeFunctionPointer>(jitUnit->symbol->baseAddress);
+	}
+
+	InvokeFunctionPointer getInvokeThunk(const FunctionType* functionType)
+	{
+		// Reuse cached invoke thunks for the same function type without locking.
+		InvokeFunctionPointer invokeThunk = findCachedInvokeThunk(invokeThunkCache.load(std::memory_order_acquire),functionType);
+		if(invokeThunk) { return invokeThunk; }
 
+		// Serialize creating invoke thunks, and check whether another thread created the thunk while this thread was
+		// waiting for the lock.
+		Platform::Lock invokeThunkCacheLock(invokeThunkCacheMutex);
+		InvokeThunkCacheTable* table = invokeThunkCache.load(std::memory_order_relaxed);
+		invokeThunk = findCachedInvokeThunk(table,functionType);
+		if(invokeThunk) { return invokeThunk; }
+
+		invokeThunk = compileInvokeThunk(functionType);
+
+		// If the table would be more than half full, replace it with a copy that has twice as many entries.
+		if((table->numUsedEntries + 1) * 2 > table->numEntries)
 		{
-			Platform::Lock addressToSymbolMapLock(addressToSymbolMapMutex);
-			addressToSymbolMap[jitUnit->symbol->baseAddress + jitUnit->symbol->numBytes] = jitUnit->symbol;
+			InvokeThunkCacheTable* newTable = new InvokeThunkCacheTable(table->numEntries * 2);
+			for(Uptr entryIndex = 0;entryIndex < table->numEntries;++entryIndex)
+			{
+				const InvokeThunkCacheTable::Entry& entry = table->entries[entryIndex];
+				if(entry.functionType.load(std::memory_order_relaxed))
+				{
+					addCachedInvokeThunk(newTable,entry.functionType.load(std::memory_order_relaxed),entry.invokeThunk.load(std::memory_order_relaxed));
+				}
+			}
+			invokeThunkCache.store(newTable,std::memory_order_release);
+			table = newTable;
 		}
+		addCachedInvokeThunk(table,functionType,invokeThunk);
 
-		return reinterpret_cast<InvokeFunctionPointer>(jitUnit->symbol->baseAddress);
+		return invokeThunk;
 	}
 	
 	void init()
@@ -746,6 +2141,17 @@ namespace LLVMJIT
 		llvm::InitializeNativeTargetDisassembler();
 		llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
 
+		// Add the C library's rounding functions that generated code may call, since they may not be exported by any
+		// library loaded in the process if the C library is linked statically.
+		llvm::sys::DynamicLibrary::AddSymbol("floor",reinterpret_cast<void*>(static_cast<F64(*)(F64)>(&::floor)));
+		llvm::sys::DynamicLibrary::AddSymbol("floorf",reinterpret_cast<void*>(static_cast<F32(*)(F32)>(&::floorf)));
+		llvm::sys::DynamicLibrary::AddSymbol("ceil",reinterpret_cast<void*>(static_cast<F64(*)(F64)>(&::ceil)));
+		llvm::sys::DynamicLibrary::AddSymbol("ceilf",reinterpret_cast<void*>(static_cast<F32(*)(F32)>(&::ceilf)));
+		llvm::sys::DynamicLibrary::AddSymbol("trunc",reinterpret_cast<void*>(static_cast<F64(*)(F64)>(&::trunc)));
+		llvm::sys::DynamicLibrary::AddSymbol("truncf",reinterpret_cast<void*>(static_cast<F32(*)(F32)>(&::truncf)));
+		llvm::sys::DynamicLibrary::AddSymbol("nearbyint",reinterpret_cast<void*>(static_cast<F64(*)(F64)>(&::nearbyint)));
+		llvm::sys::DynamicLibrary::AddSymbol("nearbyintf",reinterpret_cast<void*>(static_cast<F32(*)(F32)>(&::nearbyintf)));
+
 		auto targetTriple = llvm::sys::getProcessTriple();
 		#ifdef __APPLE__
 			// Didn't figure out exactly why, but this works around a problem with the MacOS dynamic loader. Without it,
@@ -803,3 +2209,36 @@ namespace LLVMJIT
 		#endif
 	}
 }
+
+namespace Runtime
+{
+	void setTieredCompilationEnabled(bool enable)
+	{
+		LLVMJIT::isTieredCompilationEnabled = enable;
+	}
+
+	void setLazyCompilationEnabled(bool enable)
+	{
+		LLVMJIT::isLazyCompilationEnabled = enable;
+	}
+
+	void setTierUpThreshold(U32 numCallsAndLoopIterations)
+	{
+		LLVMJIT::tierUpThreshold = numCallsAndLoopIterations;
+	}
+
+	void waitForTieredCompilation()
+	{
+		LLVMJIT::waitForTierUp();
+	}
+
+	void setHugePageCodeEnabled(bool enable)
+	{
+		LLVMJIT::isHugePageCodeEnabled = enable;
+	}
+
+	void setGDBRegistrationEnabled(bool enable)
+	{
+		LLVMJIT::isGDBRegistrationEnabled = enable;
+	}
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Inline/BasicTypes.h"
+#include "Inline/SHA256.h"
 #include "Platform/Platform.h"
 #include "RuntimePrivate.h"
 #include "Intrinsics.h"
@@ -24,7 +25,11 @@
 #endif
 
 #include "llvm/Analysis/Passes.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
@@ -44,15 +49,23 @@
 #include "llvm/Object/SymbolSize.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/DataTypes.h"
+#include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/DebugInfo/DIContext.h"
 #include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <deque>
 #include <string>
+#include <thread>
 #include <vector>
 
 #ifdef _WIN32
@@ -66,6 +79,9 @@ namespace LLVMJIT
 {
 	// The global LLVM context.
 	extern llvm::LLVMContext context;
+
+	// The target machine that code is generated for.
+	extern llvm::TargetMachine* targetMachine;
 	
 	// Maps a type ID to the corresponding LLVM type.
 	extern llvm::Type* llvmResultTypes[(Uptr)ResultType::num];
@@ -96,15 +112,18 @@ namespace LLVMJIT
 	inline llvm::Type* asLLVMType(ResultType type) { return llvmResultTypes[(Uptr)type]; }
 
 	// Converts a WebAssembly function type to a LLVM type.
+	// The LLVM function type has an additional first parameter: a pointer to the callee's InstanceContext.
 	inline llvm::FunctionType* asLLVMType(const FunctionType* functionType)
 	{
-		auto llvmArgTypes = (llvm::Type**)alloca(sizeof(llvm::Type*) * functionType->parameters.size());
-		for(Uptr argIndex = 0;argIndex < functionType->parameters.size();++argIndex)
+		const Uptr numArgs = functionType->parameters.size() + 1;
+		auto llvmArgTypes = (llvm::Type**)alloca(sizeof(llvm::Type*) * numArgs);
+		llvmArgTypes[0] = llvmI8PtrType;
+		for(Uptr parameterIndex = 0;parameterIndex < functionType->parameters.size();++parameterIndex)
 		{
-			llvmArgTypes[argIndex] = asLLVMType(functionType->parameters[argIndex]);
+			llvmArgTypes[parameterIndex + 1] = asLLVMType(functionType->parameters[parameterIndex]);
 		}
 		auto llvmResultType = asLLVMType(functionType->ret);
-		return llvm::FunctionType::get(llvmResultType,llvm::ArrayRef<llvm::Type*>(llvmArgTypes,functionType->parameters.size()),false);
+		return llvm::FunctionType::get(llvmResultType,llvm::ArrayRef<llvm::Type*>(llvmArgTypes,numArgs),false);
 	}
 
 	// Overloaded functions that compile a literal value to a LLVM constant of the right type.
@@ -122,9 +141,62 @@ namespace LLVMJIT
 	}
 
 	// Functions that map between the symbols used for externally visible functions and the function
-	std::string getExternalFunctionName(ModuleInstance* moduleInstance,Uptr functionDefIndex);
+	std::string getExternalFunctionName(Uptr functionDefIndex,const std::string& debugName);
 	bool getFunctionIndexFromExternalName(const char* externalName,Uptr& outFunctionDefIndex);
 
-	// Emits LLVM IR for a module.
-	llvm::Module* emitModule(const IR::Module& module,ModuleInstance* moduleInstance);
+	// The kinds of code that may be generated for a module.
+	enum class CodeTier
+	{
+		// Optimized code, used when tiered compilation is disabled, and for hot functions when it is enabled.
+		optimized,
+		// Quickly generated code. It counts calls and loop iterations to find hot functions, and calls the module's
+		// functions through slots that are updated when optimized code is available.
+		baseline,
+		// A small stub for each function that compiles the function on its first call, and then forwards to it.
+		lazyStub
+	};
+
+	// Emits LLVM IR for a module. If singleFunctionDefIndex is a function definition index, only that function is
+	// defined, and it calls the module's other functions through their slots.
+	llvm::Module* emitModule(
+		const IR::Module& module,
+		const std::vector<std::string>& functionDefDebugNames,
+		CodeTier tier,
+		Runtime::CompileOptions::DebugInfoLevel debugInfoLevel,
+		Uptr singleFunctionDefIndex = UINTPTR_MAX);
+
+	// Optimizes a LLVM module and generates object code for it. The LLVM module is deleted.
+	// CodeGenOpt::None skips the IR optimization passes, and Default/Aggressive use the standard -O2/-O3 pipelines.
+	// The caller must hold the lock on the global LLVM context while the module is compiled.
+	std::vector<U8> compileLLVMModule(llvm::Module* llvmModule,llvm::CodeGenOpt::Level optLevel,bool shouldLogMetrics);
+
+	// Calls emitLLVMModule to emit a module in the global LLVM context while holding the lock on it, and then compiles
+	// the module without holding the lock: it's split into partitions that are each optimized and compiled to object
+	// code in their own LLVM context, in parallel on a pool of threads. Returns an object for each partition, which may
+	// reference symbols defined by the others.
+	std::vector<std::vector<U8>> compileLLVMModuleInParallel(
+		const std::function<llvm::Module*()>& emitLLVMModule,
+		llvm::CodeGenOpt::Level optLevel,
+		bool shouldLogMetrics);
+
+	// A content-addressed cache of object code on disk, keyed by a SHA-256 digest of the module and the target it was
+	// compiled for.
+	bool isObjectCacheEnabled();
+	SHA256::Digest getObjectCacheKey(const IR::Module& module,CodeTier tier,llvm::CodeGenOpt::Level optLevel,Runtime::CompileOptions::DebugInfoLevel debugInfoLevel);
+	bool loadCachedObjects(const SHA256::Digest& key,std::vector<std::vector<U8>>& outObjects);
+	void storeCachedObjects(const SHA256::Digest& key,const std::vector<std::vector<U8>>& objects);
+
+	// Precompiled object code stored in a user section of the module it was compiled from. It's only loaded by a
+	// runtime with the same target and version as the one that compiled it, which also returns the optimization and
+	// debug info levels it was compiled with.
+	void addPrecompiledObjects(IR::Module& module,llvm::CodeGenOpt::Level optLevel,Runtime::CompileOptions::DebugInfoLevel debugInfoLevel,const std::vector<std::vector<U8>>& objects);
+	bool loadPrecompiledObjects(
+		const IR::Module& module,
+		std::vector<std::vector<U8>>& outObjects,
+		llvm::CodeGenOpt::Level& outOptLevel,
+		Runtime::CompileOptions::DebugInfoLevel& outDebugInfoLevel);
+
+	// Describes a loaded symbol to the Linux perf profiler if enabled: in /tmp/perf-<pid>.map, and in a jitdump file
+	// with the symbol's code and its line table, which maps instructions to op indices.
+	void addPerfMapSymbol(const std::string& name,Uptr baseAddress,Uptr numBytes,llvm::DWARFContext* dwarfContext);
 }
@@ -3,11 +3,28 @@
 #include "Platform/Platform.h"
 #include "RuntimePrivate.h"
 
+#include <algorithm>
+
 namespace Runtime
 {
 	// Global lists of memories; used to query whether an address is reserved by one of them.
 	std::vector<MemoryInstance*> memories;
 
+	// The address space reserved for a memory.
+	struct MemoryReservation
+	{
+		U8* baseAddress;
+		U8* reservedBaseAddress;
+		Uptr reservedNumPlatformPages;
+	};
+
+	// Reservations that aren't used by a memory, which are reused by new memories to avoid the cost of reserving and
+	// freeing address space when memories are frequently created and destroyed. A memory's pages are decommitted when
+	// its reservation is returned to the pool, so memories that reuse it start zeroed.
+	static Platform::Mutex* memoryPoolMutex = Platform::createMutex();
+	static std::vector<MemoryReservation> memoryPool;
+	static Uptr maxPooledMemories = 0;
+
 	static Uptr getPlatformPagesPerWebAssemblyPageLog2()
 	{
 		errorUnless(Platform::getPageSizeLog2() <= IR::numBytesPerPageLog2);
@@ -24,22 +41,42 @@ namespace Runtime
 		else { return (U8*)((Uptr)(outUnalignedBaseAddress + alignmentBytes - 1) & ~(alignmentBytes - 1)); }
 	}
 
-	MemoryInstance* createMemory(MemoryType type)
-	{
-		MemoryInstance* memory = new MemoryInstance(type);
+	// On a 64-bit runtime, allocate 8GB of address space for each memory.
+	// This allows eliding bounds checks on memory accesses, since a 32-bit index + 32-bit offset will always be within the reserved address-space.
+	// On a 32-bit runtime, allocate 256MB.
+	static const Uptr memoryMaxBytes = HAS_64BIT_ADDRESS_SPACE ? Uptr(8ull*1024*1024*1024) : 0x10000000;
 
-		// On a 64-bit runtime, allocate 8GB of address space for the memory.
-		// This allows eliding bounds checks on memory accesses, since a 32-bit index + 32-bit offset will always be within the reserved address-space.
-		// On a 32-bit runtime, allocate 256MB.
-		const Uptr memoryMaxBytes = HAS_64BIT_ADDRESS_SPACE ? Uptr(8ull*1024*1024*1024) : 0x10000000;
-		
+	static bool reserveMemoryAddressSpace(MemoryReservation& outReservation)
+	{
 		// On a 64 bit runtime, align the instance memory base to a 4GB boundary, so the lower 32-bits will all be zero. Maybe it will allow better code generation?
 		// Note that this reserves a full extra 4GB, but only uses (4GB-1 page) for alignment, so there will always be a guard page at the end to
 		// protect against unaligned loads/stores that straddle the end of the address-space.
 		const Uptr alignmentBytes = HAS_64BIT_ADDRESS_SPACE ? Uptr(4ull*1024*1024*1024) : ((Uptr)1 << Platform::getPageSizeLog2());
-		memory->baseAddress = allocateVirtualPagesAligned(memoryMaxBytes,alignmentBytes,memory->reservedBaseAddress,memory->reservedNumPlatformPages);
+		outReservation.baseAddress = allocateVirtualPagesAligned(memoryMaxBytes,alignmentBytes,outReservation.reservedBaseAddress,outReservation.reservedNumPlatformPages);
+		return outReservation.baseAddress != nullptr;
+	}
+
+	MemoryInstance* createMemory(MemoryType type)
+	{
+		MemoryInstance* memory = new MemoryInstance(type);
+
+		// Reuse a pooled reservation if there is one, and otherwise reserve new address space for the memory.
+		MemoryReservation reservation;
+		bool hasReservation = false;
+		{
+			Platform::Lock memoryPoolLock(memoryPoolMutex);
+			if(memoryPool.size())
+			{
+				reservation = memoryPool.back();
+				memoryPool.pop_back();
+				hasReservation = true;
+			}
+		}
+		if(!hasReservation && !reserveMemoryAddressSpace(reservation)) { delete memory; return nullptr; }
+		memory->baseAddress = reservation.baseAddress;
+		memory->reservedBaseAddress = reservation.reservedBaseAddress;
+		memory->reservedNumPlatformPages = reservation.reservedNumPlatformPages;
 		memory->endOffset = memoryMaxBytes;
-		if(!memory->baseAddress) { delete memory; return nullptr; }
 
 		// Grow the memory to the type's minimum size.
 		assert(type.size.min <= UINTPTR_MAX);
@@ -50,13 +87,123 @@ namespace Runtime
 		return memory;
 	}
 
+	void releaseMemoryImage(MemoryImage* image)
+	{
+		assert(image->numReferences > 0);
+		if(--image->numReferences == 0) { delete image; }
+	}
+
+	// Replaces any pages mapped from a memory image at or after the given offset with uncommitted pages, and releases
+	// the memory's reference to the image if none of its pages are still mapped.
+	static void unmapMemoryImage(MemoryInstance* memory,Uptr endOffset)
+	{
+		if(!memory->image) { return; }
+		const Uptr imageBaseOffset = memory->image->baseOffset;
+		const Uptr imageEndOffset = imageBaseOffset + (memory->numImagePlatformPages << Platform::getPageSizeLog2());
+		if(imageEndOffset <= endOffset) { return; }
+
+		const Uptr unmapBaseOffset = std::max(imageBaseOffset,endOffset);
+		Platform::unmapSharedPageFile(
+			memory->baseAddress + unmapBaseOffset,
+			(imageEndOffset - unmapBaseOffset) >> Platform::getPageSizeLog2());
+		memory->numImagePlatformPages = (unmapBaseOffset - imageBaseOffset) >> Platform::getPageSizeLog2();
+		if(!memory->numImagePlatformPages)
+		{
+			releaseMemoryImage(memory->image);
+			memory->image = nullptr;
+		}
+	}
+
+	bool mapMemoryImage(MemoryInstance* memory,MemoryImage* image)
+	{
+		const Uptr endOffset = image->baseOffset + (image->numPlatformPages << Platform::getPageSizeLog2());
+		assert(endOffset <= (memory->numPages << IR::numBytesPerPageLog2));
+		if(memory->image)
+		{
+			// The new mapping must replace all the pages mapped from the memory's current image.
+			errorUnless(memory->image->baseOffset >= image->baseOffset);
+			errorUnless(memory->image->baseOffset + (memory->numImagePlatformPages << Platform::getPageSizeLog2()) <= endOffset);
+		}
+
+		if(!Platform::mapSharedPageFile(image->file,memory->baseAddress + image->baseOffset,image->numPlatformPages)) { return false; }
+
+		++image->numReferences;
+		if(memory->image) { releaseMemoryImage(memory->image); }
+		memory->image = image;
+		memory->numImagePlatformPages = image->numPlatformPages;
+		return true;
+	}
+
+	void snapshotMemory(MemoryInstance* memory,MemorySnapshot& outSnapshot)
+	{
+		outSnapshot.numPages = memory->numPages;
+		const Uptr numBytes = outSnapshot.numPages << IR::numBytesPerPageLog2;
+		const Uptr numPlatformPages = outSnapshot.numPages << getPlatformPagesPerWebAssemblyPageLog2();
+
+		// Copy the memory's contents to an image, and remap the memory copy-on-write from it.
+		Platform::SharedPageFile* file = numBytes ? Platform::createSharedPageFile(memory->baseAddress,numBytes) : nullptr;
+		if(file)
+		{
+			outSnapshot.image = new MemoryImage(file,0,numPlatformPages);
+			if(!mapMemoryImage(memory,outSnapshot.image))
+			{
+				releaseMemoryImage(outSnapshot.image);
+				outSnapshot.image = nullptr;
+			}
+		}
+
+		// If the platform doesn't support shared page files, copy the memory's contents.
+		if(!outSnapshot.image) { outSnapshot.bytes.assign(memory->baseAddress,memory->baseAddress + numBytes); }
+	}
+
+	void resetMemory(MemoryInstance* memory,const MemorySnapshot& snapshot)
+	{
+		// Shrink or grow the memory to its size when it was snapshotted.
+		if(memory->numPages > snapshot.numPages) { errorUnless(shrinkMemory(memory,memory->numPages - snapshot.numPages) != -1); }
+		else if(memory->numPages < snapshot.numPages) { errorUnless(growMemory(memory,snapshot.numPages - memory->numPages) != -1); }
+
+		if(!snapshot.image) { std::copy(snapshot.bytes.begin(),snapshot.bytes.end(),memory->baseAddress); }
+		else if(memory->image == snapshot.image && memory->numImagePlatformPages == snapshot.image->numPlatformPages)
+		{
+			// Discard the copies of the pages that were written since the memory was mapped from the snapshot, so only
+			// those pages need to be restored.
+			Platform::resetSharedPageFileMapping(memory->baseAddress,snapshot.image->numPlatformPages);
+		}
+		else
+		{
+			// Map the snapshot over the memory. This is also needed if the memory was shrunk below its size when it was
+			// snapshotted, since part of the snapshot was unmapped.
+			errorUnless(mapMemoryImage(memory,snapshot.image));
+		}
+	}
+
+	bool clearMemory(MemoryInstance* memory,Uptr numPages)
+	{
+		// Decommit all the memory's pages, which are zero when they're committed again by growMemory.
+		unmapMemoryImage(memory,0);
+		if(memory->numPages > 0)
+		{
+			Platform::decommitVirtualPages(memory->baseAddress,memory->numPages << getPlatformPagesPerWebAssemblyPageLog2());
+			memory->numPages = 0;
+		}
+		return growMemory(memory,numPages) != -1;
+	}
+
 	MemoryInstance::~MemoryInstance()
 	{
+		// Unmap any pages mapped from a memory image, since decommitting them would just reload them from the image.
+		unmapMemoryImage(this,0);
+
 		// Decommit all default memory pages.
 		if(numPages > 0) { Platform::decommitVirtualPages(baseAddress,numPages << getPlatformPagesPerWebAssemblyPageLog2()); }
 
-		// Free the virtual address space.
-		if(reservedNumPlatformPages > 0) { Platform::freeVirtualPages(reservedBaseAddress,reservedNumPlatformPages); }
+		// Return the virtual address space to the pool if it isn't full, and otherwise free it.
+		if(reservedNumPlatformPages > 0)
+		{
+			Platform::Lock memoryPoolLock(memoryPoolMutex);
+			if(memoryPool.size() < maxPooledMemories) { memoryPool.push_back({baseAddress,reservedBaseAddress,reservedNumPlatformPages}); }
+			else { Platform::freeVirtualPages(reservedBaseAddress,reservedNumPlatformPages); }
+		}
 		reservedBaseAddress = baseAddress = nullptr;
 		reservedNumPlatformPages = 0;
 
@@ -79,6 +226,25 @@ namespace Runtime
 		return false;
 	}
 
+	void setMemoryPoolSize(Uptr numPooledMemories)
+	{
+		Platform::Lock memoryPoolLock(memoryPoolMutex);
+		maxPooledMemories = numPooledMemories;
+
+		// Free any reservations beyond the new size of the pool, or reserve address space to fill the pool.
+		while(memoryPool.size() > maxPooledMemories)
+		{
+			Platform::freeVirtualPages(memoryPool.back().reservedBaseAddress,memoryPool.back().reservedNumPlatformPages);
+			memoryPool.pop_back();
+		}
+		while(memoryPool.size() < maxPooledMemories)
+		{
+			MemoryReservation reservation;
+			if(!reserveMemoryAddressSpace(reservation)) { break; }
+			memoryPool.push_back(reservation);
+		}
+	}
+
 	Uptr getMemoryNumPages(MemoryInstance* memory) { return memory->numPages; }
 	Uptr getMemoryMaxPages(MemoryInstance* memory)
 	{
@@ -119,6 +285,7 @@ namespace Runtime
 			memory->numPages -= numPagesToShrink;
 
 			// Decommit the pages that were shrunk off the end of the memory.
+			unmapMemoryImage(memory,memory->numPages << IR::numBytesPerPageLog2);
 			Platform::decommitVirtualPages(
 				memory->baseAddress + (memory->numPages << IR::numBytesPerPageLog2),
 				numPagesToShrink << getPlatformPagesPerWebAssemblyPageLog2()
@@ -3,6 +3,8 @@
 #include "RuntimePrivate.h"
 #include "IR/Module.h"
 
+#include <algorithm>
+#include <map>
 #include <string.h>
 
 namespace Runtime
@@ -28,20 +30,212 @@ namespace Runtime
 		};
 	}
 
-	ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports)
+	// The maximum number of instance contexts that may exist at once. Table elements refer to contexts by a 32-bit index
+	// instead of a pointer to keep them small, but the array is smaller than 4G contexts to limit its address space.
+	static const Uptr maxInstanceContexts = HAS_64BIT_ADDRESS_SPACE ? (Uptr(1) << 24) : (Uptr(1) << 16);
+
+	// The indices of freed contexts, and the number of indices that have ever been used. Only accessed while
+	// instanceContextsMutex is locked.
+	static Platform::Mutex* instanceContextsMutex = Platform::createMutex();
+	static std::vector<U32> freeInstanceContextIndices;
+	static Uptr numInstanceContextIndices = 1;
+	static Uptr numCommittedInstanceContextPages = 0;
+
+	InstanceContext** getInstanceContexts()
 	{
-		ModuleInstance* moduleInstance = new ModuleInstance(
-			std::move(imports.functions),
-			std::move(imports.tables),
-			std::move(imports.memories),
-			std::move(imports.globals)
-			);
-		
-		// Get disassembly names for the module's objects.
+		// Reserve the address space for the whole array the first time it's used, so it never moves, and commit the
+		// page that contains the null context at index 0.
+		static InstanceContext** instanceContexts = []()
+		{
+			const Uptr numPages = (maxInstanceContexts * sizeof(InstanceContext*)) >> Platform::getPageSizeLog2();
+			U8* baseAddress = Platform::allocateVirtualPages(numPages);
+			if(!baseAddress || !Platform::commitVirtualPages(baseAddress,1)) { Errors::fatal("couldn't allocate the instance context array"); }
+			numCommittedInstanceContextPages = 1;
+			return (InstanceContext**)baseAddress;
+		}();
+		return instanceContexts;
+	}
+
+	static U32 allocateInstanceContextIndex(InstanceContext* context)
+	{
+		InstanceContext** instanceContexts = getInstanceContexts();
+		Platform::Lock instanceContextsLock(instanceContextsMutex);
+
+		U32 contextIndex;
+		if(freeInstanceContextIndices.size())
+		{
+			contextIndex = freeInstanceContextIndices.back();
+			freeInstanceContextIndices.pop_back();
+		}
+		else
+		{
+			if(numInstanceContextIndices == maxInstanceContexts) { Errors::fatal("ran out of instance context indices"); }
+			contextIndex = U32(numInstanceContextIndices++);
+
+			// Commit the page that contains the new index if needed.
+			const Uptr pageIndex = (contextIndex * sizeof(InstanceContext*)) >> Platform::getPageSizeLog2();
+			if(pageIndex >= numCommittedInstanceContextPages)
+			{
+				errorUnless(Platform::commitVirtualPages((U8*)instanceContexts + (pageIndex << Platform::getPageSizeLog2()),1));
+				numCommittedInstanceContextPages = pageIndex + 1;
+			}
+		}
+
+		instanceContexts[contextIndex] = context;
+		return contextIndex;
+	}
+
+	static void freeInstanceContextIndex(U32 contextIndex)
+	{
+		assert(contextIndex > 0);
+		InstanceContext** instanceContexts = getInstanceContexts();
+		Platform::Lock instanceContextsLock(instanceContextsMutex);
+		instanceContexts[contextIndex] = nullptr;
+		freeInstanceContextIndices.push_back(contextIndex);
+	}
+
+	void createInstanceContext(ModuleInstance* moduleInstance,Uptr numImportedFunctions)
+	{
+		const Uptr numGlobals = moduleInstance->globals.size();
+		U8* contextBytes = new U8[InstanceContext::getGlobalValuePointerOffset(numImportedFunctions,numGlobals)];
+		InstanceContext* context = (InstanceContext*)contextBytes;
+		context->moduleInstance = moduleInstance;
+
+		MemoryInstance* defaultMemory = moduleInstance->defaultMemory;
+		context->defaultMemoryBase = defaultMemory ? defaultMemory->baseAddress : nullptr;
+		context->defaultMemoryEndOffset = defaultMemory ? defaultMemory->endOffset : 0;
+		context->defaultMemory = defaultMemory;
+
+		TableInstance* defaultTable = moduleInstance->defaultTable;
+		context->defaultTableBase = defaultTable ? defaultTable->baseAddress : nullptr;
+		context->defaultTableEndOffset = defaultTable ? defaultTable->endOffset : 0;
+		context->defaultTable = defaultTable;
+
+		for(Uptr importIndex = 0;importIndex < numImportedFunctions;++importIndex)
+		{
+			FunctionInstance* importedFunction = moduleInstance->functions[importIndex];
+			auto importedFunctionContext = (InstanceContext::ImportedFunction*)(contextBytes + InstanceContext::getImportedFunctionOffset(importIndex));
+			importedFunctionContext->nativeFunction = importedFunction->nativeFunction.load(std::memory_order_acquire);
+			importedFunctionContext->context = getFunctionContext(importedFunction);
+		}
+
+		for(Uptr globalIndex = 0;globalIndex < numGlobals;++globalIndex)
+		{
+			auto globalValuePointer = (UntaggedValue**)(contextBytes + InstanceContext::getGlobalValuePointerOffset(numImportedFunctions,globalIndex));
+			*globalValuePointer = &moduleInstance->globals[globalIndex]->value;
+		}
+
+		moduleInstance->context = context;
+		moduleInstance->contextIndex = allocateInstanceContextIndex(context);
+	}
+
+	// Gets disassembly names for the module's functions, which are used to describe the compiled code in call stacks.
+	static std::vector<std::string> getFunctionDefDebugNames(const IR::Module& module)
+	{
+		std::vector<std::string> functionDefDebugNames;
 		DisassemblyNames disassemblyNames;
 		IR::getDisassemblyNames(module,disassemblyNames);
+		for(Uptr functionDefIndex = 0;functionDefIndex < module.functions.defs.size();++functionDefIndex)
+		{
+			const Uptr functionIndex = module.functions.imports.size() + functionDefIndex;
+			std::string debugName = disassemblyNames.functions[functionIndex].name;
+			if(!debugName.size()) { debugName = "<function #" + std::to_string(functionDefIndex) + ">"; }
+			functionDefDebugNames.push_back(debugName);
+		}
+		return functionDefDebugNames;
+	}
+
+	// The minimum number of bytes in a module's data segments for its memory to be initialized from a memory image
+	// instead of copying the segments. Mapping an image costs a few system calls, which is slower than copying small
+	// segments.
+	static const Uptr minMemoryImageDataBytes = 64 * 1024;
+
+	// Creates an image of a module's defined memory with its data segments copied into it. Returns null if the data
+	// segments are too small to benefit from it, if any segment's offset depends on an import, or if any segment
+	// doesn't fit in the memory's minimum size, in which case instantiating the module will fail anyway.
+	static MemoryImage* createMemoryImage(const IR::Module& module)
+	{
+		if(module.memories.imports.size() || module.memories.defs.size() != 1) { return nullptr; }
+
+		U64 beginOffset = UINT64_MAX;
+		U64 endOffset = 0;
+		U64 numDataBytes = 0;
+		for(const DataSegment& dataSegment : module.dataSegments)
+		{
+			if(dataSegment.baseOffset.type != InitializerExpression::Type::i32_const) { return nullptr; }
+			const U64 segmentBaseOffset = U32(dataSegment.baseOffset.i32);
+			beginOffset = std::min(beginOffset,segmentBaseOffset);
+			endOffset = std::max(endOffset,segmentBaseOffset + dataSegment.data.size());
+			numDataBytes += dataSegment.data.size();
+		}
+		if(numDataBytes < minMemoryImageDataBytes
+		|| endOffset > (module.memories.defs[0].type.size.min << IR::numBytesPerPageLog2))
+		{ return nullptr; }
+
+		// Round the image out to whole platform pages, and copy the segments into it in order.
+		const U64 pageMask = (U64(1) << Platform::getPageSizeLog2()) - 1;
+		beginOffset &= ~pageMask;
+		endOffset = (endOffset + pageMask) & ~pageMask;
+		std::vector<U8> imageBytes(Uptr(endOffset - beginOffset),0);
+		for(const DataSegment& dataSegment : module.dataSegments)
+		{
+			const U64 segmentBaseOffset = U32(dataSegment.baseOffset.i32);
+			std::copy(dataSegment.data.begin(),dataSegment.data.end(),imageBytes.begin() + Uptr(segmentBaseOffset - beginOffset));
+		}
+
+		Platform::SharedPageFile* file = Platform::createSharedPageFile(imageBytes.data(),imageBytes.size());
+		if(!file) { return nullptr; }
+		return new MemoryImage(file,Uptr(beginOffset),imageBytes.size() >> Platform::getPageSizeLog2());
+	}
+
+	CompiledModule* compileModule(const IR::Module& module,const CompileOptions& options)
+	{
+		errorUnless(options.optimizationLevel <= 3);
+
+		CompiledModule* compiledModule = new CompiledModule(module);
+		compiledModule->functionDefDebugNames = getFunctionDefDebugNames(module);
+
+		// Generate machine code for the module.
+		compiledModule->jitModule = LLVMJIT::compileModule(module,compiledModule->functionDefDebugNames,options);
+
+		// Create an image of the module's initialized memory to map into each instance's memory.
+		compiledModule->memoryImage = createMemoryImage(module);
+
+		return compiledModule;
+	}
+
+	void precompileModule(IR::Module& module,const CompileOptions& options)
+	{
+		errorUnless(options.optimizationLevel <= 3);
+		LLVMJIT::precompileModule(module,getFunctionDefDebugNames(module),options);
+	}
+
+	void releaseCompiledModule(CompiledModule* compiledModule)
+	{
+		assert(compiledModule->numReferences > 0);
+		if(--compiledModule->numReferences == 0) { delete compiledModule; }
+	}
+
+	ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports,const CompileOptions& options)
+	{
+		// Compile the module, and release the reference returned by compileModule once the instance holds its own.
+		CompiledModule* compiledModule = compileModule(module,options);
+		ModuleInstance* moduleInstance;
+		try { moduleInstance = instantiateModule(compiledModule,std::move(imports)); }
+		catch(...)
+		{
+			releaseCompiledModule(compiledModule);
+			throw;
+		}
+		releaseCompiledModule(compiledModule);
+		return moduleInstance;
+	}
+
+	// Checks the types of the objects bound to a new module instance's imports.
+	static void checkImportTypes(ModuleInstance* moduleInstance)
+	{
+		const IR::Module& module = moduleInstance->compiledModule->module;
 
-		// Check the type of the ModuleInstance's imports.
 		errorUnless(moduleInstance->functions.size() == module.functions.imports.size());
 		for(Uptr importIndex = 0;importIndex < module.functions.imports.size();++importIndex)
 		{
@@ -62,6 +256,62 @@ namespace Runtime
 		{
 			errorUnless(isA(moduleInstance->globals[importIndex],module.globals.imports[importIndex].type));
 		}
+	}
+
+	// Creates the FunctionInstances for a new module instance's function definitions, the context used by their code,
+	// and the instance's exports. The instance's imports, tables, memories, and globals must already be created.
+	static void createFunctionDefsAndExports(ModuleInstance* moduleInstance)
+	{
+		CompiledModule* compiledModule = moduleInstance->compiledModule;
+		const IR::Module& module = compiledModule->module;
+
+		// Create the FunctionInstance objects for the module's function definitions, which share the compiled module's code.
+		for(Uptr functionDefIndex = 0;functionDefIndex < module.functions.defs.size();++functionDefIndex)
+		{
+			auto functionInstance = new FunctionInstance(
+				moduleInstance,
+				module.types[module.functions.defs[functionDefIndex].type.index],
+				compiledModule->jitModule->functionDefNativeFunctions[functionDefIndex].load(std::memory_order_acquire),
+				compiledModule->functionDefDebugNames[functionDefIndex].c_str());
+			assert(functionInstance->nativeFunction);
+			moduleInstance->functionDefs.push_back(functionInstance);
+			moduleInstance->functions.push_back(functionInstance);
+		}
+
+		// Create the context that the module's compiled code uses to access the instance's objects.
+		createInstanceContext(moduleInstance,module.functions.imports.size());
+
+		// Set up the instance's exports.
+		for(const Export& exportIt : module.exports)
+		{
+			ObjectInstance* exportedObject = nullptr;
+			switch(exportIt.kind)
+			{
+			case ObjectKind::function: exportedObject = moduleInstance->functions[exportIt.index]; break;
+			case ObjectKind::table: exportedObject = moduleInstance->tables[exportIt.index]; break;
+			case ObjectKind::memory: exportedObject = moduleInstance->memories[exportIt.index]; break;
+			case ObjectKind::global: exportedObject = moduleInstance->globals[exportIt.index]; break;
+			default: Errors::unreachable();
+			}
+			moduleInstance->exportMap[exportIt.name] = exportedObject;
+		}
+	}
+
+	ModuleInstance* instantiateModule(CompiledModule* compiledModule,ImportBindings&& imports)
+	{
+		const IR::Module& module = compiledModule->module;
+
+		// The instance holds a reference to the compiled module, which it releases when it is freed.
+		++compiledModule->numReferences;
+		ModuleInstance* moduleInstance = new ModuleInstance(
+			compiledModule,
+			std::move(imports.functions),
+			std::move(imports.tables),
+			std::move(imports.memories),
+			std::move(imports.globals)
+			);
+
+		checkImportTypes(moduleInstance);
 
 		// Instantiate the module's memory and table definitions.
 		for(const TableDef& tableDef : module.tables.defs)
@@ -113,18 +363,21 @@ namespace Runtime
 			{ causeException(Exception::Cause::invalidSegmentOffset); }
 		}
 
-		// Copy the module's data segments into the module's default memory.
-		for(const DataSegment& dataSegment : module.dataSegments)
+		// Map the module's memory image into its memory, or copy the module's data segments into the module's default memory.
+		if(!compiledModule->memoryImage || !mapMemoryImage(moduleInstance->memories[0],compiledModule->memoryImage))
 		{
-			MemoryInstance* memory = moduleInstance->memories[dataSegment.memoryIndex];
+			for(const DataSegment& dataSegment : module.dataSegments)
+			{
+				MemoryInstance* memory = moduleInstance->memories[dataSegment.memoryIndex];
 
-			const Value baseOffsetValue = evaluateInitializer(moduleInstance,dataSegment.baseOffset);
-			errorUnless(baseOffsetValue.type == ValueType::i32);
-			const U32 baseOffset = baseOffsetValue.i32;
+				const Value baseOffsetValue = evaluateInitializer(moduleInstance,dataSegment.baseOffset);
+				errorUnless(baseOffsetValue.type == ValueType::i32);
+				const U32 baseOffset = baseOffsetValue.i32;
 
-			assert(baseOffset + dataSegment.data.size() <= (memory->numPages << IR::numBytesPerPageLog2));
+				assert(baseOffset + dataSegment.data.size() <= (memory->numPages << IR::numBytesPerPageLog2));
 
-			memcpy(memory->baseAddress + baseOffset,dataSegment.data.data(),dataSegment.data.size());
+				memcpy(memory->baseAddress + baseOffset,dataSegment.data.data(),dataSegment.data.size());
+			}
 		}
 		
 		// Instantiate the module's global definitions.
@@ -135,36 +388,8 @@ namespace Runtime
 			moduleInstance->globals.push_back(new GlobalInstance(globalDef.type,initialValue));
 		}
 		
-		// Create the FunctionInstance objects for the module's function definitions.
-		for(Uptr functionDefIndex = 0;functionDefIndex < module.functions.defs.size();++functionDefIndex)
-		{
-			const Uptr functionIndex = moduleInstance->functions.size();
-			const DisassemblyNames::Function& functionNames = disassemblyNames.functions[functionIndex];
-			std::string debugName = functionNames.name;
-			if(!debugName.size()) { debugName = "<function #" + std::to_string(functionDefIndex) + ">"; }
-			auto functionInstance = new FunctionInstance(moduleInstance,module.types[module.functions.defs[functionDefIndex].type.index],nullptr,debugName.c_str());
-			moduleInstance->functionDefs.push_back(functionInstance);
-			moduleInstance->functions.push_back(functionInstance);
-		}
-
-		// Generate machine code for the module.
-		LLVMJIT::instantiateModule(module,moduleInstance);
+		createFunctionDefsAndExports(moduleInstance);
 
-		// Set up the instance's exports.
-		for(const Export& exportIt : module.exports)
-		{
-			ObjectInstance* exportedObject = nullptr;
-			switch(exportIt.kind)
-			{
-			case ObjectKind::function: exportedObject = moduleInstance->functions[exportIt.index]; break;
-			case ObjectKind::table: exportedObject = moduleInstance->tables[exportIt.index]; break;
-			case ObjectKind::memory: exportedObject = moduleInstance->memories[exportIt.index]; break;
-			case ObjectKind::global: exportedObject = moduleInstance->globals[exportIt.index]; break;
-			default: Errors::unreachable();
-			}
-			moduleInstance->exportMap[exportIt.name] = exportedObject;
-		}
-		
 		// Copy the module's table segments into the module's default table.
 		for(const TableSegment& tableSegment : module.tableSegments)
 		{
@@ -194,9 +419,81 @@ namespace Runtime
 		return moduleInstance;
 	}
 
-	ModuleInstance::~ModuleInstance()
+	ModuleInstance* cloneInstance(const InstanceSnapshot* snapshot,ImportBindings&& imports)
+	{
+		CompiledModule* compiledModule = snapshot->moduleInstance->compiledModule;
+		const IR::Module& module = compiledModule->module;
+
+		// The instance holds a reference to the compiled module, which it releases when it is freed.
+		++compiledModule->numReferences;
+		ModuleInstance* moduleInstance = new ModuleInstance(
+			compiledModule,
+			std::move(imports.functions),
+			std::move(imports.tables),
+			std::move(imports.memories),
+			std::move(imports.globals)
+			);
+
+		checkImportTypes(moduleInstance);
+
+		// Create the instance's memory and table definitions empty: they are reset to the snapshot once the
+		// instance's functions are created.
+		for(const TableDef& tableDef : module.tables.defs)
+		{
+			auto table = createTable(tableDef.type);
+			if(!table) { causeException(Exception::Cause::outOfMemory); }
+			moduleInstance->tables.push_back(table);
+		}
+		for(const MemoryDef& memoryDef : module.memories.defs)
+		{
+			auto memory = createMemory(memoryDef.type);
+			if(!memory) { causeException(Exception::Cause::outOfMemory); }
+			moduleInstance->memories.push_back(memory);
+		}
+		if(moduleInstance->memories.size() != 0) { moduleInstance->defaultMemory = moduleInstance->memories[0]; }
+		if(moduleInstance->tables.size() != 0) { moduleInstance->defaultTable = moduleInstance->tables[0]; }
+
+		for(Uptr globalDefIndex = 0;globalDefIndex < module.globals.defs.size();++globalDefIndex)
+		{
+			const UntaggedValue& value = snapshot->globalValues[module.globals.imports.size() + globalDefIndex];
+			moduleInstance->globals.push_back(new GlobalInstance(module.globals.defs[globalDefIndex].type,value));
+		}
+
+		createFunctionDefsAndExports(moduleInstance);
+
+		// Map the snapshot's memory images into the new memories, and copy the snapshotted table elements, replacing
+		// the snapshotted instance's functions with the corresponding functions of the new instance.
+		resetInstance(moduleInstance,snapshot);
+
+		moduleInstances.push_back(moduleInstance);
+		return moduleInstance;
+	}
+
+	ModuleInstance* cloneInstance(ModuleInstance* sourceInstance,ImportBindings&& imports)
+	{
+		InstanceSnapshot* snapshot = snapshotInstance(sourceInstance);
+		ModuleInstance* moduleInstance;
+		try { moduleInstance = cloneInstance(snapshot,std::move(imports)); }
+		catch(...)
+		{
+			deleteInstanceSnapshot(snapshot);
+			throw;
+		}
+		deleteInstanceSnapshot(snapshot);
+		return moduleInstance;
+	}
+
+	CompiledModule::~CompiledModule()
 	{
 		delete jitModule;
+		if(memoryImage) { releaseMemoryImage(memoryImage); }
+	}
+
+	ModuleInstance::~ModuleInstance()
+	{
+		if(contextIndex) { freeInstanceContextIndex(contextIndex); }
+		delete [] (U8*)context;
+		releaseCompiledModule(compiledModule);
 	}
 
 	MemoryInstance* getDefaultMemory(ModuleInstance* moduleInstance) { return moduleInstance->defaultMemory; }
@@ -0,0 +1,275 @@
+#include "LLVMJIT.h"
+#include "Inline/BasicTypes.h"
+#include "Inline/Serialization.h"
+#include "Inline/Timing.h"
+#include "Logging/Logging.h"
+#include "WASM/WASM.h"
+#include "llvm/Config/llvm-config.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// Identifies the code generator that produced a cached object. This should be changed whenever a change to
+// the runtime would make previously generated object code incompatible.
+#define OBJECT_CACHE_VERSION "WAVM object cache 8"
+
+namespace LLVMJIT
+{
+	// The header written at the start of each cached object file or precompiled object section. It is followed by the
+	// size of each object as a U64, and then the bytes of each object. The whole key is stored, so objects are only
+	// loaded for the exact key they were compiled for, and not for a key that just has the same file name.
+	struct CachedObjectHeader
+	{
+		U64 magic;
+		SHA256::Digest key;
+		U64 numObjects;
+	};
+
+	static const U64 cachedObjectMagic = 0x6a626f6d7661770aull;
+
+	// An upper bound on the number of objects in a cached file, used to reject corrupt files before allocating memory.
+	static const U64 maxCachedObjects = 65536;
+
+	// The directory of the object cache, which may be changed while other threads are compiling modules.
+	// Only accessed while objectCacheDirectoryMutex is locked.
+	static Platform::Mutex* objectCacheDirectoryMutex = Platform::createMutex();
+	static std::string objectCacheDirectory;
+
+	static std::string getObjectCacheDirectory()
+	{
+		Platform::Lock objectCacheDirectoryLock(objectCacheDirectoryMutex);
+		return objectCacheDirectory;
+	}
+
+	static std::string getCachedObjectPath(const SHA256::Digest& key)
+	{
+		std::string path = getObjectCacheDirectory() + "/";
+		for(U8 keyByte : key.bytes)
+		{
+			char keyByteString[3];
+			snprintf(keyByteString,sizeof(keyByteString),"%02x",keyByte);
+			path += keyByteString;
+		}
+		return path + ".o";
+	}
+
+	bool isObjectCacheEnabled() { return getObjectCacheDirectory().size() > 0; }
+
+	SHA256::Digest getObjectCacheKey(const IR::Module& module,CodeTier tier,llvm::CodeGenOpt::Level optLevel,Runtime::CompileOptions::DebugInfoLevel debugInfoLevel)
+	{
+		// Serialize the module to its binary form.
+		Serialization::ArrayOutputStream stream;
+		WASM::serialize(stream,module);
+		std::vector<U8> keyBytes = stream.getBytes();
+
+		// Append a description of the target and the code generator.
+		auto appendKeyString = [&keyBytes](const std::string& string)
+		{
+			keyBytes.insert(keyBytes.end(),string.begin(),string.end());
+			keyBytes.push_back(0);
+		};
+		appendKeyString(targetMachine->getTargetTriple().str());
+		appendKeyString(targetMachine->getTargetCPU().str());
+		appendKeyString(targetMachine->getTargetFeatureString().str());
+		appendKeyString(LLVM_VERSION_STRING);
+		appendKeyString(OBJECT_CACHE_VERSION);
+		appendKeyString(tier == CodeTier::baseline ? "baseline" : "optimized");
+		appendKeyString("O" + std::to_string(int(optLevel)));
+		appendKeyString("g" + std::to_string(int(debugInfoLevel)));
+		appendKeyString(HAS_64BIT_ADDRESS_SPACE ? "64-bit address space" : "32-bit address space");
+		appendKeyString(ENABLE_SIMD_PROTOTYPE ? "SIMD" : "");
+		appendKeyString(ENABLE_THREADING_PROTOTYPE ? "threading" : "");
+
+		return SHA256::computeDigest(keyBytes.data(),keyBytes.size());
+	}
+
+	// Serializes a set of objects with a header that identifies the key they were compiled for.
+	static std::vector<U8> serializeObjects(const SHA256::Digest& key,const std::vector<std::vector<U8>>& objects)
+	{
+		assert(objects.size() > 0 && objects.size() <= maxCachedObjects);
+
+		Serialization::ArrayOutputStream stream;
+		const CachedObjectHeader header = {cachedObjectMagic,key,U64(objects.size())};
+		Serialization::serializeBytes(stream,(const U8*)&header,sizeof(header));
+		for(const std::vector<U8>& objectBytes : objects)
+		{
+			const U64 numObjectBytes = objectBytes.size();
+			Serialization::serializeBytes(stream,(const U8*)&numObjectBytes,sizeof(numObjectBytes));
+		}
+		for(const std::vector<U8>& objectBytes : objects)
+		{
+			Serialization::serializeBytes(stream,objectBytes.data(),objectBytes.size());
+		}
+		return stream.getBytes();
+	}
+
+	// Deserializes a set of objects written by serializeObjects, if they were compiled for the same key.
+	static bool deserializeObjects(const U8* bytes,Uptr numBytes,const SHA256::Digest& key,std::vector<std::vector<U8>>& outObjects)
+	{
+		// Read the header, and validate that it's an object for the same key.
+		CachedObjectHeader header;
+		if(numBytes < sizeof(header)) { return false; }
+		memcpy(&header,bytes,sizeof(header));
+		if(header.magic != cachedObjectMagic
+		|| header.key != key
+		|| header.numObjects == 0
+		|| header.numObjects > maxCachedObjects)
+		{ return false; }
+		Uptr offset = sizeof(header);
+
+		// Read the size of each object, and check that they add up to the remaining bytes.
+		std::vector<U64> objectSizes(Uptr(header.numObjects));
+		if(numBytes - offset < objectSizes.size() * sizeof(U64)) { return false; }
+		memcpy(objectSizes.data(),bytes + offset,objectSizes.size() * sizeof(U64));
+		offset += objectSizes.size() * sizeof(U64);
+		U64 numObjectBytes = 0;
+		for(U64 objectSize : objectSizes)
+		{
+			if(objectSize > numBytes - offset - numObjectBytes) { return false; }
+			numObjectBytes += objectSize;
+		}
+		if(numObjectBytes != numBytes - offset) { return false; }
+
+		// Read the object code.
+		outObjects.resize(objectSizes.size());
+		for(Uptr objectIndex = 0;objectIndex < objectSizes.size();++objectIndex)
+		{
+			const Uptr objectSize = Uptr(objectSizes[objectIndex]);
+			outObjects[objectIndex].assign(bytes + offset,bytes + offset + objectSize);
+			offset += objectSize;
+		}
+		return true;
+	}
+
+	bool loadCachedObjects(const SHA256::Digest& key,std::vector<std::vector<U8>>& outObjects)
+	{
+		Timing::Timer loadTimer;
+
+		const std::string path = getCachedObjectPath(key);
+		std::ifstream stream(path,std::ios::binary | std::ios::in);
+		if(!stream.is_open()) { return false; }
+
+		// Read the whole file.
+		std::vector<U8> fileBytes((std::istreambuf_iterator<char>(stream)),std::istreambuf_iterator<char>());
+		if(!stream.eof() && !stream)
+		{
+			Log::printf(Log::Category::debug,"Couldn't read cached object: %s\n",path.c_str());
+			return false;
+		}
+
+		if(!deserializeObjects(fileBytes.data(),fileBytes.size(),key,outObjects))
+		{
+			Log::printf(Log::Category::debug,"Ignoring invalid cached object: %s\n",path.c_str());
+			outObjects.clear();
+			return false;
+		}
+
+		Timing::logTimer("Loaded cached object code",loadTimer);
+		return true;
+	}
+
+	void storeCachedObjects(const SHA256::Digest& key,const std::vector<std::vector<U8>>& objects)
+	{
+		const std::vector<U8> fileBytes = serializeObjects(key,objects);
+
+		// Write the objects to a temporary file, then rename it, so other processes never see a partially written file.
+		// The temporary file is named by the process ID and a per-process counter, so concurrent writers of the same
+		// key in this process or others never write to the same temporary file.
+		static std::atomic<U64> nextTemporaryFileIndex(0);
+		const std::string path = getCachedObjectPath(key);
+		const std::string temporaryPath = path + ".tmp"
+			+ std::to_string(Platform::getProcessID())
+			+ "." + std::to_string(nextTemporaryFileIndex++);
+		{
+			std::ofstream stream(temporaryPath,std::ios::binary | std::ios::out | std::ios::trunc);
+			if(!stream.is_open())
+			{
+				Log::printf(Log::Category::debug,"Couldn't write cached object: %s\n",temporaryPath.c_str());
+				return;
+			}
+
+			stream.write((const char*)fileBytes.data(),fileBytes.size());
+			if(!stream)
+			{
+				stream.close();
+				std::remove(temporaryPath.c_str());
+				return;
+			}
+		}
+
+		if(std::rename(temporaryPath.c_str(),path.c_str())) { std::remove(temporaryPath.c_str()); }
+	}
+
+	// The name of the user section that holds a module's precompiled object code. The section contains the
+	// optimization level and debug info level it was compiled with as U64s, followed by the objects serialized by
+	// serializeObjects.
+	static const char* precompiledObjectSectionName = "wavm.precompiled_object";
+
+	// Returns the key for a module's precompiled objects, which is computed from the module without them.
+	static SHA256::Digest getPrecompiledObjectKey(const IR::Module& module,llvm::CodeGenOpt::Level optLevel,Runtime::CompileOptions::DebugInfoLevel debugInfoLevel)
+	{
+		IR::Module moduleWithoutObjects = module;
+		Uptr userSectionIndex;
+		if(IR::findUserSection(moduleWithoutObjects,precompiledObjectSectionName,userSectionIndex))
+		{
+			moduleWithoutObjects.userSections.erase(moduleWithoutObjects.userSections.begin() + userSectionIndex);
+		}
+		return getObjectCacheKey(moduleWithoutObjects,CodeTier::optimized,optLevel,debugInfoLevel);
+	}
+
+	void addPrecompiledObjects(IR::Module& module,llvm::CodeGenOpt::Level optLevel,Runtime::CompileOptions::DebugInfoLevel debugInfoLevel,const std::vector<std::vector<U8>>& objects)
+	{
+		// Replace any objects the module was already precompiled with.
+		Uptr userSectionIndex;
+		if(IR::findUserSection(module,precompiledObjectSectionName,userSectionIndex))
+		{
+			module.userSections.erase(module.userSections.begin() + userSectionIndex);
+		}
+
+		const U64 levels[2] = {U64(optLevel),U64(debugInfoLevel)};
+		std::vector<U8> sectionBytes((const U8*)levels,(const U8*)levels + sizeof(levels));
+		const std::vector<U8> objectBytes = serializeObjects(getPrecompiledObjectKey(module,optLevel,debugInfoLevel),objects);
+		sectionBytes.insert(sectionBytes.end(),objectBytes.begin(),objectBytes.end());
+		module.userSections.push_back({precompiledObjectSectionName,std::move(sectionBytes)});
+	}
+
+	bool loadPrecompiledObjects(
+		const IR::Module& module,
+		std::vector<std::vector<U8>>& outObjects,
+		llvm::CodeGenOpt::Level& outOptLevel,
+		Runtime::CompileOptions::DebugInfoLevel& outDebugInfoLevel)
+	{
+		Uptr userSectionIndex;
+		if(!IR::findUserSection(module,precompiledObjectSectionName,userSectionIndex)) { return false; }
+		const std::vector<U8>& sectionBytes = module.userSections[userSectionIndex].data;
+
+		// Ignore objects that were compiled for a different module, target, or version of WAVM.
+		U64 levels[2];
+		if(sectionBytes.size() < sizeof(levels)) { return false; }
+		memcpy(levels,sectionBytes.data(),sizeof(levels));
+		if(levels[0] > U64(llvm::CodeGenOpt::Aggressive)) { return false; }
+		if(levels[1] > U64(Runtime::CompileOptions::DebugInfoLevel::full)) { return false; }
+		const SHA256::Digest key = getPrecompiledObjectKey(module,llvm::CodeGenOpt::Level(levels[0]),Runtime::CompileOptions::DebugInfoLevel(levels[1]));
+		if(!deserializeObjects(sectionBytes.data() + sizeof(levels),sectionBytes.size() - sizeof(levels),key,outObjects))
+		{
+			Log::printf(Log::Category::debug,"Ignoring precompiled object code for a different target or version\n");
+			outObjects.clear();
+			return false;
+		}
+		outOptLevel = llvm::CodeGenOpt::Level(levels[0]);
+		outDebugInfoLevel = Runtime::CompileOptions::DebugInfoLevel(levels[1]);
+		return true;
+	}
+}
+
+namespace Runtime
+{
+	void setObjectCacheDirectory(const char* directory)
+	{
+		Platform::Lock objectCacheDirectoryLock(LLVMJIT::objectCacheDirectoryMutex);
+		LLVMJIT::objectCacheDirectory = directory ? directory : "";
+	}
+}
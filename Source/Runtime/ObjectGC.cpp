@@ -2,6 +2,7 @@
 #include "Runtime.h"
 #include "RuntimePrivate.h"
 #include "Intrinsics.h"
+#include "Platform/Platform.h"
 
 #include <set>
 #include <vector>
@@ -13,6 +14,10 @@ namespace Runtime
 	{
 		std::set<GCObject*> allObjects;
 
+		// The instance snapshots that haven't been deleted. They may be created and deleted on any thread.
+		Platform::Mutex* snapshotsMutex;
+		std::set<InstanceSnapshot*> snapshots;
+
 		static GCGlobals& get()
 		{
 			static GCGlobals globals;
@@ -20,7 +25,7 @@ namespace Runtime
 		}
 		
 	private:
-		GCGlobals() {}
+		GCGlobals(): snapshotsMutex(Platform::createMutex()) {}
 	};
 
 	GCObject::GCObject(ObjectKind inKind): ObjectInstance(inKind)
@@ -35,6 +40,20 @@ namespace Runtime
 		GCGlobals::get().allObjects.erase(this);
 	}
 
+	void addGCRootSnapshot(InstanceSnapshot* snapshot)
+	{
+		GCGlobals& gcGlobals = GCGlobals::get();
+		Platform::Lock snapshotsLock(gcGlobals.snapshotsMutex);
+		gcGlobals.snapshots.insert(snapshot);
+	}
+
+	void removeGCRootSnapshot(InstanceSnapshot* snapshot)
+	{
+		GCGlobals& gcGlobals = GCGlobals::get();
+		Platform::Lock snapshotsLock(gcGlobals.snapshotsMutex);
+		gcGlobals.snapshots.erase(snapshot);
+	}
+
 	void freeUnreferencedObjects(std::vector<ObjectInstance*>&& rootObjectReferences)
 	{
 		std::set<ObjectInstance*> referencedObjects;
@@ -43,6 +62,20 @@ namespace Runtime
 		// Gather GC roots from running WASM threads.
 		getThreadGCRoots(rootObjectReferences);
 
+		// Gather GC roots from instance snapshots.
+		{
+			GCGlobals& gcGlobals = GCGlobals::get();
+			Platform::Lock snapshotsLock(gcGlobals.snapshotsMutex);
+			for(InstanceSnapshot* snapshot : gcGlobals.snapshots)
+			{
+				rootObjectReferences.push_back(snapshot->moduleInstance);
+				for(const std::vector<TableElementSnapshot>& elements : snapshot->tableElements)
+				{
+					for(const TableElementSnapshot& element : elements) { rootObjectReferences.push_back(element.object); }
+				}
+			}
+		}
+
 		// Initialize the referencedObjects set from the rootObjectReferences and intrinsic objects.
 		for(auto object : rootObjectReferences)
 		{
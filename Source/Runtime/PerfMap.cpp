@@ -0,0 +1,223 @@
+#include "LLVMJIT.h"
+#include "Inline/BasicTypes.h"
+#include "Logging/Logging.h"
+#include "Platform/Platform.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <time.h>
+	#include <unistd.h>
+#endif
+
+namespace LLVMJIT
+{
+	// Whether loaded JIT code is described in a perf map or jitdump file. They may also be enabled by setting the
+	// WAVM_PERF_MAP or WAVM_JITDUMP environment variables. They're atomic since they may be set while other threads
+	// are loading JIT code.
+	static std::atomic<bool> isPerfMapEnabled(getenv("WAVM_PERF_MAP") != nullptr);
+	static std::atomic<bool> isJITDumpEnabled(getenv("WAVM_JITDUMP") != nullptr);
+
+	#ifdef __linux__
+		// The jitdump format, as described by tools/perf/Documentation/jitdump-specification.txt in the Linux source.
+		struct JITDumpFileHeader
+		{
+			U32 magic;
+			U32 version;
+			U32 totalSize;
+			U32 elfMachine;
+			U32 padding;
+			U32 processId;
+			U64 timestamp;
+			U64 flags;
+		};
+
+		struct JITDumpRecordHeader
+		{
+			U32 id;
+			U32 totalSize;
+			U64 timestamp;
+		};
+
+		// Followed by the null terminated symbol name and the code bytes.
+		struct JITDumpCodeLoadRecord
+		{
+			JITDumpRecordHeader header;
+			U32 processId;
+			U32 threadId;
+			U64 virtualAddress;
+			U64 codeAddress;
+			U64 codeSize;
+			U64 codeIndex;
+		};
+
+		// Followed by the entries, each of which is followed by a null terminated file name.
+		struct JITDumpDebugInfoRecord
+		{
+			JITDumpRecordHeader header;
+			U64 codeAddress;
+			U64 numEntries;
+		};
+
+		struct JITDumpDebugInfoEntry
+		{
+			U64 codeAddress;
+			U32 line;
+			U32 discriminator;
+		};
+
+		enum { jitDumpCodeLoadRecordId = 0, jitDumpDebugInfoRecordId = 2 };
+
+		#if defined(__x86_64__)
+			static const U32 jitDumpElfMachine = 62;
+		#elif defined(__i386__)
+			static const U32 jitDumpElfMachine = 3;
+		#elif defined(__aarch64__)
+			static const U32 jitDumpElfMachine = 183;
+		#elif defined(__arm__)
+			static const U32 jitDumpElfMachine = 40;
+		#else
+			static const U32 jitDumpElfMachine = 0;
+		#endif
+
+		// Serializes writing to the perf map and jitdump files. Each file is opened when the first symbol is added
+		// while it's enabled, so either may be enabled after the other has been written to.
+		static Platform::Mutex* perfMapMutex = Platform::createMutex();
+		static FILE* perfMapFile = nullptr;
+		static FILE* jitDumpFile = nullptr;
+		static bool hasOpenedPerfMapFile = false;
+		static bool hasOpenedJITDumpFile = false;
+		static U64 nextJITDumpCodeIndex = 0;
+
+		// Returns the time in the clock used by perf record -k mono.
+		static U64 getJITDumpTimestamp()
+		{
+			timespec monotonicClock;
+			clock_gettime(CLOCK_MONOTONIC,&monotonicClock);
+			return U64(monotonicClock.tv_sec) * 1000000000 + U64(monotonicClock.tv_nsec);
+		}
+
+		static void openPerfMapFile()
+		{
+			hasOpenedPerfMapFile = true;
+			const std::string perfMapPath = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+			perfMapFile = fopen(perfMapPath.c_str(),"a");
+			if(!perfMapFile) { Log::printf(Log::Category::error,"Couldn't open perf map: %s\n",perfMapPath.c_str()); }
+		}
+
+		static void openJITDumpFile()
+		{
+			hasOpenedJITDumpFile = true;
+			const char* jitDumpDirectory = getenv("JITDUMPDIR");
+			const std::string jitDumpPath = std::string(jitDumpDirectory ? jitDumpDirectory : "/tmp") + "/jit-" + std::to_string(getpid()) + ".dump";
+			const int fd = open(jitDumpPath.c_str(),O_CREAT | O_TRUNC | O_RDWR,0666);
+			if(fd < 0) { Log::printf(Log::Category::error,"Couldn't open jitdump file: %s\n",jitDumpPath.c_str()); return; }
+
+			// perf finds the jitdump file by looking for an executable mapping of it in the profile. The mapping is
+			// never unmapped, so it stays in the profile.
+			if(mmap(nullptr,Uptr(1) << Platform::getPageSizeLog2(),PROT_READ | PROT_EXEC,MAP_PRIVATE,fd,0) == MAP_FAILED)
+			{
+				Log::printf(Log::Category::error,"Couldn't map jitdump file: %s\n",jitDumpPath.c_str());
+				close(fd);
+				return;
+			}
+
+			jitDumpFile = fdopen(fd,"wb");
+			if(!jitDumpFile) { close(fd); return; }
+
+			const JITDumpFileHeader header =
+			{
+				0x4A695444, // "JiTD"
+				1,
+				sizeof(JITDumpFileHeader),
+				jitDumpElfMachine,
+				0,
+				U32(getpid()),
+				getJITDumpTimestamp(),
+				0
+			};
+			fwrite(&header,sizeof(header),1,jitDumpFile);
+			fflush(jitDumpFile);
+		}
+
+		static void writeJITDumpRecords(const std::string& name,Uptr baseAddress,Uptr numBytes,llvm::DWARFContext* dwarfContext)
+		{
+			// Write the line table for the code before the code itself, mapping each instruction to the index of the op
+			// it was compiled from. The symbol name is used as the file name, so perf reports ops as name:opIndex.
+			if(dwarfContext)
+			{
+				llvm::DILineInfoTable lineInfoTable = dwarfContext->getLineInfoForAddressRange(baseAddress,numBytes);
+				if(lineInfoTable.size())
+				{
+					const Uptr numEntryBytes = sizeof(JITDumpDebugInfoEntry) + name.size() + 1;
+					JITDumpDebugInfoRecord record;
+					record.header.id = jitDumpDebugInfoRecordId;
+					record.header.totalSize = U32(sizeof(record) + numEntryBytes * lineInfoTable.size());
+					record.header.timestamp = getJITDumpTimestamp();
+					record.codeAddress = baseAddress;
+					record.numEntries = lineInfoTable.size();
+					fwrite(&record,sizeof(record),1,jitDumpFile);
+					for(auto lineInfo : lineInfoTable)
+					{
+						const JITDumpDebugInfoEntry entry = {lineInfo.first,lineInfo.second.Line,0};
+						fwrite(&entry,sizeof(entry),1,jitDumpFile);
+						fwrite(name.c_str(),name.size() + 1,1,jitDumpFile);
+					}
+				}
+			}
+
+			JITDumpCodeLoadRecord record;
+			record.header.id = jitDumpCodeLoadRecordId;
+			record.header.totalSize = U32(sizeof(record) + name.size() + 1 + numBytes);
+			record.header.timestamp = getJITDumpTimestamp();
+			record.processId = U32(getpid());
+			record.threadId = U32(syscall(SYS_gettid));
+			record.virtualAddress = baseAddress;
+			record.codeAddress = baseAddress;
+			record.codeSize = numBytes;
+			record.codeIndex = nextJITDumpCodeIndex++;
+			fwrite(&record,sizeof(record),1,jitDumpFile);
+			fwrite(name.c_str(),name.size() + 1,1,jitDumpFile);
+			fwrite(reinterpret_cast<const void*>(baseAddress),numBytes,1,jitDumpFile);
+			fflush(jitDumpFile);
+		}
+	#endif
+
+	void addPerfMapSymbol(const std::string& name,Uptr baseAddress,Uptr numBytes,llvm::DWARFContext* dwarfContext)
+	{
+		if(!isPerfMapEnabled && !isJITDumpEnabled) { return; }
+
+		#ifdef __linux__
+			Platform::Lock perfMapLock(perfMapMutex);
+			if(isPerfMapEnabled && !hasOpenedPerfMapFile) { openPerfMapFile(); }
+			if(isJITDumpEnabled && !hasOpenedJITDumpFile) { openJITDumpFile(); }
+
+			if(isPerfMapEnabled && perfMapFile)
+			{
+				fprintf(perfMapFile,"%llx %llx %s\n",(unsigned long long)baseAddress,(unsigned long long)numBytes,name.c_str());
+				fflush(perfMapFile);
+			}
+
+			if(isJITDumpEnabled && jitDumpFile) { writeJITDumpRecords(name,baseAddress,numBytes,dwarfContext); }
+		#endif
+	}
+}
+
+namespace Runtime
+{
+	void setPerfMapEnabled(bool enable)
+	{
+		LLVMJIT::isPerfMapEnabled = enable;
+	}
+
+	void setJITDumpEnabled(bool enable)
+	{
+		LLVMJIT::isJITDumpEnabled = enable;
+	}
+}
@@ -110,7 +110,7 @@ namespace Runtime
 			[&]
 			{
 				// Call the invoke thunk.
-				(*invokeFunctionPointer)(function->nativeFunction,thunkMemory);
+				(*invokeFunctionPointer)(function->nativeFunction.load(std::memory_order_acquire),getFunctionContext(function),thunkMemory);
 
 				// Read the return value out of the thunk memory block.
 				if(functionType->ret != ResultType::none)
@@ -130,6 +130,31 @@ namespace Runtime
 		return function->type;
 	}
 
+	void getFunctionNativeCode(FunctionInstance* function,const FunctionType* expectedType,void*& outNativeCode,InstanceContext*& outContext)
+	{
+		if(function->type != expectedType) { throw Exception {Exception::Cause::invokeSignatureMismatch}; }
+
+		// Tiered and lazily compiled code forwards calls to the latest code for the function, so the native code may be
+		// called after the function's code is replaced.
+		outNativeCode = function->nativeFunction.load(std::memory_order_acquire);
+		outContext = getFunctionContext(function);
+	}
+
+	void callAndTurnHardwareTrapsIntoRuntimeExceptions(void (*thunk)(void*),void* thunkArgument)
+	{
+		// Only capture two pointers, so the std::function doesn't need to allocate memory for the lambda.
+		Platform::CallStack trapCallStack;
+		Uptr trapOperand;
+		const Platform::HardwareTrapType trapType = Platform::catchHardwareTraps(
+			trapCallStack,trapOperand,
+			[thunk,thunkArgument]{(*thunk)(thunkArgument);}
+			);
+		if(trapType != Platform::HardwareTrapType::none)
+		{
+			handleHardwareTrap(trapType,std::move(trapCallStack),trapOperand);
+		}
+	}
+
 	GlobalInstance* createGlobal(GlobalType type,Value initialValue)
 	{
 		return new GlobalInstance(type,initialValue);
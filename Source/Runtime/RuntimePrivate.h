@@ -3,6 +3,7 @@
 #include "Inline/BasicTypes.h"
 #include "Platform/Platform.h"
 #include "Runtime.h"
+#include "IR/Module.h"
 
 #include <functional>
 #include <map>
@@ -10,25 +11,59 @@
 
 #define HAS_64BIT_ADDRESS_SPACE (sizeof(Uptr) == 8 && !PRETEND_32BIT_ADDRESS_SPACE)
 
+namespace Runtime { struct InstanceContext; struct CompiledModule; }
+
 namespace LLVMJIT
 {
 	using namespace Runtime;
 	
 	struct JITModuleBase
 	{
+		// The native code for each of the module's function definitions. Tiered and lazily compiled code calls
+		// functions through these slots, which are replaced while other threads may be calling them: new code is
+		// published with a release store once it's executable, and must be read with an acquire load.
+		std::vector<std::atomic<void*>> functionDefNativeFunctions;
+
+		JITModuleBase(Uptr numFunctionDefs): functionDefNativeFunctions(numFunctionDefs) {}
 		virtual ~JITModuleBase() {}
 	};
 
 	void init();
-	void instantiateModule(const IR::Module& module,Runtime::ModuleInstance* moduleInstance);
+
+	// Generates and loads native code for a module. The debug names are used to describe the module's functions in call stacks.
+	JITModuleBase* compileModule(const IR::Module& module,const std::vector<std::string>& functionDefDebugNames,const CompileOptions& options);
+
+	// Generates native code for a module, and adds it to the module in a user section that compileModule loads it from.
+	void precompileModule(IR::Module& module,const std::vector<std::string>& functionDefDebugNames,const CompileOptions& options);
+
+	// Requests that a hot function of a module compiled with baseline code be recompiled with optimization on a
+	// background thread. Once the optimized code is loaded, it replaces the baseline code.
+	void requestTierUp(Runtime::CompiledModule* compiledModule,Uptr functionDefIndex);
+
+	// Waits until the optimized code for all functions that have requested it has been compiled and loaded.
+	void waitForTierUp();
+
+	// Compiles the body of a function in a lazily compiled module if it hasn't been compiled yet, and patches the
+	// instance's FunctionInstance and default table elements for it to call the compiled code directly.
+	void compileFunctionDef(Runtime::ModuleInstance* moduleInstance,Uptr functionDefIndex);
+
 	bool describeInstructionPointer(Uptr ip,std::string& outDescription);
 	
-	typedef void (*InvokeFunctionPointer)(void*,U64*);
+	typedef void (*InvokeFunctionPointer)(void*,InstanceContext*,U64*);
 
 	// Generates an invoke thunk for a specific function type.
 	InvokeFunctionPointer getInvokeThunk(const IR::FunctionType* functionType);
 }
 
+namespace Intrinsics
+{
+	// Decorates an intrinsic name with its type, to form a name that is unique among all intrinsics.
+	std::string getDecoratedName(const std::string& name,const IR::ObjectType& type);
+
+	// Finds an intrinsic function by its decorated name.
+	Runtime::FunctionInstance* findFunctionByDecoratedName(const std::string& decoratedName);
+}
+
 namespace Runtime
 {
 	using namespace IR;
@@ -45,7 +80,8 @@ namespace Runtime
 	{
 		ModuleInstance* moduleInstance;
 		const FunctionType* type;
-		void* nativeFunction;
+		// Atomic since lazy compilation patches it while other threads may be calling the function.
+		std::atomic<void*> nativeFunction;
 		std::string debugName;
 
 		FunctionInstance(ModuleInstance* inModuleInstance,const FunctionType* inType,void* inNativeFunction = nullptr,const char* inDebugName = "<unidentified FunctionInstance>")
@@ -57,9 +93,15 @@ namespace Runtime
 	{
 		struct FunctionElement
 		{
-			const FunctionType* type;
-			void* value;
+			// The canonical ID of the function's type (see getFunctionTypeID), or 0 for an undefined element.
+			U32 typeID;
+			// The index of the function's context in the array returned by getInstanceContexts.
+			U32 contextIndex;
+			// Atomic since lazy compilation patches it while other threads may be calling through the table.
+			std::atomic<void*> value;
 		};
+		static_assert(sizeof(std::atomic<void*>) == sizeof(void*),"generated code loads FunctionElement::value as a plain pointer");
+		static_assert(sizeof(FunctionElement) == 8 + sizeof(void*),"FunctionElement should be packed without padding");
 
 		TableType type;
 
@@ -76,6 +118,8 @@ namespace Runtime
 		~TableInstance() override;
 	};
 
+	struct MemoryImage;
+
 	// An instance of a WebAssembly Memory.
 	struct MemoryInstance : GCObject
 	{
@@ -88,7 +132,14 @@ namespace Runtime
 		U8* reservedBaseAddress;
 		Uptr reservedNumPlatformPages;
 
-		MemoryInstance(const MemoryType& inType): GCObject(ObjectKind::memory), type(inType), baseAddress(nullptr), numPages(0), endOffset(0), reservedBaseAddress(nullptr), reservedNumPlatformPages(0) {}
+		// The memory image that pages from image->baseOffset are mapped copy-on-write from, and how many of its pages
+		// are still mapped. The memory holds a reference to the image while any of its pages are mapped.
+		MemoryImage* image;
+		Uptr numImagePlatformPages;
+
+		MemoryInstance(const MemoryType& inType)
+		: GCObject(ObjectKind::memory), type(inType), baseAddress(nullptr), numPages(0), endOffset(0), reservedBaseAddress(nullptr), reservedNumPlatformPages(0)
+		, image(nullptr), numImagePlatformPages(0) {}
 		~MemoryInstance() override;
 	};
 
@@ -101,9 +152,85 @@ namespace Runtime
 		GlobalInstance(GlobalType inType,UntaggedValue inValue): GCObject(ObjectKind::global), type(inType), value(inValue) {}
 	};
 
+	// The contents of the platform pages of a memory from baseOffset, which is mapped copy-on-write into memories
+	// instead of copying it. It's used for a module's memory after its data segments are copied into it, and for the
+	// contents of a snapshotted memory.
+	struct MemoryImage
+	{
+		Platform::SharedPageFile* file;
+		Uptr baseOffset;
+		Uptr numPlatformPages;
+
+		// The number of references to the image: one for the compiled module or snapshot that created it, and one for
+		// each memory that maps it.
+		std::atomic<Uptr> numReferences;
+
+		MemoryImage(Platform::SharedPageFile* inFile,Uptr inBaseOffset,Uptr inNumPlatformPages)
+		: file(inFile), baseOffset(inBaseOffset), numPlatformPages(inNumPlatformPages), numReferences(1) {}
+		~MemoryImage() { Platform::destroySharedPageFile(file); }
+	};
+
+	// The contents of a memory when it was snapshotted. If the platform supports shared page files, it's an image of
+	// the whole memory that the memory is remapped from, so resetting the memory only has to discard the pages that
+	// were written since, and clones of the memory share the pages that neither has written. Otherwise, the snapshot
+	// is a copy of the memory's bytes.
+	struct MemorySnapshot
+	{
+		Uptr numPages;
+		MemoryImage* image;
+		std::vector<U8> bytes;
+
+		MemorySnapshot(): numPages(0), image(nullptr) {}
+	};
+
+	// An element of a table when it was snapshotted. If the element is a function of the snapshotted instance,
+	// functionIndex is its index in the instance's functions, so it can be mapped to the same function of other
+	// instances of the module. Otherwise, functionIndex is UINTPTR_MAX.
+	struct TableElementSnapshot
+	{
+		ObjectInstance* object;
+		Uptr functionIndex;
+	};
+
+	struct InstanceSnapshot
+	{
+		ModuleInstance* moduleInstance;
+
+		// The snapshots of the instance's memories and the elements of its tables, in the same order as the instance's
+		// memories and tables.
+		std::vector<MemorySnapshot> memories;
+		std::vector<std::vector<TableElementSnapshot>> tableElements;
+
+		// The values of the instance's globals, in the same order as the instance's globals.
+		std::vector<UntaggedValue> globalValues;
+
+		InstanceSnapshot(ModuleInstance* inModuleInstance): moduleInstance(inModuleInstance) {}
+		~InstanceSnapshot();
+	};
+
+	// A module that has been compiled to native code, which is shared by all instances of the module.
+	struct CompiledModule
+	{
+		const IR::Module module;
+		std::vector<std::string> functionDefDebugNames;
+		LLVMJIT::JITModuleBase* jitModule;
+
+		// An image of the module's initialized memory, or null if its data segments are copied into each instance's memory.
+		MemoryImage* memoryImage;
+
+		// The number of references to the compiled module: one for the handle returned by compileModule,
+		// one for each instance of the module, and one for each pending request to optimize one of its functions.
+		std::atomic<Uptr> numReferences;
+
+		CompiledModule(const IR::Module& inModule): module(inModule), jitModule(nullptr), memoryImage(nullptr), numReferences(1) {}
+		~CompiledModule();
+	};
+
 	// An instance of a WebAssembly module.
 	struct ModuleInstance : GCObject
 	{
+		CompiledModule* compiledModule;
+
 		std::map<std::string,ObjectInstance*> exportMap;
 
 		std::vector<FunctionInstance*> functionDefs;
@@ -116,30 +243,104 @@ namespace Runtime
 		MemoryInstance* defaultMemory;
 		TableInstance* defaultTable;
 
-		LLVMJIT::JITModuleBase* jitModule;
+		InstanceContext* context;
+		U32 contextIndex;
 
 		ModuleInstance(
+			CompiledModule* inCompiledModule,
 			std::vector<FunctionInstance*>&& inFunctionImports,
 			std::vector<TableInstance*>&& inTableImports,
 			std::vector<MemoryInstance*>&& inMemoryImports,
 			std::vector<GlobalInstance*>&& inGlobalImports
 			)
 		: GCObject(ObjectKind::module)
+		, compiledModule(inCompiledModule)
 		, functions(inFunctionImports)
 		, tables(inTableImports)
 		, memories(inMemoryImports)
 		, globals(inGlobalImports)
 		, defaultMemory(nullptr)
 		, defaultTable(nullptr)
-		, jitModule(nullptr)
+		, context(nullptr)
+		, contextIndex(0)
 		{}
 
 		~ModuleInstance() override;
 	};
 
+	// The per-instance data that compiled code accesses through the context pointer passed to every function.
+	// The fixed fields are followed by an ImportedFunction for each of the module's function imports, and then
+	// a pointer to the value of each of the module's globals. The IR emitter depends on this layout.
+	struct InstanceContext
+	{
+		struct ImportedFunction
+		{
+			void* nativeFunction;
+			InstanceContext* context;
+		};
+
+		ModuleInstance* moduleInstance;
+
+		U8* defaultMemoryBase;
+		Uptr defaultMemoryEndOffset;
+		MemoryInstance* defaultMemory;
+
+		TableInstance::FunctionElement* defaultTableBase;
+		Uptr defaultTableEndOffset;
+		TableInstance* defaultTable;
+
+		static Uptr getImportedFunctionOffset(Uptr importIndex)
+		{
+			return sizeof(InstanceContext) + importIndex * sizeof(ImportedFunction);
+		}
+		static Uptr getGlobalValuePointerOffset(Uptr numImportedFunctions,Uptr globalIndex)
+		{
+			return getImportedFunctionOffset(numImportedFunctions) + globalIndex * sizeof(UntaggedValue*);
+		}
+	};
+
+	// Creates the context for a module instance with all its imports, memories, tables, and globals, and sets the
+	// instance's context and context index.
+	void createInstanceContext(ModuleInstance* moduleInstance,Uptr numImportedFunctions);
+
+	// Returns the array of all instance contexts, which table elements refer to by index. Index 0 is always null, and
+	// is used for functions that aren't defined by a module instance. The array's address never changes.
+	InstanceContext** getInstanceContexts();
+
+	// Returns the context that must be passed to a function's native code.
+	inline InstanceContext* getFunctionContext(FunctionInstance* function)
+	{
+		return function->moduleInstance ? function->moduleInstance->context : nullptr;
+	}
+	inline U32 getFunctionContextIndex(FunctionInstance* function)
+	{
+		return function->moduleInstance ? function->moduleInstance->contextIndex : 0;
+	}
+
 	// Initializes global state used by the WAVM intrinsics.
 	void initWAVMIntrinsics();
 
+	// Returns a canonical ID for a function type, which call_indirect compares against the type IDs of table elements.
+	// IDs are unique within the process, and start at 1 so they never match an undefined table element.
+	U32 getFunctionTypeID(const FunctionType* type);
+	const FunctionType* getFunctionTypeFromID(U32 typeID);
+
+	// Releases a reference to a memory image, and frees it if it was the last reference.
+	void releaseMemoryImage(MemoryImage* image);
+
+	// Maps a memory image over the memory's pages it covers, which must include any pages mapped from the memory's
+	// current image. Returns false if the platform couldn't map it.
+	bool mapMemoryImage(MemoryInstance* memory,MemoryImage* image);
+
+	// Snapshots the contents of a memory, and resets a memory to the contents of a snapshot. The memory doesn't need to
+	// be the one that was snapshotted, so resetting a new memory to a snapshot clones the snapshotted memory.
+	void snapshotMemory(MemoryInstance* memory,MemorySnapshot& outSnapshot);
+	void resetMemory(MemoryInstance* memory,const MemorySnapshot& snapshot);
+
+	// Resizes a memory to the given number of pages, and sets all its bytes to zero. Returns false if the memory
+	// couldn't be grown to the new size.
+	bool clearMemory(MemoryInstance* memory,Uptr numPages);
+
 	// Checks whether an address is owned by a table or memory.
 	bool isAddressOwnedByTable(U8* address);
 	bool isAddressOwnedByMemory(U8* address);
@@ -153,4 +354,9 @@ namespace Runtime
 
 	// Adds GC roots from WASM threads to the provided array.
 	void getThreadGCRoots(std::vector<ObjectInstance*>& outGCRoots);
+
+	// Adds or removes an instance snapshot from the garbage collector's roots. A snapshot's roots are the snapshotted
+	// instance and the objects that were in its tables when it was snapshotted.
+	void addGCRootSnapshot(InstanceSnapshot* snapshot);
+	void removeGCRootSnapshot(InstanceSnapshot* snapshot);
 }
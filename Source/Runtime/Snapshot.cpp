@@ -0,0 +1,391 @@
+#include "Inline/BasicTypes.h"
+#include "Logging/Logging.h"
+#include "Runtime.h"
+#include "RuntimePrivate.h"
+#include "Inline/Serialization.h"
+#include "WASM/WASM.h"
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+#define XXH_FORCE_NATIVE_FORMAT 1
+#define XXH_PRIVATE_API
+#include "../ThirdParty/xxhash/xxhash.h"
+
+namespace Runtime
+{
+	InstanceSnapshot::~InstanceSnapshot()
+	{
+		removeGCRootSnapshot(this);
+		for(const MemorySnapshot& memorySnapshot : memories)
+		{
+			if(memorySnapshot.image) { releaseMemoryImage(memorySnapshot.image); }
+		}
+	}
+
+	InstanceSnapshot* snapshotInstance(ModuleInstance* moduleInstance)
+	{
+		InstanceSnapshot* snapshot = new InstanceSnapshot(moduleInstance);
+
+		snapshot->memories.resize(moduleInstance->memories.size());
+		for(Uptr memoryIndex = 0;memoryIndex < moduleInstance->memories.size();++memoryIndex)
+		{
+			snapshotMemory(moduleInstance->memories[memoryIndex],snapshot->memories[memoryIndex]);
+		}
+
+		// Record the index of each table element that is one of the instance's functions.
+		std::map<ObjectInstance*,Uptr> functionIndices;
+		for(Uptr functionIndex = 0;functionIndex < moduleInstance->functions.size();++functionIndex)
+		{
+			functionIndices[asObject(moduleInstance->functions[functionIndex])] = functionIndex;
+		}
+		for(TableInstance* table : moduleInstance->tables)
+		{
+			std::vector<TableElementSnapshot> elements;
+			for(ObjectInstance* element : table->elements)
+			{
+				auto functionIndexIt = element ? functionIndices.find(element) : functionIndices.end();
+				elements.push_back({element,functionIndexIt == functionIndices.end() ? UINTPTR_MAX : functionIndexIt->second});
+			}
+			snapshot->tableElements.push_back(std::move(elements));
+		}
+
+		for(GlobalInstance* global : moduleInstance->globals) { snapshot->globalValues.push_back(global->value); }
+
+		// Keep the snapshotted instance and table elements alive until the snapshot is deleted.
+		addGCRootSnapshot(snapshot);
+		return snapshot;
+	}
+
+	// Resets a table to the snapshotted elements. Elements that were functions of the snapshotted instance are
+	// replaced with the same function of moduleInstance.
+	static void resetTable(TableInstance* table,const std::vector<TableElementSnapshot>& elements,ModuleInstance* moduleInstance)
+	{
+		// Shrink or grow the table to its size when it was snapshotted.
+		if(table->elements.size() > elements.size()) { errorUnless(shrinkTable(table,table->elements.size() - elements.size()) != -1); }
+		else if(table->elements.size() < elements.size()) { errorUnless(growTable(table,elements.size() - table->elements.size()) != -1); }
+
+		// Restore the elements that were changed since the snapshot.
+		for(Uptr elementIndex = 0;elementIndex < elements.size();++elementIndex)
+		{
+			const TableElementSnapshot& elementSnapshot = elements[elementIndex];
+			ObjectInstance* element = elementSnapshot.functionIndex == UINTPTR_MAX
+				? elementSnapshot.object
+				: asObject(moduleInstance->functions[elementSnapshot.functionIndex]);
+			if(table->elements[elementIndex] == element) { continue; }
+			if(element) { setTableElement(table,elementIndex,element); }
+			else
+			{
+				table->baseAddress[elementIndex].typeID = 0;
+				table->baseAddress[elementIndex].contextIndex = 0;
+				table->baseAddress[elementIndex].value.store(nullptr,std::memory_order_release);
+				table->elements[elementIndex] = nullptr;
+			}
+		}
+	}
+
+	void resetInstance(ModuleInstance* moduleInstance,const InstanceSnapshot* snapshot)
+	{
+		// An instance may also be reset to a snapshot of another instance of the same module, such as the instance it
+		// was cloned from, in which case only the objects it defines are reset, and not its imports.
+		errorUnless(moduleInstance->compiledModule == snapshot->moduleInstance->compiledModule);
+		const IR::Module& module = moduleInstance->compiledModule->module;
+		const bool isSnapshottedInstance = moduleInstance == snapshot->moduleInstance;
+
+		for(Uptr memoryIndex = isSnapshottedInstance ? 0 : module.memories.imports.size();memoryIndex < moduleInstance->memories.size();++memoryIndex)
+		{
+			resetMemory(moduleInstance->memories[memoryIndex],snapshot->memories[memoryIndex]);
+		}
+
+		for(Uptr tableIndex = isSnapshottedInstance ? 0 : module.tables.imports.size();tableIndex < moduleInstance->tables.size();++tableIndex)
+		{
+			resetTable(moduleInstance->tables[tableIndex],snapshot->tableElements[tableIndex],moduleInstance);
+		}
+
+		// Only mutable globals can have changed since the snapshot.
+		for(Uptr globalIndex = isSnapshottedInstance ? 0 : module.globals.imports.size();globalIndex < moduleInstance->globals.size();++globalIndex)
+		{
+			GlobalInstance* global = moduleInstance->globals[globalIndex];
+			if(global->type.isMutable) { global->value = snapshot->globalValues[globalIndex]; }
+		}
+	}
+
+	void deleteInstanceSnapshot(InstanceSnapshot* snapshot)
+	{
+		delete snapshot;
+	}
+
+	// The header of an instance state file. It is followed by:
+	//   Each global's value as 16 bytes.
+	//   For each table: its number of elements as a U64, then each element as a U64: 0 for an undefined element, or
+	//   1 plus the index of its function in the instance's functions.
+	//   For each memory: an InstanceStateMemoryHeader, then the index of each page that isn't all zeroes as a U64,
+	//   then padding to a multiple of the page size, then the contents of those pages. Pages that are all zeroes are
+	//   omitted, and keeping the page contents aligned allows them to be mapped from the file.
+	struct InstanceStateHeader
+	{
+		U64 magic;
+		U64 moduleHash;
+		U64 pageSizeLog2;
+		U64 numMemories;
+		U64 numTables;
+		U64 numGlobals;
+	};
+
+	struct InstanceStateMemoryHeader
+	{
+		U64 numPages;
+		U64 numSavedPlatformPages;
+	};
+
+	static const U64 instanceStateMagic = 0x6174736d7661770aull;
+
+	static const Uptr numGlobalValueBytes = 16;
+	static_assert(sizeof(UntaggedValue) <= numGlobalValueBytes,"UntaggedValue is too big to save");
+
+	// Hashes the binary form of a module, so state can only be restored to an instance of the module it was saved from.
+	static U64 getModuleHash(const IR::Module& module)
+	{
+		Serialization::ArrayOutputStream stream;
+		WASM::serialize(stream,module);
+		const std::vector<U8> moduleBytes = stream.getBytes();
+		return XXH64(moduleBytes.data(),moduleBytes.size(),0);
+	}
+
+	static bool isZeroPage(const U8* page,Uptr numBytes)
+	{
+		const U64* words = (const U64*)page;
+		for(Uptr wordIndex = 0;wordIndex < numBytes / sizeof(U64);++wordIndex)
+		{
+			if(words[wordIndex]) { return false; }
+		}
+		return true;
+	}
+
+	static Uptr getPaddingToPageSize(Uptr offset)
+	{
+		const Uptr pageMask = (Uptr(1) << Platform::getPageSizeLog2()) - 1;
+		return ((offset + pageMask) & ~pageMask) - offset;
+	}
+
+	bool saveInstanceState(ModuleInstance* moduleInstance,const char* path)
+	{
+		std::ofstream stream(path,std::ios::binary | std::ios::out | std::ios::trunc);
+		if(!stream.is_open())
+		{
+			Log::printf(Log::Category::error,"Couldn't write instance state: %s\n",path);
+			return false;
+		}
+
+		auto writeBytes = [&stream](const void* bytes,Uptr numBytes) { stream.write((const char*)bytes,numBytes); };
+		auto writeU64 = [&stream](U64 value) { stream.write((const char*)&value,sizeof(value)); };
+
+		const InstanceStateHeader header =
+		{
+			instanceStateMagic,
+			getModuleHash(moduleInstance->compiledModule->module),
+			Platform::getPageSizeLog2(),
+			moduleInstance->memories.size(),
+			moduleInstance->tables.size(),
+			moduleInstance->globals.size()
+		};
+		writeBytes(&header,sizeof(header));
+
+		for(GlobalInstance* global : moduleInstance->globals)
+		{
+			U8 valueBytes[numGlobalValueBytes] = {0};
+			memcpy(valueBytes,&global->value,sizeof(UntaggedValue));
+			writeBytes(valueBytes,numGlobalValueBytes);
+		}
+
+		// Table elements are saved as the index of the function in the instance.
+		std::map<ObjectInstance*,Uptr> functionIndices;
+		for(Uptr functionIndex = 0;functionIndex < moduleInstance->functions.size();++functionIndex)
+		{
+			functionIndices[asObject(moduleInstance->functions[functionIndex])] = functionIndex;
+		}
+		for(TableInstance* table : moduleInstance->tables)
+		{
+			writeU64(table->elements.size());
+			for(ObjectInstance* element : table->elements)
+			{
+				if(!element) { writeU64(0); continue; }
+
+				auto functionIndexIt = functionIndices.find(element);
+				if(functionIndexIt == functionIndices.end())
+				{
+					Log::printf(Log::Category::error,"Couldn't save instance state: a table contains a function that isn't in the instance\n");
+					stream.close();
+					std::remove(path);
+					return false;
+				}
+				writeU64(functionIndexIt->second + 1);
+			}
+		}
+
+		const Uptr pageSize = Uptr(1) << Platform::getPageSizeLog2();
+		for(MemoryInstance* memory : moduleInstance->memories)
+		{
+			const Uptr numPages = memory->numPages;
+			const Uptr numPlatformPages = (numPages << IR::numBytesPerPageLog2) >> Platform::getPageSizeLog2();
+			std::vector<U64> savedPlatformPageIndices;
+			for(Uptr platformPageIndex = 0;platformPageIndex < numPlatformPages;++platformPageIndex)
+			{
+				if(!isZeroPage(memory->baseAddress + platformPageIndex * pageSize,pageSize)) { savedPlatformPageIndices.push_back(platformPageIndex); }
+			}
+
+			const InstanceStateMemoryHeader memoryHeader = {numPages,savedPlatformPageIndices.size()};
+			writeBytes(&memoryHeader,sizeof(memoryHeader));
+			writeBytes(savedPlatformPageIndices.data(),savedPlatformPageIndices.size() * sizeof(U64));
+
+			const std::vector<U8> padding(getPaddingToPageSize(Uptr(stream.tellp())),0);
+			writeBytes(padding.data(),padding.size());
+			for(U64 platformPageIndex : savedPlatformPageIndices)
+			{
+				writeBytes(memory->baseAddress + Uptr(platformPageIndex) * pageSize,pageSize);
+			}
+		}
+
+		stream.close();
+		if(!stream)
+		{
+			Log::printf(Log::Category::error,"Couldn't write instance state: %s\n",path);
+			std::remove(path);
+			return false;
+		}
+		return true;
+	}
+
+	bool restoreInstanceState(ModuleInstance* moduleInstance,const char* path)
+	{
+		std::ifstream stream(path,std::ios::binary | std::ios::in);
+		if(!stream.is_open())
+		{
+			Log::printf(Log::Category::error,"Couldn't read instance state: %s\n",path);
+			return false;
+		}
+
+		auto readBytes = [&stream](void* bytes,Uptr numBytes) { return bool(stream.read((char*)bytes,numBytes)); };
+		auto invalidState = [path](const char* reason)
+		{
+			Log::printf(Log::Category::error,"Invalid instance state (%s): %s\n",reason,path);
+			return false;
+		};
+
+		// Validate that the state is for an instance of the same module.
+		InstanceStateHeader header;
+		if(!readBytes(&header,sizeof(header)) || header.magic != instanceStateMagic) { return invalidState("bad header"); }
+		if(header.pageSizeLog2 != Platform::getPageSizeLog2()) { return invalidState("different page size"); }
+		if(header.moduleHash != getModuleHash(moduleInstance->compiledModule->module)
+		|| header.numMemories != moduleInstance->memories.size()
+		|| header.numTables != moduleInstance->tables.size()
+		|| header.numGlobals != moduleInstance->globals.size())
+		{ return invalidState("different module"); }
+
+		// Read and validate the whole file before changing the instance.
+		std::vector<UntaggedValue> globalValues(moduleInstance->globals.size());
+		for(UntaggedValue& globalValue : globalValues)
+		{
+			U8 valueBytes[numGlobalValueBytes];
+			if(!readBytes(valueBytes,numGlobalValueBytes)) { return invalidState("truncated"); }
+			memcpy(&globalValue,valueBytes,sizeof(UntaggedValue));
+		}
+
+		std::vector<std::vector<TableElementSnapshot>> tableElements(moduleInstance->tables.size());
+		for(Uptr tableIndex = 0;tableIndex < moduleInstance->tables.size();++tableIndex)
+		{
+			const TableType& tableType = moduleInstance->tables[tableIndex]->type;
+			U64 numElements;
+			if(!readBytes(&numElements,sizeof(numElements))) { return invalidState("truncated"); }
+			if(numElements < tableType.size.min || numElements > tableType.size.max) { return invalidState("table size"); }
+
+			for(U64 elementIndex = 0;elementIndex < numElements;++elementIndex)
+			{
+				U64 functionIndex;
+				if(!readBytes(&functionIndex,sizeof(functionIndex))) { return invalidState("truncated"); }
+				if(functionIndex > moduleInstance->functions.size()) { return invalidState("table element"); }
+				tableElements[tableIndex].push_back({nullptr,functionIndex ? Uptr(functionIndex - 1) : UINTPTR_MAX});
+			}
+		}
+
+		// Read the header and page indices of each memory, and skip over its pages, which are read directly into the
+		// memory once the whole file has been validated.
+		struct SavedMemory
+		{
+			Uptr numPages;
+			std::vector<U64> savedPlatformPageIndices;
+			U64 pagesOffset;
+		};
+		const Uptr pageSize = Uptr(1) << Platform::getPageSizeLog2();
+		std::vector<SavedMemory> savedMemories(moduleInstance->memories.size());
+		for(Uptr memoryIndex = 0;memoryIndex < moduleInstance->memories.size();++memoryIndex)
+		{
+			const MemoryType& memoryType = moduleInstance->memories[memoryIndex]->type;
+			SavedMemory& savedMemory = savedMemories[memoryIndex];
+
+			InstanceStateMemoryHeader memoryHeader;
+			if(!readBytes(&memoryHeader,sizeof(memoryHeader))) { return invalidState("truncated"); }
+			if(memoryHeader.numPages < memoryType.size.min
+			|| memoryHeader.numPages > memoryType.size.max
+			|| memoryHeader.numPages > IR::maxMemoryPages)
+			{ return invalidState("memory size"); }
+			const U64 numPlatformPages = (memoryHeader.numPages << IR::numBytesPerPageLog2) >> Platform::getPageSizeLog2();
+			if(memoryHeader.numSavedPlatformPages > numPlatformPages) { return invalidState("memory pages"); }
+			savedMemory.numPages = Uptr(memoryHeader.numPages);
+
+			// The saved page indices must be in ascending order, which also ensures that no page is saved twice.
+			savedMemory.savedPlatformPageIndices.resize(Uptr(memoryHeader.numSavedPlatformPages));
+			if(!readBytes(savedMemory.savedPlatformPageIndices.data(),savedMemory.savedPlatformPageIndices.size() * sizeof(U64))) { return invalidState("truncated"); }
+			for(Uptr savedPageIndex = 0;savedPageIndex < savedMemory.savedPlatformPageIndices.size();++savedPageIndex)
+			{
+				const U64 platformPageIndex = savedMemory.savedPlatformPageIndices[savedPageIndex];
+				if(platformPageIndex >= numPlatformPages
+				|| (savedPageIndex > 0 && platformPageIndex <= savedMemory.savedPlatformPageIndices[savedPageIndex - 1]))
+				{ return invalidState("memory pages"); }
+			}
+
+			savedMemory.pagesOffset = U64(stream.tellg()) + getPaddingToPageSize(Uptr(stream.tellg()));
+			stream.seekg(std::streamoff(savedMemory.pagesOffset + memoryHeader.numSavedPlatformPages * pageSize),std::ios::beg);
+		}
+
+		// Seeking past the end of the file succeeds, so check that the file ends exactly after the last memory's pages.
+		const U64 endOffset = U64(stream.tellg());
+		stream.seekg(0,std::ios::end);
+		if(!stream || U64(stream.tellg()) != endOffset) { return invalidState(U64(stream.tellg()) < endOffset ? "truncated" : "trailing bytes"); }
+
+		for(Uptr globalIndex = 0;globalIndex < moduleInstance->globals.size();++globalIndex)
+		{
+			GlobalInstance* global = moduleInstance->globals[globalIndex];
+			if(global->type.isMutable) { global->value = globalValues[globalIndex]; }
+		}
+		for(Uptr tableIndex = 0;tableIndex < moduleInstance->tables.size();++tableIndex)
+		{
+			resetTable(moduleInstance->tables[tableIndex],tableElements[tableIndex],moduleInstance);
+		}
+
+		// Clear each memory, and read the saved pages directly into it.
+		for(Uptr memoryIndex = 0;memoryIndex < moduleInstance->memories.size();++memoryIndex)
+		{
+			MemoryInstance* memory = moduleInstance->memories[memoryIndex];
+			const SavedMemory& savedMemory = savedMemories[memoryIndex];
+			if(!clearMemory(memory,savedMemory.numPages))
+			{
+				Log::printf(Log::Category::error,"Couldn't grow memory to restore instance state: %s\n",path);
+				return false;
+			}
+
+			stream.seekg(std::streamoff(savedMemory.pagesOffset),std::ios::beg);
+			for(U64 platformPageIndex : savedMemory.savedPlatformPageIndices)
+			{
+				if(!readBytes(memory->baseAddress + Uptr(platformPageIndex) * pageSize,pageSize))
+				{
+					Log::printf(Log::Category::error,"Couldn't read instance state: %s\n",path);
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+}
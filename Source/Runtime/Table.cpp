@@ -3,30 +3,91 @@
 #include "Platform/Platform.h"
 #include "RuntimePrivate.h"
 
+#include <map>
+
 namespace Runtime
 {
 	// Global lists of tables; used to query whether an address is reserved by one of them.
 	std::vector<TableInstance*> tables;
 
+	// The address space reserved for a table.
+	struct TableReservation
+	{
+		TableInstance::FunctionElement* baseAddress;
+		U8* reservedBaseAddress;
+		Uptr reservedNumPlatformPages;
+	};
+
+	// Reservations that aren't used by a table, which are reused by new tables to avoid the cost of reserving and
+	// freeing address space when tables are frequently created and destroyed. A table's pages are decommitted when
+	// its reservation is returned to the pool, so tables that reuse it start zeroed.
+	static Platform::Mutex* tablePoolMutex = Platform::createMutex();
+	static std::vector<TableReservation> tablePool;
+	static Uptr maxPooledTables = 0;
+
+	// The canonical IDs of function types. Index 0 of functionTypesByID is reserved for undefined table elements.
+	static Platform::Mutex* functionTypeIDMutex = Platform::createMutex();
+	static std::map<const FunctionType*,U32> functionTypeIDs;
+	static std::vector<const FunctionType*> functionTypesByID = {nullptr};
+
+	U32 getFunctionTypeID(const FunctionType* type)
+	{
+		Platform::Lock functionTypeIDLock(functionTypeIDMutex);
+		auto typeIDIt = functionTypeIDs.find(type);
+		if(typeIDIt != functionTypeIDs.end()) { return typeIDIt->second; }
+
+		if(functionTypesByID.size() > UINT32_MAX) { Errors::fatal("ran out of function type IDs"); }
+		const U32 typeID = U32(functionTypesByID.size());
+		functionTypesByID.push_back(type);
+		functionTypeIDs[type] = typeID;
+		return typeID;
+	}
+
+	const FunctionType* getFunctionTypeFromID(U32 typeID)
+	{
+		Platform::Lock functionTypeIDLock(functionTypeIDMutex);
+		return typeID < functionTypesByID.size() ? functionTypesByID[typeID] : nullptr;
+	}
+
 	static Uptr getNumPlatformPages(Uptr numBytes)
 	{
 		return (numBytes + (Uptr(1)<<Platform::getPageSizeLog2()) - 1) >> Platform::getPageSizeLog2();
 	}
 
-	TableInstance* createTable(TableType type)
-	{
-		TableInstance* table = new TableInstance(type);
+	// In 64-bit, allocate enough address-space to safely access 32-bit table indices without bounds checking, or 16MB (4M elements) if the host is 32-bit.
+	static const Uptr tableMaxBytes = HAS_64BIT_ADDRESS_SPACE ? Uptr(U64(sizeof(TableInstance::FunctionElement)) << 32) : 16*1024*1024;
 
-		// In 64-bit, allocate enough address-space to safely access 32-bit table indices without bounds checking, or 16MB (4M elements) if the host is 32-bit.
-		const Uptr tableMaxBytes = HAS_64BIT_ADDRESS_SPACE ? Uptr(U64(sizeof(TableInstance::FunctionElement)) << 32) : 16*1024*1024;
-		
+	static bool reserveTableAddressSpace(TableReservation& outReservation)
+	{
 		// On a 64 bit runtime, align the table base to a 4GB boundary, so the lower 32-bits will all be zero. Maybe it will allow better code generation?
 		// Note that this reserves a full extra 4GB, but only uses (4GB-1 page) for alignment, so there will always be a guard page at the end to
 		// protect against unaligned loads/stores that straddle the end of the address-space.
 		const Uptr alignmentBytes = HAS_64BIT_ADDRESS_SPACE ? Uptr(4ull*1024*1024*1024) : (Uptr(1) << Platform::getPageSizeLog2());
-		table->baseAddress = (TableInstance::FunctionElement*)allocateVirtualPagesAligned(tableMaxBytes,alignmentBytes,table->reservedBaseAddress,table->reservedNumPlatformPages);
+		outReservation.baseAddress = (TableInstance::FunctionElement*)allocateVirtualPagesAligned(tableMaxBytes,alignmentBytes,outReservation.reservedBaseAddress,outReservation.reservedNumPlatformPages);
+		return outReservation.baseAddress != nullptr;
+	}
+
+	TableInstance* createTable(TableType type)
+	{
+		TableInstance* table = new TableInstance(type);
+
+		// Reuse a pooled reservation if there is one, and otherwise reserve new address space for the table.
+		TableReservation reservation;
+		bool hasReservation = false;
+		{
+			Platform::Lock tablePoolLock(tablePoolMutex);
+			if(tablePool.size())
+			{
+				reservation = tablePool.back();
+				tablePool.pop_back();
+				hasReservation = true;
+			}
+		}
+		if(!hasReservation && !reserveTableAddressSpace(reservation)) { delete table; return nullptr; }
+		table->baseAddress = reservation.baseAddress;
+		table->reservedBaseAddress = reservation.reservedBaseAddress;
+		table->reservedNumPlatformPages = reservation.reservedNumPlatformPages;
 		table->endOffset = tableMaxBytes;
-		if(!table->baseAddress) { delete table; return nullptr; }
 		
 		// Grow the table to the type's minimum size.
 		assert(type.size.min <= UINTPTR_MAX);
@@ -42,8 +103,13 @@ namespace Runtime
 		// Decommit all pages.
 		if(elements.size() > 0) { Platform::decommitVirtualPages((U8*)baseAddress,getNumPlatformPages(elements.size() * sizeof(TableInstance::FunctionElement))); }
 
-		// Free the virtual address space.
-		if(reservedNumPlatformPages > 0) { Platform::freeVirtualPages((U8*)reservedBaseAddress,reservedNumPlatformPages); }
+		// Return the virtual address space to the pool if it isn't full, and otherwise free it.
+		if(reservedNumPlatformPages > 0)
+		{
+			Platform::Lock tablePoolLock(tablePoolMutex);
+			if(tablePool.size() < maxPooledTables) { tablePool.push_back({baseAddress,reservedBaseAddress,reservedNumPlatformPages}); }
+			else { Platform::freeVirtualPages((U8*)reservedBaseAddress,reservedNumPlatformPages); }
+		}
 		reservedBaseAddress = nullptr;
 		reservedNumPlatformPages = 0;
 		baseAddress = nullptr;
@@ -67,14 +133,36 @@ namespace Runtime
 		return false;
 	}
 
+	void setTablePoolSize(Uptr numPooledTables)
+	{
+		Platform::Lock tablePoolLock(tablePoolMutex);
+		maxPooledTables = numPooledTables;
+
+		// Free any reservations beyond the new size of the pool, or reserve address space to fill the pool.
+		while(tablePool.size() > maxPooledTables)
+		{
+			Platform::freeVirtualPages(tablePool.back().reservedBaseAddress,tablePool.back().reservedNumPlatformPages);
+			tablePool.pop_back();
+		}
+		while(tablePool.size() < maxPooledTables)
+		{
+			TableReservation reservation;
+			if(!reserveTableAddressSpace(reservation)) { break; }
+			tablePool.push_back(reservation);
+		}
+	}
+
 	ObjectInstance* setTableElement(TableInstance* table,Uptr index,ObjectInstance* newValue)
 	{
 		// Write the new table element to both the table's elements array and its indirect function call data.
+		// The element's code is written last with release ordering, so generated code that loads it with acquire
+		// ordering also sees the type ID and context index written for it.
 		assert(index < table->elements.size());
 		FunctionInstance* functionInstance = asFunction(newValue);
 		assert(functionInstance->nativeFunction);
-		table->baseAddress[index].type = functionInstance->type;
-		table->baseAddress[index].value = functionInstance->nativeFunction;
+		table->baseAddress[index].typeID = getFunctionTypeID(functionInstance->type);
+		table->baseAddress[index].contextIndex = getFunctionContextIndex(functionInstance);
+		table->baseAddress[index].value.store(functionInstance->nativeFunction.load(std::memory_order_acquire),std::memory_order_release);
 		auto oldValue = table->elements[index];
 		table->elements[index] = newValue;
 		return oldValue;
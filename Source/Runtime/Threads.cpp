@@ -261,21 +261,23 @@ namespace Runtime
 			causeException(Runtime::Exception::Cause::undefinedTableElement);
 		}
 		// Validate  that the indexed function's type matches the expected type.
-		const FunctionType* actualSignature = table->baseAddress[elementIndex].type;
-		if(actualSignature != expectedType)
+		if(table->baseAddress[elementIndex].typeID != getFunctionTypeID(expectedType))
 		{
 			causeException(Runtime::Exception::Cause::indirectCallSignatureMismatch);
 		}
 		return asFunction(table->elements[elementIndex]);
 	}
 
-	void callAndTurnHardwareTrapsIntoRuntimeExceptions(void (*function)(I32),I32 argument)
+	void callAndTurnHardwareTrapsIntoRuntimeExceptions(FunctionInstance* function,I32 argument)
 	{
+		auto nativeFunction = (void(*)(InstanceContext*,I32))function->nativeFunction.load(std::memory_order_acquire);
+		InstanceContext* context = getFunctionContext(function);
+
 		Platform::CallStack trapCallStack;
 		Uptr trapOperand;
 		const Platform::HardwareTrapType trapType = Platform::catchHardwareTraps(
 			trapCallStack,trapOperand,
-			[function,argument]{(*function)(argument);}
+			[nativeFunction,context,argument]{(*nativeFunction)(context,argument);}
 			);
 		if(trapType != Platform::HardwareTrapType::none)
 		{
@@ -288,7 +290,7 @@ namespace Runtime
 		try
 		{
 			// Call the thread entry function.
-			callAndTurnHardwareTrapsIntoRuntimeExceptions((void(*)(I32))thread->entryFunction->nativeFunction,argument);
+			callAndTurnHardwareTrapsIntoRuntimeExceptions(thread->entryFunction,argument);
 		}
 		catch(Runtime::Exception exception)
 		{
@@ -300,7 +302,7 @@ namespace Runtime
 			try
 			{
 				// Call the thread error function.
-				callAndTurnHardwareTrapsIntoRuntimeExceptions((void(*)(I32))thread->errorFunction->nativeFunction,argument);
+				callAndTurnHardwareTrapsIntoRuntimeExceptions(thread->errorFunction,argument);
 			}
 			catch(Runtime::Exception secondException)
 			{
@@ -1,128 +1,15 @@
 #include "Inline/BasicTypes.h"
-#include "Inline/Floats.h"
 #include "Logging/Logging.h"
 #include "Intrinsics.h"
 #include "RuntimePrivate.h"
 
-#include <math.h>
-
 namespace Runtime
 {
-	template<typename Float>
-	Float quietNaN(Float value)
-	{
-		Floats::FloatComponents<Float> components;
-		components.value = value;
-		components.bits.significand |= typename Floats::FloatComponents<Float>::Bits(1) << (Floats::FloatComponents<Float>::numSignificandBits - 1);
-		return components.value;
-	}
-
-	template<typename Float>
-	Float floatMin(Float left,Float right)
-	{
-		// If either operand is a NaN, convert it to a quiet NaN and return it.
-		if(left != left) { return quietNaN(left); }
-		else if(right != right) { return quietNaN(right); }
-		// If either operand is less than the other, return it.
-		else if(left < right) { return left; }
-		else if(right < left) { return right; }
-		else
-		{
-			// Finally, if the operands are apparently equal, compare their integer values to distinguish -0.0 from +0.0
-			Floats::FloatComponents<Float> leftComponents;
-			leftComponents.value = left;
-			Floats::FloatComponents<Float> rightComponents;
-			rightComponents.value = right;
-			return leftComponents.bitcastInt < rightComponents.bitcastInt ? right : left;
-		}
-	}
-	
-	template<typename Float>
-	Float floatMax(Float left,Float right)
-	{
-		// If either operand is a NaN, convert it to a quiet NaN and return it.
-		if(left != left) { return quietNaN(left); }
-		else if(right != right) { return quietNaN(right); }
-		// If either operand is less than the other, return it.
-		else if(left > right) { return left; }
-		else if(right > left) { return right; }
-		else
-		{
-			// Finally, if the operands are apparently equal, compare their integer values to distinguish -0.0 from +0.0
-			Floats::FloatComponents<Float> leftComponents;
-			leftComponents.value = left;
-			Floats::FloatComponents<Float> rightComponents;
-			rightComponents.value = right;
-			return leftComponents.bitcastInt > rightComponents.bitcastInt ? right : left;
-		}
-	}
-
-	template<typename Float>
-	Float floatCeil(Float value)
-	{
-		if(value != value) { return quietNaN(value); }
-		else { return ceil(value); }
-	}
-	
-	template<typename Float>
-	Float floatFloor(Float value)
-	{
-		if(value != value) { return quietNaN(value); }
-		else { return floor(value); }
-	}
-	
-	template<typename Float>
-	Float floatTrunc(Float value)
+	DEFINE_INTRINSIC_FUNCTION0(wavmIntrinsics,invalidFloatOperationTrap,invalidFloatOperationTrap,none)
 	{
-		if(value != value) { return quietNaN(value); }
-		else { return trunc(value); }
-	}
-	
-	template<typename Float>
-	Float floatNearest(Float value)
-	{
-		if(value != value) { return quietNaN(value); }
-		else { return nearbyint(value); }
-	}
-
-	DEFINE_INTRINSIC_FUNCTION2(wavmIntrinsics,floatMin,floatMin,f32,f32,left,f32,right) { return floatMin(left,right); }
-	DEFINE_INTRINSIC_FUNCTION2(wavmIntrinsics,floatMin,floatMin,f64,f64,left,f64,right) { return floatMin(left,right); }
-	DEFINE_INTRINSIC_FUNCTION2(wavmIntrinsics,floatMax,floatMax,f32,f32,left,f32,right) { return floatMax(left,right); }
-	DEFINE_INTRINSIC_FUNCTION2(wavmIntrinsics,floatMax,floatMax,f64,f64,left,f64,right) { return floatMax(left,right); }
-
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatCeil,floatCeil,f32,f32,value) { return floatCeil(value); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatCeil,floatCeil,f64,f64,value) { return floatCeil(value); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatFloor,floatFloor,f32,f32,value) { return floatFloor(value); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatFloor,floatFloor,f64,f64,value) { return floatFloor(value); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatTrunc,floatTrunc,f32,f32,value) { return floatTrunc(value); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatTrunc,floatTrunc,f64,f64,value) { return floatTrunc(value); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatNearest,floatNearest,f32,f32,value) { return floatNearest(value); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatNearest,floatNearest,f64,f64,value) { return floatNearest(value); }
-
-	template<typename Dest,typename Source,bool isMinInclusive>
-	Dest floatToInt(Source sourceValue,Source minValue,Source maxValue)
-	{
-		if(sourceValue != sourceValue)
-		{
-			causeException(Exception::Cause::invalidFloatOperation);
-		}
-		else if(sourceValue >= maxValue || (isMinInclusive ? sourceValue <= minValue : sourceValue < minValue))
-		{
-			causeException(Exception::Cause::integerDivideByZeroOrIntegerOverflow);
-		}
-		return (Dest)sourceValue;
+		causeException(Exception::Cause::invalidFloatOperation);
 	}
 
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatToSignedInt,floatToSignedInt,i32,f32,source) { return floatToInt<I32,F32,false>(source,(F32)INT32_MIN,-(F32)INT32_MIN); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatToSignedInt,floatToSignedInt,i32,f64,source) { return floatToInt<I32,F64,false>(source,(F64)INT32_MIN,-(F64)INT32_MIN); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatToSignedInt,floatToSignedInt,i64,f32,source) { return floatToInt<I64,F32,false>(source,(F32)INT64_MIN,-(F32)INT64_MIN); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatToSignedInt,floatToSignedInt,i64,f64,source) { return floatToInt<I64,F64,false>(source,(F64)INT64_MIN,-(F64)INT64_MIN); }
-	
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatToUnsignedInt,floatToUnsignedInt,i32,f32,source) { return floatToInt<U32,F32,true>(source,-1.0f,-2.0f * INT32_MIN); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatToUnsignedInt,floatToUnsignedInt,i32,f64,source) { return floatToInt<U32,F64,true>(source,-1.0,-2.0 * INT32_MIN); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatToUnsignedInt,floatToUnsignedInt,i64,f32,source) { return floatToInt<U64,F32,true>(source,-1.0f,-2.0f * INT64_MIN); }
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,floatToUnsignedInt,floatToUnsignedInt,i64,f64,source) { return floatToInt<U64,F64,true>(source,-1.0,-2.0 * INT64_MIN); }
-
 	DEFINE_INTRINSIC_FUNCTION0(wavmIntrinsics,divideByZeroOrIntegerOverflowTrap,divideByZeroOrIntegerOverflowTrap,none)
 	{
 		causeException(Exception::Cause::integerDivideByZeroOrIntegerOverflow);
@@ -138,12 +25,12 @@ namespace Runtime
 		causeException(Exception::Cause::accessViolation);
 	}
 
-	DEFINE_INTRINSIC_FUNCTION3(wavmIntrinsics,indirectCallSignatureMismatch,indirectCallSignatureMismatch,none,i32,index,i64,expectedSignatureBits,i64,tableBits)
+	DEFINE_INTRINSIC_FUNCTION3(wavmIntrinsics,indirectCallSignatureMismatch,indirectCallSignatureMismatch,none,i32,index,i32,expectedTypeID,i64,tableBits)
 	{
 		TableInstance* table = reinterpret_cast<TableInstance*>(tableBits);
 		void* elementValue = table->baseAddress[index].value;
-		const FunctionType* actualSignature = table->baseAddress[index].type;
-		const FunctionType* expectedSignature = reinterpret_cast<const FunctionType*>((Uptr)expectedSignatureBits);
+		const FunctionType* actualSignature = getFunctionTypeFromID(table->baseAddress[index].typeID);
+		const FunctionType* expectedSignature = getFunctionTypeFromID(U32(expectedTypeID));
 		std::string ipDescription = "<unknown>";
 		LLVMJIT::describeInstructionPointer(reinterpret_cast<Uptr>(elementValue),ipDescription);
 		Log::printf(Log::Category::debug,"call_indirect signature mismatch: expected %s at index %u but got %s (%s)\n",
@@ -178,18 +65,28 @@ namespace Runtime
 		return (U32)numMemoryPages;
 	}
 
+	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,requestTierUp,requestTierUp,none,i64,functionDefIndex)
+	{
+		LLVMJIT::requestTierUp(instanceContext->moduleInstance->compiledModule,Uptr(functionDefIndex));
+	}
+
+	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,compileFunctionDef,compileFunctionDef,none,i64,functionDefIndex)
+	{
+		LLVMJIT::compileFunctionDef(instanceContext->moduleInstance,Uptr(functionDefIndex));
+	}
+
 	THREAD_LOCAL Uptr indentLevel = 0;
 
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,debugEnterFunction,debugEnterFunction,none,i64,functionInstanceBits)
+	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,debugEnterFunction,debugEnterFunction,none,i64,functionDefIndex)
 	{
-		FunctionInstance* function = reinterpret_cast<FunctionInstance*>(functionInstanceBits);
+		FunctionInstance* function = instanceContext->moduleInstance->functionDefs[Uptr(functionDefIndex)];
 		Log::printf(Log::Category::debug,"ENTER: %s\n",function->debugName.c_str());
 		++indentLevel;
 	}
 	
-	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,debugExitFunction,debugExitFunction,none,i64,functionInstanceBits)
+	DEFINE_INTRINSIC_FUNCTION1(wavmIntrinsics,debugExitFunction,debugExitFunction,none,i64,functionDefIndex)
 	{
-		FunctionInstance* function = reinterpret_cast<FunctionInstance*>(functionInstanceBits);
+		FunctionInstance* function = instanceContext->moduleInstance->functionDefs[Uptr(functionDefIndex)];
 		--indentLevel;
 		Log::printf(Log::Category::debug,"EXIT:  %s\n",function->debugName.c_str());
 	}
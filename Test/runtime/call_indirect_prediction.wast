@@ -0,0 +1,50 @@
+;; call_indirect directly calls the callee it predicts from the module's table segments when the table element is that
+;; function. Check that other functions of the same type in the same table, including functions of other instances
+;; with the same code, are called with their own instance's state.
+
+(module $Predicted
+  (type $getter (func (result i32)))
+  (global $value i32 (i32.const 1))
+  (table (export "table") 5 anyfunc)
+  (elem (i32.const 0) $get)
+  (func $get (type $getter) (get_global $value))
+  (func (export "call") (param i32) (result i32) (call_indirect $getter (get_local 0)))
+)
+(register "Predicted" $Predicted)
+
+;; The same code as the predicted callee, but in an instance with a different global value.
+(module $SameCode
+  (type $getter (func (result i32)))
+  (global $value i32 (i32.const 2))
+  (table (import "Predicted" "table") 5 anyfunc)
+  (elem (i32.const 1) $get)
+  (func $get (type $getter) (get_global $value))
+  (func (export "call") (param i32) (result i32) (call_indirect $getter (get_local 0)))
+)
+
+;; A different function with the same type.
+(module $Other
+  (type $getter (func (result i32)))
+  (table (import "Predicted" "table") 5 anyfunc)
+  (elem (i32.const 2) $get)
+  (func $get (type $getter) (i32.const 3))
+)
+
+;; A function with a different type.
+(module
+  (table (import "Predicted" "table") 5 anyfunc)
+  (elem (i32.const 3) $get)
+  (func $get (result i64) (i64.const 4))
+)
+
+(assert_return (invoke $Predicted "call" (i32.const 0)) (i32.const 1))
+(assert_return (invoke $Predicted "call" (i32.const 1)) (i32.const 2))
+(assert_return (invoke $Predicted "call" (i32.const 2)) (i32.const 3))
+(assert_trap (invoke $Predicted "call" (i32.const 3)) "indirect call")
+(assert_trap (invoke $Predicted "call" (i32.const 4)) "uninitialized")
+
+(assert_return (invoke $SameCode "call" (i32.const 0)) (i32.const 1))
+(assert_return (invoke $SameCode "call" (i32.const 1)) (i32.const 2))
+(assert_return (invoke $SameCode "call" (i32.const 2)) (i32.const 3))
+(assert_trap (invoke $SameCode "call" (i32.const 3)) "indirect call")
+(assert_trap (invoke $SameCode "call" (i32.const 4)) "uninitialized")